@@ -18,6 +18,7 @@ BuildRequires:  expat-devel
 BuildRequires:  cmake
 BuildRequires:  gettext-devel
 BuildRequires:  pkgconfig(json-glib-1.0)
+BuildRequires:  pkgconfig(gdk-pixbuf-2.0)
 
 %description
 A service to export OFono/Obex functionality over DBUS, to be used by WebRuntime plugin
@@ -45,6 +46,7 @@ rm -rf %{buildroot}
 
 %files
 %{_libdir}/pkgconfig/phoned.pc
+%{_includedir}/phoned/pbexport.h
 %{_prefix}/sbin/phoned
 %{_prefix}/share/dbus-1/services/org.tizen.phone.service
 %{_prefix}/lib/systemd/user/phoned.service
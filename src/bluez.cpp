@@ -19,6 +19,9 @@ namespace PhoneD {
 #define BLUEZ_DEVICE_IFACE      BLUEZ_PREFIX ".Device1"
 #define BLUEZ_AGENT_IFACE       BLUEZ_PREFIX ".Agent1"
 
+#define OBJECT_MANAGER_IFACE    "org.freedesktop.DBus.ObjectManager"
+#define PROPERTIES_IFACE        "org.freedesktop.DBus.Properties"
+
 #define AGENT_PATH              "/org/bluez/poc_agent"
 #define AGENT_CAPABILITIES      "KeyboardDisplay"
 
@@ -39,35 +42,45 @@ namespace PhoneD {
 
 Bluez::Bluez() :
     mAdapterPath(NULL),
+    mSignals(this),
     mAgentRegistrationId(-1),
     mAgentIntrospectionData(NULL)
 {
     LoggerD("entered");
 
+    memset(&mAgentIfaceVTable, 0, sizeof(mAgentIfaceVTable));
+
+    mSignals.add(OBJECT_MANAGER_IFACE, "InterfacesAdded", "(oa{sa{sv}})", &Bluez::interfacesAddedSignal);
+    mSignals.add(OBJECT_MANAGER_IFACE, "InterfacesRemoved", "(oas)", &Bluez::interfacesRemovedSignal);
+    mSignals.add(PROPERTIES_IFACE, "PropertiesChanged", "(sa{sv}as)", &Bluez::propertiesChangedSignal);
+    mSignals.add(BLUEZ_ADAPTER_IFACE, "DeviceCreated", "(o)", &Bluez::deviceCreatedSignal);
+    mSignals.add(BLUEZ_ADAPTER_IFACE, "DeviceRemoved", "(o)", &Bluez::deviceRemovedSignal);
+    mSignals.add(BLUEZ_ADAPTER_IFACE, "PropertyChanged", "(sv)", &Bluez::adapterPropertyChangedSignal);
+    mSignals.add(BLUEZ_DEVICE_IFACE, "PropertyChanged", "(sv)", &Bluez::devicePropertyChangedSignal);
+
+    // subscribe for InterfacesAdded/InterfacesRemoved to get notification about the change
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, OBJECT_MANAGER_IFACE,
+                       "/", "InterfacesAdded");
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, OBJECT_MANAGER_IFACE,
+                       "/", "InterfacesRemoved");
+    // the properties of all adapters and devices, to keep the mirror up to date
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, PROPERTIES_IFACE,
+                       NULL, "PropertiesChanged");
+
+    // the objects are loaded once the signals are subscribed, so that no change is missed
+    loadObjects();
     mAdapterPath = getDefaultAdapter();
     if(!mAdapterPath) {
         LoggerE("Unable to get default adapter");
     }
-    memset(&mAgentIfaceVTable, 0, sizeof(mAgentIfaceVTable));
-
-    // subscribe for InterfacesAdded/InterfacesRemoved to get notification about the change
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, "org.freedesktop.DBus.ObjectManager",
-                             "/", "InterfacesAdded", Bluez::handleSignal,
-                             this);
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, "org.freedesktop.DBus.ObjectManager",
-                             "/", "InterfacesRemoved", Bluez::handleSignal,
-                             this);
 
     if(mAdapterPath) {
-        Utils::setSignalListener(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, BLUEZ_ADAPTER_IFACE,
-                                 mAdapterPath, "DeviceCreated", Bluez::handleSignal,
-                                 this);
-        Utils::setSignalListener(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, BLUEZ_ADAPTER_IFACE,
-                                 mAdapterPath, "DeviceRemoved", Bluez::handleSignal,
-                                 this);
-        Utils::setSignalListener(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, BLUEZ_ADAPTER_IFACE,
-                                 mAdapterPath, "PropertyChanged", Bluez::handleSignal,
-                                 this);
+        mSignals.subscribe(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, BLUEZ_ADAPTER_IFACE,
+                           mAdapterPath, "DeviceCreated");
+        mSignals.subscribe(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, BLUEZ_ADAPTER_IFACE,
+                           mAdapterPath, "DeviceRemoved");
+        mSignals.subscribe(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, BLUEZ_ADAPTER_IFACE,
+                           mAdapterPath, "PropertyChanged");
     }
 }
 
@@ -80,64 +93,122 @@ Bluez::~Bluez() {
 
 gchar* Bluez::getDefaultAdapter()
 {
-	char *result;
-
-	GError * error = nullptr;
-	GDBusProxy * managerProxy = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE, NULL,
-	                            "org.bluez",
-	                            "/",
-	                            "org.freedesktop.DBus.ObjectManager",
-	                            nullptr,&error);
-	if(error)
-	{
-		LoggerE("could not create ObjManager proxy");
-		// DebugOut(DebugOut::Error)<<"Could not create ObjectManager proxy for Bluez: "<<error->message<<endl;
-		g_error_free(error);
-		return "";
-	}
-
-	GVariant * objectMap = g_dbus_proxy_call_sync(managerProxy, "GetManagedObjects",nullptr, G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-
-	if(error)
-	{
-		LoggerE("failed to get GetManagedObj");
-		//DebugOut(DebugOut::Error)<<"Failed call to GetManagedObjects: "<<error->message<<endl;
-		g_object_unref(managerProxy);
-		g_error_free(error);
-		return "";
-	}
-
-	GVariantIter* iter;
-	char* objPath;
-	GVariantIter* level2Dict;
-
-	g_variant_get(objectMap, "(a{oa{sa{sv}}})",&iter);
-	while(g_variant_iter_next(iter, "{oa{sa{sv}}}",&objPath, &level2Dict))
-	{
-		char * interfaceName;
-		GVariantIter* innerDict;
-		while(g_variant_iter_next(level2Dict, "{sa{sv}}", &interfaceName, &innerDict))
-		{
-			if(!strcmp(interfaceName, "org.bluez.Adapter1"))
-			{
-				result = objPath?strdup(objPath):NULL;
-			}
-			g_free(interfaceName);
-			g_variant_iter_free(innerDict);
-		}
-		g_free(objPath);
-		g_variant_iter_free(level2Dict);
-	}
-	g_variant_iter_free(iter);
-
-	return result;
+    // the adapters are not ordered in the mirror, take the first one by the path, eg. /org/bluez/hci0
+    const std::string *result = NULL;
+    for(auto it = mAdapters.begin(); it != mAdapters.end(); ++it) {
+        if(!result || (*it).first < *result)
+            result = &(*it).first;
+    }
+    return result ? strdup(result->c_str()) : NULL;
+}
+
+const char *Bluez::getDeviceFromAddress(const std::string &address) const
+{
+    auto it = mDeviceAddresses.find(address);
+    return (it != mDeviceAddresses.end()) ? (*it).second.c_str() : NULL;
+}
+
+void Bluez::loadObjects() {
+    GError *err = NULL;
+    GVariant *reply = NULL;
+    reply = g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SYSTEM),
+                                         BLUEZ_SERVICE,
+                                         "/",
+                                         OBJECT_MANAGER_IFACE,
+                                         "GetManagedObjects",
+                                         NULL,
+                                         G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+                                         G_DBUS_CALL_FLAGS_NONE,
+                                         -1,
+                                         NULL,
+                                         &err);
+
+    if(err || !reply) {
+        if(err) {
+            LoggerE("Failed to call 'GetManagedObjects' DBUS method: " << err->message);
+            g_error_free(err);
+        }
+        else if(!reply)
+            LoggerE("Reply from calling 'GetManagedObjects' is NULL");
+        return;
+    }
+
+    GVariantIter *objects = NULL;
+    GVariantIter *interfaces = NULL;
+    const char *path = NULL;
+    g_variant_get(reply, "(a{oa{sa{sv}}})", &objects);
+    while(g_variant_iter_next(objects, "{&oa{sa{sv}}}", &path, &interfaces)) {
+        const char *iface = NULL;
+        GVariantIter *props = NULL;
+        while(g_variant_iter_next(interfaces, "{&sa{sv}}", &iface, &props)) {
+            addInterface(path, iface, props);
+            g_variant_iter_free(props);
+        }
+        g_variant_iter_free(interfaces);
+    }
+    g_variant_iter_free(objects);
+    g_variant_unref(reply);
+
+    LoggerD("Loaded " << mAdapters.size() << " adapter(s) and " << mDevices.size() << " device(s)");
+}
+
+void Bluez::addInterface(const char *path, const char *iface, GVariantIter *props) {
+    if(!strcmp(iface, BLUEZ_ADAPTER_IFACE)) {
+        bool &powered = mAdapters[path];
+        const char *key = NULL;
+        GVariant *value = NULL;
+        while(g_variant_iter_next(props, "{&sv}", &key, &value)) {
+            if(!strcmp(key, "Powered") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN))
+                powered = g_variant_get_boolean(value);
+            g_variant_unref(value);
+        }
+    }
+    else if(!strcmp(iface, BLUEZ_DEVICE_IFACE)) {
+        updateDevice(path, props);
+    }
+}
+
+void Bluez::removeInterface(const char *path, const char *iface) {
+    if(!strcmp(iface, BLUEZ_ADAPTER_IFACE)) {
+        mAdapters.erase(path);
+    }
+    else if(!strcmp(iface, BLUEZ_DEVICE_IFACE)) {
+        auto it = mDevices.find(path);
+        if(it == mDevices.end())
+            return;
+        auto address = mDeviceAddresses.find((*it).second.address);
+        if(address != mDeviceAddresses.end() && (*address).second == path)
+            mDeviceAddresses.erase(address);
+        mDevices.erase(it);
+    }
+}
+
+void Bluez::updateDevice(const char *path, GVariantIter *props) {
+    Device &device = mDevices[path];
+    const char *key = NULL;
+    GVariant *value = NULL;
+    while(g_variant_iter_next(props, "{&sv}", &key, &value)) {
+        if(!strcmp(key, "Address") && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+            const char *address = g_variant_get_string(value, NULL);
+            if(device.address != address) {
+                if(!device.address.empty())
+                    mDeviceAddresses.erase(device.address);
+                device.address = address;
+                mDeviceAddresses[device.address] = path;
+            }
+        }
+        else if(!strcmp(key, "Paired") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+            device.paired = g_variant_get_boolean(value);
+        }
+        g_variant_unref(value);
+    }
 }
 
 bool Bluez::setAdapterPowered(bool value) {
     if(mAdapterPath) {
         GError *err = NULL;
 
-		g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,NULL),
+		g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SYSTEM),
 		                             BLUEZ_SERVICE,
 		                             mAdapterPath,
 		                             "org.freedesktop.DBus.Properties",
@@ -161,124 +232,109 @@ bool Bluez::setAdapterPowered(bool value) {
     return false;
 }
 
-void Bluez::handleSignal(GDBusConnection  *connection,
-                         const gchar      *sender,
-                         const gchar      *object_path,
-                         const gchar      *interface_name,
-                         const gchar      *signal_name,
-                         GVariant         *parameters,
-                         gpointer          user_data)
-{
-    LoggerD("signal received: '" << interface_name << "' -> '" << signal_name << "' -> '" << object_path << "'");
-
-    Bluez *ctx = static_cast<Bluez*>(user_data);
-    if(!ctx) {
-        LoggerD("Failed to cast to Bluez");
-        return;
-    }
-
-    if(!strcmp(interface_name, "org.freedesktop.DBus.ObjectManager")) {
-        if(!strcmp(signal_name, "InterfacesAdded"))
-        {
-			char *objPath = NULL;
-			GVariantIter* iter;
-
-			g_variant_get(parameters, "(oa{sa{sv}})", &objPath, &iter);
-
-			if(objPath)
-			{
-				GVariantIter* iter2;
-				char *interface = NULL;
-
-				while(g_variant_iter_next(iter, "{sa{sv}}",&interface, &iter2))
-				{
-
-					if(!strcmp(interface, "org.bluez.Adapter1"))
-					{
-						LoggerD("Adapter added: " << objPath);
-						if(!ctx->mAdapterPath) {
-						// make added adapter as default
-						ctx->mAdapterPath = strdup(objPath);
-						//ctx->setupAgent();
-						//ctx->registerAgent();
-						ctx->defaultAdapterAdded();
-						}
-					}
-				}
-        }
-	}
-        else if(!strcmp(signal_name, "InterfacesRemoved")) {
-            char *objPath = NULL;
-			GVariantIter* iter;
-
-			g_variant_get(parameters, "(oa{sa{sv}})", &objPath, &iter);
-
-			if(objPath)
-			{
-				GVariantIter* iter2;
-				char *interface = NULL;
-
-				while(g_variant_iter_next(iter, "{sa{sv}}",&interface, &iter2))
-				{
-
-					if(!strcmp(interface, "org.bluez.Adapter1"))
-					{
-						LoggerD("Adapter removed: " << objPath);
-						if(ctx->mAdapterPath && !strcmp(ctx->mAdapterPath, objPath)) {
-							// removed the default adapter
-							free(ctx->mAdapterPath);
-							ctx->mAdapterPath = NULL;
-							ctx->defaultAdapterRemoved();
-						}
-					}
+// the parameters of the signals are checked by mSignals, see Bluez::Bluez()
+void Bluez::interfacesAddedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *objPath = NULL;
+    GVariantIter *iter = NULL;
+    g_variant_get(parameters, "(&oa{sa{sv}})", &objPath, &iter);
+
+    const char *interface = NULL;
+    GVariantIter *props = NULL;
+    while(g_variant_iter_next(iter, "{&sa{sv}}", &interface, &props)) {
+        addInterface(objPath, interface, props);
+        g_variant_iter_free(props);
+        if(!strcmp(interface, BLUEZ_ADAPTER_IFACE)) {
+            LoggerD("Adapter added: " << objPath);
+            if(!mAdapterPath) {
+                // make added adapter as default
+                mAdapterPath = strdup(objPath);
+                //setupAgent();
+                //registerAgent();
+                defaultAdapterAdded();
             }
         }
     }
+    g_variant_iter_free(iter);
 }
-    else if(!strcmp(interface_name, BLUEZ_ADAPTER_IFACE)) {
-        if(!strcmp(signal_name, "DeviceCreated")) {
-            const char *device;
-            g_variant_get(parameters, "(o)", &device);
-            LoggerD("DeviceCreated: " << (device?device:"UNKNOWN"));
-
-            // subscribe for PropertyChanged signal on the device,
-            // to get notification about device being paired
-            Utils::setSignalListener(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, BLUEZ_DEVICE_IFACE,
-                                     device, "PropertyChanged", Bluez::handleSignal,
-                                     ctx);
 
+void Bluez::interfacesRemovedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *objPath = NULL;
+    GVariantIter *iter = NULL;
+    g_variant_get(parameters, "(&oas)", &objPath, &iter);
+
+    const char *interface = NULL;
+    while(g_variant_iter_next(iter, "&s", &interface)) {
+        removeInterface(objPath, interface);
+        if(!strcmp(interface, BLUEZ_DEVICE_IFACE)) {
+            // the device is gone, so are its signals
+            Utils::removeSignalListeners(G_BUS_TYPE_SYSTEM, objPath);
         }
-        else if(!strcmp(signal_name, "DeviceRemoved")) {
-            const char *device;
-            g_variant_get(parameters, "(o)", &device);
-            LoggerD("DeviceRemoved: " << (device?device:"UNKNOWN"));
-            ctx->deviceRemoved(device);
-        }
-        else if(!strcmp(signal_name, "PropertyChanged")) {
-            const char *name;
-            GVariant *v_value;
-            g_variant_get(parameters, "(sv)", &name, &v_value);
-            LoggerD("\tname=" << name);
-            if(!strcmp(name, "Powered")) {
-                bool value = g_variant_get_boolean(v_value);
-                ctx->adapterPowered(value);
-                //LoggerD("\tvalue=" << (value?"TRUE":"FALSE"));
+        else if(!strcmp(interface, BLUEZ_ADAPTER_IFACE)) {
+            LoggerD("Adapter removed: " << objPath);
+            if(mAdapterPath && !strcmp(mAdapterPath, objPath)) {
+                // removed the default adapter
+                free(mAdapterPath);
+                mAdapterPath = NULL;
+                defaultAdapterRemoved();
             }
         }
     }
-    else if(!strcmp(interface_name, BLUEZ_DEVICE_IFACE)) {
-        if(!strcmp(signal_name, "PropertyChanged")) {
-            const char *name;
-            GVariant *value;
-            g_variant_get(parameters, "(sv)", &name, &value);
-            if(!strcmp(name, "Paired")) {
-                bool paired = g_variant_get_boolean(value);
-                if(paired) { // the device has been paired
-                    ctx->deviceCreated(object_path);
-                }
-            }
+    g_variant_iter_free(iter);
+}
+
+void Bluez::propertiesChangedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *iface = NULL;
+    GVariantIter *props = NULL;
+    g_variant_get(parameters, "(&sa{sv}as)", &iface, &props, NULL);
+    // only the properties of the objects, which are already known, are updated, the objects are added by InterfacesAdded
+    if(!strcmp(iface, BLUEZ_ADAPTER_IFACE) && mAdapters.find(objectPath) != mAdapters.end())
+        addInterface(objectPath, iface, props);
+    else if(!strcmp(iface, BLUEZ_DEVICE_IFACE) && mDevices.find(objectPath) != mDevices.end())
+        updateDevice(objectPath, props);
+    g_variant_iter_free(props);
+}
+
+void Bluez::deviceCreatedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *device = NULL;
+    g_variant_get(parameters, "(&o)", &device);
+    LoggerD("DeviceCreated: " << device);
+
+    // subscribe for PropertyChanged signal on the device,
+    // to get notification about device being paired
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, BLUEZ_SERVICE, BLUEZ_DEVICE_IFACE,
+                       device, "PropertyChanged");
+}
+
+void Bluez::deviceRemovedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *device = NULL;
+    g_variant_get(parameters, "(&o)", &device);
+    LoggerD("DeviceRemoved: " << device);
+    Utils::removeSignalListeners(G_BUS_TYPE_SYSTEM, device);
+    deviceRemoved(device);
+}
+
+void Bluez::adapterPropertyChangedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *name = NULL;
+    GVariant *value = NULL;
+    g_variant_get(parameters, "(&sv)", &name, &value);
+    LoggerD("\tname=" << name);
+    if(!strcmp(name, "Powered") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+        adapterPowered(g_variant_get_boolean(value));
+    }
+    g_variant_unref(value);
+}
+
+void Bluez::devicePropertyChangedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *name = NULL;
+    GVariant *value = NULL;
+    g_variant_get(parameters, "(&sv)", &name, &value);
+    if(!strcmp(name, "Paired") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+        bool paired = g_variant_get_boolean(value);
+        if(paired) { // the device has been paired
+            deviceCreated(objectPath);
         }
     }
+    g_variant_unref(value);
 }
 
 void Bluez::agentHandleMethodCall( GDBusConnection       *connection,
@@ -310,7 +366,7 @@ void Bluez::agentHandleMethodCall( GDBusConnection       *connection,
     }
     else if (!strcmp(method_name, "Release")) {
         if(!strcmp(object_path, AGENT_PATH)) { // released agent for pairing
-            bool unregistered = g_dbus_connection_unregister_object(g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL), ctx->mAgentRegistrationId);
+            bool unregistered = g_dbus_connection_unregister_object(BusConnection::get(G_BUS_TYPE_SYSTEM), ctx->mAgentRegistrationId);
             if(unregistered)
                 ctx->mAgentRegistrationId = -1;
         }
@@ -322,118 +378,16 @@ void Bluez::agentHandleMethodCall( GDBusConnection       *connection,
     }
 }
 
-gchar* Bluez::getDeviceFromAddress(std::string &address)
-{
-	char *result = NULL;
-	bool done = false;
-
-	GError * error = nullptr;
-	GDBusProxy * managerProxy = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE, NULL,
-	                            "org.bluez",
-	                            "/",
-	                            "org.freedesktop.DBus.ObjectManager",
-	                            nullptr,&error);
-	if(error)
-	{
-		LoggerE("could not create ObjManager proxy");
-		// DebugOut(DebugOut::Error)<<"Could not create ObjectManager proxy for Bluez: "<<error->message<<endl;
-		g_error_free(error);
-		return "";
-	}
-
-	GVariant * objectMap = g_dbus_proxy_call_sync(managerProxy, "GetManagedObjects",nullptr, G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-
-	if(error)
-	{
-		LoggerE("failed to get GetManagedObj");
-		//DebugOut(DebugOut::Error)<<"Failed call to GetManagedObjects: "<<error->message<<endl;
-		g_object_unref(managerProxy);
-		g_error_free(error);
-		return "";
-	}
-
-	GVariantIter* iter;
-	char* objPath;
-	GVariantIter* level2Dict;
-
-	g_variant_get(objectMap, "(a{oa{sa{sv}}})",&iter);
-	while(g_variant_iter_next(iter, "{oa{sa{sv}}}",&objPath, &level2Dict))
-	{
-		char * interfaceName;
-		GVariantIter* innerDict;
-		while(g_variant_iter_next(level2Dict, "{sa{sv}}", &interfaceName, &innerDict))
-		{
-			if(!strcmp(interfaceName, "org.bluez.Device1"))
-			{
-				char* propertyName;
-				GVariant* value;
-
-				while(done == false && g_variant_iter_next(innerDict,"{sv}", &propertyName, &value))
-				{
-					if(!strcmp(propertyName, "Address"))
-					{
-						char* addr;
-						g_variant_get(value,"s",&addr);
-						if(addr && std::string(addr) == address)
-						{
-
-							result = objPath?strdup(objPath):NULL;
-							done = true;
-							LoggerD("getDeviceFromAddress found : " << result);
-						}
-
-						g_free(addr);
-					}
-					g_free(propertyName);
-					g_variant_unref(value);
-				}
-			}
-			g_free(interfaceName);
-			g_variant_iter_free(innerDict);
-		}
-		g_free(objPath);
-		g_variant_iter_free(level2Dict);
-	}
-	g_variant_iter_free(iter);
-
-	return result;
-}
-
 bool Bluez::isDevicePaired(const char *bt_addr) {
-    bool paired = false;
-    std::string addrStr = std::string(bt_addr);
-    gchar* device = getDeviceFromAddress(addrStr);
-
-    if(!mAdapterPath)
-        return paired;
-
-    GError *err = NULL;
-    GVariant *reply = NULL;
-	reply = g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL),
-	                                     BLUEZ_SERVICE,
-	                                     device,
-	                                     "org.freedesktop.DBus.Properties",
-	                                     "Get",
-	                                     g_variant_new("(ss)", "org.bluez.Device1", "Paired"),
-	                                     NULL,
-	                                     G_DBUS_CALL_FLAGS_NONE,
-	                                     -1,
-	                                     NULL,
-	                                     &err);
-
-    if(err || !reply) {
-        if(err)
-            g_error_free(err);
-        return paired;
-    }
-
-	GVariant *value;
-	g_variant_get(reply, "(v)", &value);
-	paired = g_variant_get_boolean(value);
+    if(!mAdapterPath || !bt_addr)
+        return false;
 
-	g_variant_unref(reply);
+    const char *device = getDeviceFromAddress(bt_addr);
+    if(!device)
+        return false;
 
-    return paired;
+    auto it = mDevices.find(device);
+    return (it != mDevices.end()) ? (*it).second.paired : false;
 }
 
 void Bluez::setupAgent()
@@ -457,7 +411,7 @@ void Bluez::setupAgent()
     LoggerD("introspection data parsed OK");
 
     GError *err = NULL;
-    mAgentRegistrationId = g_dbus_connection_register_object( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL),
+    mAgentRegistrationId = g_dbus_connection_register_object( BusConnection::get(G_BUS_TYPE_SYSTEM),
                                                   AGENT_PATH,
                                                   mAgentIntrospectionData->interfaces[0],
                                                   &mAgentIfaceVTable, //const GDBusInterfaceVTable *vtable,
@@ -478,7 +432,7 @@ void Bluez::registerAgent()
     LoggerD("entered");
 
     GError *err = NULL;
-    g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL),
+    g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SYSTEM),
                                  BLUEZ_SERVICE,
                                  mAdapterPath,
                                  BLUEZ_ADAPTER_IFACE,
@@ -8,6 +8,9 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+
+#include "utils.h"
 
 namespace PhoneD {
 
@@ -31,6 +34,7 @@ class Bluez {
          * \li "DeviceCreated" on \b org.bluez.Adapter interface - To get notified when a device (remote device) is created, ie. when pairing is initiated.
          * \li "DeviceRemoved" on \b org.bluez.Adapter interface - To get notified when a device (remote device) is removed, ie. when the device is unpaired.
          * \li "PropertyChanged" on \b org.bluez.Adapter interface - To get notified when there is a change in some of adapter's properties, eg. when the adapter is "Powered", the name of adapter has changed, etc.
+         * \li "PropertiesChanged" on \b org.freedesktop.DBus.Properties interface of all objects - To keep the adapters and the devices, which are loaded once by \b GetManagedObjects, up to date.
          */
         Bluez();
 
@@ -69,15 +73,21 @@ class Bluez {
         bool setAdapterPowered(bool value); // Power ON/OFF hci0 adapter
 
     private:
-        gchar* getDefaultAdapter();
-        gchar* getDeviceFromAddress(std::string &address);
-        static void handleSignal(GDBusConnection *connection,
-                                 const gchar     *sender,
-                                 const gchar     *object_path,
-                                 const gchar     *interface_name,
-                                 const gchar     *signal_name,
-                                 GVariant        *parameters,
-                                 gpointer         user_data);
+        gchar* getDefaultAdapter(); // the first of the known adapters, or NULL, the caller frees the path
+        const char *getDeviceFromAddress(const std::string &address) const; // path of the device, or NULL
+        // the mirror of the adapters and the devices of org.bluez
+        void loadObjects(); // seeds the mirror by a single "GetManagedObjects" call
+        void addInterface(const char *path, const char *iface, GVariantIter *props); // props - 'a{sv}'
+        void removeInterface(const char *path, const char *iface);
+        void updateDevice(const char *path, GVariantIter *props);
+        // targets of the signals, see mSignals
+        void interfacesAddedSignal(const gchar *objectPath, GVariant *parameters);
+        void interfacesRemovedSignal(const gchar *objectPath, GVariant *parameters);
+        void propertiesChangedSignal(const gchar *objectPath, GVariant *parameters);
+        void deviceCreatedSignal(const gchar *objectPath, GVariant *parameters);
+        void deviceRemovedSignal(const gchar *objectPath, GVariant *parameters);
+        void adapterPropertyChangedSignal(const gchar *objectPath, GVariant *parameters);
+        void devicePropertyChangedSignal(const gchar *objectPath, GVariant *parameters);
 
         static void agentHandleMethodCall( GDBusConnection       *connection,
                                            const gchar           *sender,
@@ -94,8 +104,22 @@ class Bluez {
         virtual void deviceCreated(const char *device) = 0;
         virtual void deviceRemoved(const char *device) = 0;
 
+    private:
+        // a device as it is known from org.bluez.Device1 interface
+        struct Device {
+            Device() : paired(false) {}
+            std::string address;
+            bool paired;
+        };
+
     private:
         gchar* mAdapterPath;
+        SignalRouter<Bluez> mSignals;
+
+        // mirror of org.bluez objects, see loadObjects()
+        std::unordered_map<std::string, bool> mAdapters;               // path -> 'Powered'
+        std::unordered_map<std::string, Device> mDevices;              // path -> device
+        std::unordered_map<std::string, std::string> mDeviceAddresses; // address -> path
 
         // Agent
         int mAgentRegistrationId;
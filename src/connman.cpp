@@ -46,7 +46,7 @@ void ConnMan::init() {
 char *ConnMan::getBluetoothTechnology() {
     GError *err = NULL;
     GVariant *reply = NULL;
-    reply = g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,NULL),
+    reply = g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SYSTEM),
                                          CONNMAN_SERVICE,
                                          "/",
                                          CONNMAN_MANAGER_IFACE,
@@ -97,7 +97,7 @@ bool ConnMan::setBluetoothPowered(bool value) {
     char *bluetooth = getBluetoothTechnology();
     if(bluetooth) {
         GError *err = NULL;
-        g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,NULL),
+        g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SYSTEM),
                                      CONNMAN_SERVICE,
                                      bluetooth,
                                      CONNMAN_TECHNOLOGY_IFACE,
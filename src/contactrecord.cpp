@@ -0,0 +1,225 @@
+
+#include "contactrecord.h"
+#include "phonenumberindex.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <unordered_set>
+
+namespace PhoneD {
+
+// the string shared by the records, it's allocated with the characters following the header
+struct SharedString {
+    guint refs;
+    char str[1];
+};
+
+struct SharedStringHash {
+    size_t operator()(const char *str) const { return g_str_hash(str); }
+};
+struct SharedStringEqual {
+    bool operator()(const char *a, const char *b) const { return !strcmp(a, b); }
+};
+
+// the arena of the strings of all records, keyed by the characters of SharedString; it's never freed, since the records
+// may be destroyed by static destructors
+static std::unordered_set<const char*, SharedStringHash, SharedStringEqual> *sStrings = NULL;
+static GMutex sStringsLock; // the records are made on the parser threads
+
+static SharedString *sharedString(const char *str) {
+    return reinterpret_cast<SharedString*>(const_cast<char*>(str) - offsetof(SharedString, str));
+}
+
+// the lock has to be held
+static const char *internString(const char *str) {
+    if(!sStrings)
+        sStrings = new std::unordered_set<const char*, SharedStringHash, SharedStringEqual>();
+    auto it = sStrings->find(str);
+    if(it != sStrings->end()) {
+        sharedString(*it)->refs++;
+        return *it;
+    }
+    size_t length = strlen(str);
+    SharedString *shared = static_cast<SharedString*>(g_malloc(offsetof(SharedString, str) + length + 1));
+    shared->refs = 1;
+    memcpy(shared->str, str, length + 1);
+    sStrings->insert(shared->str);
+    return shared->str;
+}
+
+// the lock has to be held
+static void releaseString(const char *str) {
+    SharedString *shared = sharedString(str);
+    if(--shared->refs == 0) {
+        sStrings->erase(str);
+        g_free(shared);
+    }
+}
+
+static void appendUInt32(std::string &buffer, guint32 value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static bool readUInt32(const char **data, const char *end, guint32 &value) {
+    if((size_t)(end - *data) < sizeof(value))
+        return false;
+    memcpy(&value, *data, sizeof(value));
+    *data += sizeof(value);
+    return true;
+}
+
+ContactRecord::ContactRecord() :
+    mData(NULL)
+{
+}
+
+ContactRecord::~ContactRecord() {
+    release();
+}
+
+void ContactRecord::release() {
+    if(!mData)
+        return;
+    unsigned int count = slotCount();
+    g_mutex_lock(&sStringsLock);
+    for(unsigned int i=0; i<count; i++) {
+        const char *str = string(i);
+        if(str)
+            releaseString(str);
+    }
+    g_mutex_unlock(&sStringsLock);
+    g_free(mData);
+    mData = NULL;
+}
+
+void ContactRecord::make(const Header &header, const std::vector<const char*> &slots) {
+    Header made = header;
+    made.size = sizeof(Header) + slots.size() * sizeof(const char*);
+    mData = static_cast<char*>(g_malloc(made.size));
+    memcpy(mData, &made, sizeof(made));
+
+    const char **strings = reinterpret_cast<const char**>(mData + sizeof(Header));
+    g_mutex_lock(&sStringsLock);
+    for(unsigned int i=0; i<slots.size(); i++)
+        strings[i] = (slots[i] && slots[i][0]) ? internString(slots[i]) : NULL;
+    g_mutex_unlock(&sStringsLock);
+}
+
+void ContactRecord::assign(EContact *econtact) {
+    release();
+    if(!econtact)
+        return;
+
+    // the values are collected in the order of the slots, they are referenced until the block is made
+    std::vector<const char*> slots;
+    slots.push_back((const char*)e_contact_get_const(econtact, E_CONTACT_FULL_NAME));
+    slots.push_back((const char*)e_contact_get_const(econtact, E_CONTACT_GIVEN_NAME));
+    slots.push_back((const char*)e_contact_get_const(econtact, E_CONTACT_FAMILY_NAME));
+    EContactPhoto *photo = (EContactPhoto*)e_contact_get(econtact, E_CONTACT_PHOTO);
+    slots.push_back((photo && E_CONTACT_PHOTO_TYPE_URI == photo->type) ? e_contact_photo_get_uri(photo) : NULL);
+    slots.push_back((const char*)e_contact_get_const(econtact, E_CONTACT_REV));   // 'REV' holds call date/time
+    slots.push_back((const char*)e_contact_get_const(econtact, E_CONTACT_NOTE));  // 'NOTE' holds direction of the call
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+
+    GList *phoneNumbersList = (GList*)e_contact_get(econtact, E_CONTACT_TEL);
+    std::vector<std::string> normalized(g_list_length(phoneNumbersList)); // not resized, the slots point to the strings
+    for(GList *number = phoneNumbersList; number; number = number->next) {
+        const char *phoneNumber = (const char*)number->data;
+        if(!phoneNumber || !phoneNumber[0])
+            continue;
+        PhoneNumberIndex::normalize(phoneNumber, normalized[header.numbers]);
+        slots.push_back(phoneNumber);
+        slots.push_back(normalized[header.numbers].c_str());
+        header.numbers++;
+    }
+
+    for(int id=E_CONTACT_FIRST_EMAIL_ID; id<=E_CONTACT_LAST_EMAIL_ID; id++) {
+        const char *email = (const char*)e_contact_get_const(econtact, (EContactField)id);
+        if(email && email[0]) {
+            slots.push_back(email);
+            header.emails++;
+        }
+    }
+
+    EContactAddress *addresses[E_CONTACT_ADDRESS_OTHER - E_CONTACT_ADDRESS_HOME + 1];
+    for(int id=E_CONTACT_ADDRESS_HOME; id<=E_CONTACT_ADDRESS_OTHER; id++) {
+        EContactAddress *address = (EContactAddress*)e_contact_get(econtact, (EContactField)id);
+        addresses[id - E_CONTACT_ADDRESS_HOME] = address;
+        if(!address)
+            continue;
+        slots.push_back(id==E_CONTACT_ADDRESS_HOME ? "HOME" : (id==E_CONTACT_ADDRESS_WORK ? "WORK" : "OTHER"));
+        slots.push_back(address->country);
+        slots.push_back(address->region);
+        slots.push_back(address->locality);
+        slots.push_back(address->street);
+        slots.push_back(address->code);
+        header.addresses++;
+    }
+
+    make(header, slots);
+
+    for(unsigned int i=0; i<sizeof(addresses)/sizeof(addresses[0]); i++) {
+        if(addresses[i])
+            e_contact_address_free(addresses[i]);
+    }
+    g_list_free_full(phoneNumbersList, g_free);
+    e_contact_photo_free(photo);
+}
+
+// the record is stored as: uint32 numbers, uint32 emails, uint32 addresses, { uint32 length, string } * slots,
+// the normalized numbers are skipped, an empty string stands for the string, which is not set
+void ContactRecord::write(std::string &buffer) const {
+    appendUInt32(buffer, numberCount());
+    appendUInt32(buffer, emailCount());
+    appendUInt32(buffer, addressCount());
+    unsigned int count = slotCount();
+    for(unsigned int i=0; i<count; i++) {
+        if(i >= FIELD_COUNT && i < FIELD_COUNT + 2*numberCount() && (i - FIELD_COUNT) % 2)
+            continue;
+        const char *str = string(i);
+        size_t length = str ? strlen(str) : 0;
+        appendUInt32(buffer, length);
+        buffer.append(str ? str : "", length);
+    }
+}
+
+bool ContactRecord::read(const char **data, const char *end) {
+    release();
+
+    guint32 numbers = 0, emails = 0, addresses = 0;
+    if(!readUInt32(data, end, numbers) || !readUInt32(data, end, emails) || !readUInt32(data, end, addresses) ||
+       numbers > G_MAXUINT16 || emails > G_MAXUINT8 || addresses > G_MAXUINT8)
+        return false;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.numbers = numbers;
+    header.emails = emails;
+    header.addresses = addresses;
+
+    // the strings are copied, so that they are terminated, the slots point to them
+    unsigned int count = FIELD_COUNT + 2*numbers + emails + ADDRESS_FIELD_COUNT*addresses;
+    std::vector<std::string> strings(count);
+    std::vector<const char*> slots(count, NULL);
+    for(unsigned int i=0; i<count; i++) {
+        bool normalized = i >= FIELD_COUNT && i < FIELD_COUNT + 2*numbers && (i - FIELD_COUNT) % 2;
+        if(normalized) {
+            PhoneNumberIndex::normalize(strings[i-1].c_str(), strings[i]);
+        }
+        else {
+            guint32 length = 0;
+            if(!readUInt32(data, end, length) || (size_t)(end - *data) < length)
+                return false;
+            strings[i].assign(*data, length);
+            *data += length;
+        }
+        slots[i] = strings[i].c_str();
+    }
+
+    make(header, slots);
+    return true;
+}
+
+} // PhoneD
@@ -0,0 +1,173 @@
+#ifndef CONTACTRECORD_H_
+#define CONTACTRECORD_H_
+
+#include <libebook-contacts/libebook-contacts.h>
+#include <string>
+#include <vector>
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::ContactRecord
+ *  \brief Flat, read-only copy of the fields of the contact, or of the call history entry, which are served to the clients.
+ *
+ * The record is filled in once, when the VCard is ingested, so that the indexes, the serializers and the export read the fields
+ * without going through EContact. The strings are interned in one arena shared by all records, ie. each distinct string, eg. a first
+ * name, or a city, is stored only once, regardless of how many contacts, or synchronizations, reference it. The record itself is one
+ * block of memory with the references to the strings. The phone numbers are stored also normalized, see PhoneNumberIndex::normalize().
+ * The VCard is not kept, the record is stored into the phonebook cache by write().
+ */
+class ContactRecord {
+    public:
+        /*! Single-valued fields of the record. */
+        enum Field {
+            FULL_NAME = 0,              /*!< E_CONTACT_FULL_NAME. */
+            GIVEN_NAME,                 /*!< E_CONTACT_GIVEN_NAME. */
+            FAMILY_NAME,                /*!< E_CONTACT_FAMILY_NAME. */
+            PHOTO_URI,                  /*!< URI of E_CONTACT_PHOTO, the inline photos are replaced by URIs on ingest. */
+            CALL_TIME,                  /*!< E_CONTACT_REV, it holds date/time of the call, see VCardReader. */
+            CALL_DIRECTION,             /*!< E_CONTACT_NOTE, it holds direction of the call, see VCardReader. */
+            FIELD_COUNT
+        };
+
+        /*! Fields of the address. */
+        enum AddressField {
+            ADDRESS_TYPE = 0,           /*!< \b "HOME", \b "WORK", or \b "OTHER". */
+            ADDRESS_COUNTRY,
+            ADDRESS_REGION,
+            ADDRESS_CITY,
+            ADDRESS_STREET,
+            ADDRESS_POSTAL_CODE,
+            ADDRESS_FIELD_COUNT
+        };
+
+        /**
+         * A default constructor. Constructs an empty record.
+         */
+        ContactRecord();
+
+        /**
+         * A destructor which releases the strings of the record.
+         */
+        ~ContactRecord();
+
+        /**
+         * Fills the record in from the EContact, previous content of the record is released.
+         * @param[in] econtact The entry as EContact.
+         */
+        void assign(EContact *econtact);
+
+        /**
+         * Appends the record to the buffer, eg. to store it into the phonebook cache. The normalized phone numbers are not stored.
+         * @param[in,out] buffer The buffer.
+         */
+        void write(std::string &buffer) const;
+
+        /**
+         * Fills the record in from the data made by write(), previous content of the record is released.
+         * @param[in,out] data The data, it's moved after the record.
+         * @param[in] end The end of the data.
+         * @return \b False, if the data are not valid.
+         */
+        bool read(const char **data, const char *end);
+
+        /**
+         * Gets the field of the record.
+         * @param[in] field The field.
+         * @return The value of the field, or \b NULL if the field is not set, or it's empty.
+         */
+        const char *get(Field field) const { return string(field); }
+
+        /**
+         * Gets the number of the phone numbers.
+         * @return The number of the phone numbers.
+         */
+        unsigned int numberCount() const { return mData ? header()->numbers : 0; }
+
+        /**
+         * Gets the phone number as it is in the VCard.
+         * @param[in] index Index of the phone number, it has to be lower than numberCount().
+         * @return The phone number, it's not empty.
+         */
+        const char *number(unsigned int index) const { return string(FIELD_COUNT + 2*index); }
+
+        /**
+         * Gets the normalized phone number, see PhoneNumberIndex::normalize().
+         * @param[in] index Index of the phone number, it has to be lower than numberCount().
+         * @return The normalized phone number, or \b NULL if the number doesn't have any digits.
+         */
+        const char *normalizedNumber(unsigned int index) const { return string(FIELD_COUNT + 2*index + 1); }
+
+        /**
+         * Gets the number of the e-mail addresses.
+         * @return The number of the e-mail addresses.
+         */
+        unsigned int emailCount() const { return mData ? header()->emails : 0; }
+
+        /**
+         * Gets the e-mail address.
+         * @param[in] index Index of the e-mail address, it has to be lower than emailCount().
+         * @return The e-mail address, it's not empty.
+         */
+        const char *email(unsigned int index) const { return string(FIELD_COUNT + 2*numberCount() + index); }
+
+        /**
+         * Gets the number of the addresses.
+         * @return The number of the addresses.
+         */
+        unsigned int addressCount() const { return mData ? header()->addresses : 0; }
+
+        /**
+         * Gets the field of the address.
+         * @param[in] index Index of the address, it has to be lower than addressCount().
+         * @param[in] field The field of the address.
+         * @return The value of the field, or \b NULL if the field is not set.
+         */
+        const char *address(unsigned int index, AddressField field) const {
+            return string(FIELD_COUNT + 2*numberCount() + emailCount() + ADDRESS_FIELD_COUNT*index + field);
+        }
+
+        /**
+         * Gets the size of the memory block holding the record, the strings shared with other records are not included.
+         * @return The size in bytes.
+         */
+        size_t size() const { return mData ? header()->size : 0; }
+
+    private:
+        ContactRecord(const ContactRecord&);
+        ContactRecord &operator=(const ContactRecord&);
+
+        // the block starts with the header, followed by the interned strings (NULL - the string is not set) in the order of
+        // the fields, the phone numbers (raw and normalized), the e-mail addresses and the addresses
+        struct Header {
+            guint32 size;
+            guint16 numbers;
+            guint8 emails;
+            guint8 addresses;
+        };
+
+        const Header *header() const { return reinterpret_cast<const Header*>(mData); }
+        const char *string(unsigned int slot) const {
+            return mData ? reinterpret_cast<const char* const*>(mData + sizeof(Header))[slot] : NULL;
+        }
+        unsigned int slotCount() const {
+            return mData ? FIELD_COUNT + 2*numberCount() + emailCount() + ADDRESS_FIELD_COUNT*addressCount() : 0;
+        }
+        // interns the strings of the slots into the block, previous content of the record has to be released
+        void make(const Header &header, const std::vector<const char*> &slots);
+        void release();
+
+    private:
+        char *mData;
+};
+
+} // PhoneD
+
+#endif /* CONTACTRECORD_H_ */
+
+/** @} */
+
@@ -0,0 +1,209 @@
+
+#include "contactsearchindex.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace PhoneD {
+
+#define DIAL_PAD_NUMBER_SUFFIX_DIGITS   9 // number of trailing digits matched as the number without the prefix
+
+void ContactSearchIndex::tokenize(const char *text, std::vector<std::string> &tokens) {
+    if(!text)
+        return;
+
+    // decomposed form has the diacritics as separate combining marks, which are dropped
+    gchar *decomposed = g_utf8_normalize(text, -1, G_NORMALIZE_NFD);
+    if(!decomposed)
+        return;
+
+    std::string token;
+    for(const gchar *p = decomposed; *p; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+        if(g_unichar_ismark(c))
+            continue;
+        if(g_unichar_isalnum(c)) {
+            char buffer[6];
+            token.append(buffer, g_unichar_to_utf8(g_unichar_tolower(c), buffer));
+        }
+        else if(!token.empty()) {
+            tokens.push_back(token);
+            token.clear();
+        }
+    }
+    if(!token.empty())
+        tokens.push_back(token);
+
+    g_free(decomposed);
+}
+
+bool ContactSearchIndex::mapToDialPad(const std::string &token, std::string &digits) {
+    static const char keys[] = "22233344455566677778889999"; // a - z
+    digits.clear();
+    for(unsigned int i=0; i<token.length(); i++) {
+        char c = token[i];
+        if(c >= 'a' && c <= 'z')
+            digits += keys[c - 'a'];
+        else if(c >= '0' && c <= '9')
+            digits += c;
+        else
+            return false;
+    }
+    return !digits.empty();
+}
+
+void ContactSearchIndex::add(const PBEntry *entry) {
+    if(!entry)
+        return;
+
+    guint32 index = mItems.size();
+    mItems.push_back(Item());
+    Item &item = mItems.back();
+    item.entry = entry;
+
+    // the first word of the full name, or the given name, ranks first on the dial pad
+    std::vector<std::string> firstNames;
+    tokenize(entry->record.get(ContactRecord::GIVEN_NAME), firstNames);
+    tokenize(entry->record.get(ContactRecord::FULL_NAME), item.tokens);
+    if(!item.tokens.empty())
+        firstNames.push_back(item.tokens[0]);
+    item.tokens.insert(item.tokens.end(), firstNames.begin(), firstNames.end());
+    tokenize(entry->record.get(ContactRecord::FAMILY_NAME), item.tokens);
+    std::sort(item.tokens.begin(), item.tokens.end());
+    item.tokens.erase(std::unique(item.tokens.begin(), item.tokens.end()), item.tokens.end());
+
+    std::string digits;
+    for(unsigned int i=0; i<item.tokens.size(); i++) {
+        mNames.push_back(std::make_pair(item.tokens[i], index));
+        if(mapToDialPad(item.tokens[i], digits)) {
+            bool first = std::find(firstNames.begin(), firstNames.end(), item.tokens[i]) != firstNames.end();
+            mDialPad.add(digits, index, first ? DialPadTrie::MATCH_FIRST_NAME : DialPadTrie::MATCH_NAME);
+        }
+    }
+
+    for(unsigned int i=0; i<entry->record.numberCount(); i++) {
+        // the normalized number has only the digits, and possibly the leading '+'
+        const char *number = entry->record.normalizedNumber(i);
+        if(!number)
+            continue;
+        digits = (number[0] == '+') ? number + 1 : number;
+        if(digits.length() > G_MAXUINT16)
+            continue;
+        for(size_t offset=0; offset<digits.length(); offset++) {
+            NumberSuffix suffix = { index, (guint16)item.numbers.size(), (guint16)offset };
+            mNumberSuffixes.push_back(suffix);
+        }
+        item.numbers.push_back(digits);
+        // the number is typed also without the international, or trunk prefix
+        mDialPad.add(digits, index, DialPadTrie::MATCH_NUMBER);
+        if(digits.length() > DIAL_PAD_NUMBER_SUFFIX_DIGITS)
+            mDialPad.add(digits.substr(digits.length() - DIAL_PAD_NUMBER_SUFFIX_DIGITS), index, DialPadTrie::MATCH_NUMBER);
+    }
+
+    mPrepared = false;
+}
+
+void ContactSearchIndex::prepare() {
+    if(mPrepared)
+        return;
+    std::sort(mNames.begin(), mNames.end());
+    std::sort(mNumberSuffixes.begin(), mNumberSuffixes.end(), [this](const NumberSuffix &a, const NumberSuffix &b) {
+        return strcmp(suffix(a), suffix(b)) < 0;
+    });
+    mDialPad.prepare();
+    mPrepared = true;
+}
+
+void ContactSearchIndex::findPrefix(const std::vector<Key> &keys, const std::string &prefix, std::vector<guint32> &items) {
+    auto it = std::lower_bound(keys.begin(), keys.end(), Key(prefix, 0));
+    for(; it != keys.end() && !(*it).first.compare(0, prefix.length(), prefix); ++it)
+        items.push_back((*it).second);
+}
+
+void ContactSearchIndex::findNumbers(const std::string &digits, std::vector<guint32> &items) const {
+    auto it = std::lower_bound(mNumberSuffixes.begin(), mNumberSuffixes.end(), digits, [this](const NumberSuffix &a, const std::string &b) {
+        return strcmp(suffix(a), b.c_str()) < 0;
+    });
+    for(; it != mNumberSuffixes.end() && !strncmp(suffix(*it), digits.c_str(), digits.length()); ++it)
+        items.push_back((*it).item);
+}
+
+void ContactSearchIndex::search(const char *query, unsigned long limit, std::vector<const PBEntry*> &entries) const {
+    entries.clear();
+
+    std::vector<std::string> words;
+    tokenize(query, words);
+    if(words.empty() || !mPrepared)
+        return;
+
+    // the query made only of digits (and eg. '+', ' ', '-') is typed on the dial pad
+    bool dialPad = true;
+    std::string digits;
+    for(const char *c = query; *c; c++) {
+        if(*c >= '0' && *c <= '9')
+            digits += *c;
+        else if(!strchr("+-()/. ", *c))
+            dialPad = false;
+    }
+    dialPad = dialPad && !digits.empty();
+
+    // candidates are the contacts matching the first word, the other words have to match too
+    std::vector<guint32> candidates;
+    findPrefix(mNames, words[0], candidates);
+    if(dialPad) {
+        std::vector<guint32> names;
+        mDialPad.find(digits, 0, names);
+        candidates.insert(candidates.end(), names.begin(), names.end());
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::vector<guint32> matches;
+    for(unsigned int c=0; c<candidates.size(); c++) {
+        const Item &item = mItems[candidates[c]];
+        bool match = true;
+        for(unsigned int w=1; match && w<words.size(); w++) {
+            auto it = std::lower_bound(item.tokens.begin(), item.tokens.end(), words[w]);
+            match = it != item.tokens.end() && !(*it).compare(0, words[w].length(), words[w]);
+        }
+        if(match || dialPad) // the digits of the dial pad are matched as a whole
+            matches.push_back(candidates[c]);
+    }
+
+    // the digits match the phone number anywhere, eg. without the prefix
+    if(dialPad) {
+        findNumbers(digits, matches);
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    }
+
+    unsigned long count = (limit > 0 && limit < matches.size()) ? limit : matches.size();
+    entries.reserve(count);
+    for(unsigned long i=0; i<count; i++)
+        entries.push_back(mItems[matches[i]].entry);
+}
+
+void ContactSearchIndex::predict(const char *digits, unsigned long limit, std::vector<const PBEntry*> &entries, gint64 *lookup) const {
+    entries.clear();
+    if(!digits || !mPrepared)
+        return;
+
+    // only the keys of the dial pad are taken, eg. a number pasted with the separators
+    std::string keys;
+    for(const char *c = digits; *c; c++) {
+        if(*c >= '0' && *c <= '9')
+            keys += *c;
+    }
+
+    std::vector<guint32> items;
+    gint64 start = g_get_monotonic_time();
+    mDialPad.find(keys, limit, items);
+    if(lookup)
+        *lookup = g_get_monotonic_time() - start;
+    entries.reserve(items.size());
+    for(unsigned int i=0; i<items.size(); i++)
+        entries.push_back(mItems[items[i]].entry);
+}
+
+} // PhoneD
+
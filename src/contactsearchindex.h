@@ -0,0 +1,122 @@
+#ifndef CONTACTSEARCHINDEX_H_
+#define CONTACTSEARCHINDEX_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "pblist.h"
+#include "dialpadtrie.h"
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::ContactSearchIndex
+ *  \brief In-memory index of contacts for type-ahead search by name, or phone number.
+ *
+ * Names of the contacts (full, given and family name) are split into tokens, which are folded, ie. converted to lower case and
+ * stripped of diacritics, so that eg. \b "zel" matches \b "Želmíra". Each word of the query has to match a prefix of some token of
+ * the contact. A query made of digits matches also the phone numbers of the contact, anywhere in the number, and the names typed
+ * on the dial pad, ie. the tokens mapped to digits by T9 letter groups, eg. \b "526" matches \b "Jan". The tokens are kept sorted,
+ * so that the prefixes are looked-up in logarithmic time, the tokens mapped to digits and the phone numbers are kept in DialPadTrie.
+ * All suffixes of the phone numbers are kept sorted too, ie. the digits anywhere in the number are looked-up as a prefix of a suffix.
+ * The matching contacts are returned in the order they have been added, predict() returns them ranked by DialPadTrie.
+ *
+ * The index is filled in by add() and prepare() has to be called before it is searched. It references the entries, it doesn't own them.
+ */
+class ContactSearchIndex {
+    public:
+        /**
+         * A default constructor. Constructs an empty index.
+         */
+        ContactSearchIndex() : mPrepared(true) {}
+
+        /**
+         * Adds the contact to the index.
+         * @param[in] entry The contact, it has to outlive the index.
+         */
+        void add(const PBEntry *entry);
+
+        /**
+         * Sorts the tokens added since the last call, it has to be called before the index is searched.
+         */
+        void prepare();
+
+        /**
+         * Searches the contacts matching the query.
+         * @param[in] query The query, eg. \b "jo sm", \b "+42190", or \b "7648".
+         * @param[in] limit Maximum number of contacts to be returned, \b 0 means all matching contacts.
+         * @param[out] entries A container for the matching contacts, in the order they have been added.
+         */
+        void search(const char *query, unsigned long limit, std::vector<const PBEntry*> &entries) const;
+
+        /**
+         * Predicts the contacts for the digits typed on the dial pad, see DialPadTrie.
+         * @param[in] digits The digits, eg. \b "5264", other characters are ignored.
+         * @param[in] limit Maximum number of contacts to be returned, \b 0 means all matching contacts.
+         * @param[out] entries A container for the matching contacts, the best match first.
+         * @param[out] lookup A container for the duration of the look-up in DialPadTrie (in microseconds), or \b NULL.
+         */
+        void predict(const char *digits, unsigned long limit, std::vector<const PBEntry*> &entries, gint64 *lookup = NULL) const;
+
+        /**
+         * Gets the number of indexed contacts.
+         * @return The number of contacts.
+         */
+        size_t size() const { return mItems.size(); }
+
+        /**
+         * Folds the text for matching, ie. converts it to lower case and removes diacritics, and splits it into tokens.
+         * @param[in] text UTF-8 text.
+         * @param[out] tokens A container for the tokens, they are appended.
+         */
+        static void tokenize(const char *text, std::vector<std::string> &tokens);
+
+        /**
+         * Maps the folded token to the digits of the dial pad, eg. \b "jan" to \b "526".
+         * @param[in] token The token made by tokenize().
+         * @param[out] digits A container for the digits.
+         * @return \b False, if the token contains a character, which is not on the dial pad.
+         */
+        static bool mapToDialPad(const std::string &token, std::string &digits);
+
+    private:
+        struct Item {
+            const PBEntry *entry;
+            std::vector<std::string> tokens;  // folded name tokens
+            std::vector<std::string> numbers; // digits of the phone numbers
+        };
+        typedef std::pair<std::string, guint32> Key; // token -> index of the item
+        struct NumberSuffix {
+            guint32 item;
+            guint16 number;  // index of the number in Item::numbers
+            guint16 offset;  // the suffix starts at the offset in the number
+        };
+
+        // appends indexes of the items having a key starting with the prefix
+        static void findPrefix(const std::vector<Key> &keys, const std::string &prefix, std::vector<guint32> &items);
+        // appends indexes of the items having a phone number containing the digits
+        void findNumbers(const std::string &digits, std::vector<guint32> &items) const;
+        const char *suffix(const NumberSuffix &suffix) const {
+            return mItems[suffix.item].numbers[suffix.number].c_str() + suffix.offset;
+        }
+
+    private:
+        std::vector<Item> mItems;
+        std::vector<Key> mNames;   // sorted name tokens
+        std::vector<NumberSuffix> mNumberSuffixes; // suffixes of the digits of the phone numbers, sorted
+        DialPadTrie mDialPad;      // name tokens mapped to digits and the phone numbers
+        bool mPrepared;
+};
+
+} // PhoneD
+
+#endif /* CONTACTSEARCHINDEX_H_ */
+
+/** @} */
+
@@ -0,0 +1,129 @@
+
+#include "dialpadtrie.h"
+
+#include <algorithm>
+
+namespace PhoneD {
+
+DialPadTrie::DialPadTrie() :
+    mItemCount(0),
+    mPrepared(true)
+{
+    Node root = { 0, 0, 0, 0, 0 };
+    mNodes.push_back(root);
+}
+
+guint32 DialPadTrie::child(guint32 node, char digit) const {
+    for(guint32 c = mNodes[node].firstChild; c; c = mNodes[c].nextSibling) {
+        if(mNodes[c].digit == digit)
+            return c;
+    }
+    return 0;
+}
+
+void DialPadTrie::add(const std::string &digits, guint32 item, Kind kind) {
+    if(digits.empty())
+        return;
+
+    guint32 node = 0;
+    for(unsigned int i=0; i<digits.length(); i++) {
+        guint32 next = child(node, digits[i]);
+        if(!next) {
+            Node n = { 0, mNodes[node].firstChild, 0, 0, digits[i] };
+            next = mNodes.size();
+            mNodes.push_back(n);
+            mNodes[node].firstChild = next;
+        }
+        node = next;
+    }
+
+    Ref ref = { node, item, (guint8)kind, (guint8)std::min<size_t>(digits.length(), 255) };
+    mRefs.push_back(ref);
+    mItemCount = std::max(mItemCount, item + 1);
+    mPrepared = false;
+}
+
+void DialPadTrie::prepare() {
+    if(mPrepared)
+        return;
+
+    // number the nodes in depth-first (pre-)order, iteratively not to overflow the stack on long keys
+    std::vector<guint32> parents(mNodes.size(), 0);
+    std::vector<guint32> preorder;
+    std::vector<guint32> stack(1, 0);
+    preorder.reserve(mNodes.size());
+    while(!stack.empty()) {
+        guint32 node = stack.back();
+        stack.pop_back();
+        mNodes[node].order = mNodes[node].last = preorder.size();
+        preorder.push_back(node);
+        for(guint32 c = mNodes[node].firstChild; c; c = mNodes[c].nextSibling) {
+            parents[c] = node;
+            stack.push_back(c);
+        }
+    }
+
+    // the sub-tree of the node is the range of the orders from the node to its last descendant
+    for(size_t i = preorder.size(); i-- > 1;) {
+        guint32 node = preorder[i];
+        Node &parent = mNodes[parents[node]];
+        parent.last = std::max(parent.last, mNodes[node].last);
+    }
+
+    // the references of the keys in the sub-tree are then in one range
+    const std::vector<Node> &nodes = mNodes;
+    std::stable_sort(mRefs.begin(), mRefs.end(), [&nodes](const Ref &a, const Ref &b) {
+        return nodes[a.node].order < nodes[b.node].order;
+    });
+    mOrders.resize(mRefs.size());
+    for(size_t i=0; i<mRefs.size(); i++)
+        mOrders[i] = mNodes[mRefs[i].node].order;
+
+    mPrepared = true;
+}
+
+void DialPadTrie::find(const std::string &digits, size_t limit, std::vector<guint32> &items) const {
+    items.clear();
+    if(digits.empty() || !mPrepared)
+        return;
+
+    guint32 node = 0;
+    for(unsigned int i=0; i<digits.length(); i++) {
+        node = child(node, digits[i]);
+        if(!node)
+            return;
+    }
+
+    auto begin = std::lower_bound(mOrders.begin(), mOrders.end(), mNodes[node].order);
+    auto end = std::upper_bound(begin, mOrders.end(), mNodes[node].last);
+
+    // rank: the kind of the match, then the number of digits missing to complete the key, then the item;
+    // the best match of each item counts, the items are returned once; the buffers are reused by the searches of the thread,
+    // so that a keystroke doesn't allocate, nor clear a buffer for all items, only the matched items are reset
+    static thread_local std::vector<guint64> best;
+    static thread_local std::vector<guint64> ranked;
+    if(best.size() < mItemCount)
+        best.resize(mItemCount, G_MAXUINT64);
+    ranked.clear();
+    for(auto it = begin; it != end; ++it) {
+        const Ref &ref = mRefs[it - mOrders.begin()];
+        guint64 rank = ((guint64)ref.kind << 40) | ((guint64)(ref.length > digits.length() ? ref.length - digits.length() : 0) << 32) | ref.item;
+        if(best[ref.item] == G_MAXUINT64)
+            ranked.push_back(ref.item);
+        best[ref.item] = std::min(best[ref.item], rank);
+    }
+    for(size_t i=0; i<ranked.size(); i++) {
+        guint32 item = (guint32)ranked[i];
+        ranked[i] = best[item];
+        best[item] = G_MAXUINT64;
+    }
+
+    size_t count = (limit > 0 && limit < ranked.size()) ? limit : ranked.size();
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end());
+    items.reserve(count);
+    for(size_t i=0; i<count; i++)
+        items.push_back((guint32)ranked[i]);
+}
+
+} // PhoneD
+
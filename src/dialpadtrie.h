@@ -0,0 +1,96 @@
+#ifndef DIALPADTRIE_H_
+#define DIALPADTRIE_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::DialPadTrie
+ *  \brief Trie of digit sequences, as typed on the dial pad, for predictive matching of contacts.
+ *
+ * Keys are the names of the contacts mapped to the digits of the dial pad (T9), eg. \b "526" for \b "Jan", and the phone numbers.
+ * Each key references an item, eg. the index of the contact, and the kind of the match. Once all keys are added, prepare() lays the
+ * references out in depth-first order of the trie, so that the references of all keys starting with given digits are in one range,
+ * which is found by walking the trie along the digits. The items are ranked by the kind of the match, then by how much of the key
+ * is matched, ie. complete keys first, and then by the order of the items.
+ */
+class DialPadTrie {
+    public:
+        /*! Kinds of the match, in the order of the rank. */
+        enum Kind {
+            MATCH_FIRST_NAME = 0,       /*!< The first name, or the first word of the name. */
+            MATCH_NAME,                 /*!< Other word of the name. */
+            MATCH_NUMBER                /*!< The phone number. */
+        };
+
+        /**
+         * A default constructor. Constructs an empty trie.
+         */
+        DialPadTrie();
+
+        /**
+         * Adds the key to the trie.
+         * @param[in] digits The key, made of digits \b 0 - \b 9.
+         * @param[in] item The item the key belongs to.
+         * @param[in] kind The kind of the match.
+         */
+        void add(const std::string &digits, guint32 item, Kind kind);
+
+        /**
+         * Lays out the references of the keys added since the last call, it has to be called before the trie is searched.
+         */
+        void prepare();
+
+        /**
+         * Finds the items having a key, which starts with given digits.
+         * @param[in] digits The digits typed on the dial pad.
+         * @param[in] limit Maximum number of items to be returned, \b 0 means all matching items.
+         * @param[out] items A container for the items, the best match first. Each item is returned only once.
+         */
+        void find(const std::string &digits, size_t limit, std::vector<guint32> &items) const;
+
+        /**
+         * Gets the number of nodes of the trie.
+         * @return The number of nodes.
+         */
+        size_t size() const { return mNodes.size(); }
+
+    private:
+        struct Node {
+            guint32 firstChild;  // 0 if none, the root is never a child
+            guint32 nextSibling; // 0 if none
+            guint32 order;       // position of the node in depth-first order
+            guint32 last;        // the last position of the nodes in its sub-tree
+            char digit;
+        };
+        struct Ref {
+            guint32 node;        // the node, where the key ends
+            guint32 item;
+            guint8 kind;
+            guint8 length;       // length of the key, up to 255
+        };
+
+        // finds the child of the node for the digit, 0 if there isn't any
+        guint32 child(guint32 node, char digit) const;
+
+    private:
+        std::vector<Node> mNodes;    // the root is at 0
+        std::vector<Ref> mRefs;      // sorted by the order of their nodes, once prepared
+        std::vector<guint32> mOrders; // the orders of the nodes of mRefs, for the binary search
+        guint32 mItemCount;  // the highest item + 1
+        bool mPrepared;
+};
+
+} // PhoneD
+
+#endif /* DIALPADTRIE_H_ */
+
+/** @} */
+
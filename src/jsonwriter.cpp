@@ -0,0 +1,166 @@
+
+#include "jsonwriter.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace PhoneD {
+
+#define JSON_WRITER_MIN_RESERVE   64
+#define JSON_ESCAPE_MAX_LENGTH    6  // the longest escape sequence, ie. \u00XX
+
+JsonWriter::JsonWriter(std::string &json, size_t reserve) :
+    mJson(json),
+    mData(NULL),
+    mLength(json.length()),
+    mSeparate(false)
+{
+    grow(reserve > JSON_WRITER_MIN_RESERVE ? reserve : JSON_WRITER_MIN_RESERVE);
+}
+
+JsonWriter::~JsonWriter() {
+    mJson.resize(mLength);
+}
+
+void JsonWriter::grow(size_t length) {
+    size_t size = mJson.size() * 2;
+    if(size < mLength + length)
+        size = mLength + length;
+    mJson.resize(size);
+    mData = &mJson[0];
+}
+
+char *JsonWriter::next(char *end, const char *name, size_t nameLength) {
+    if(mSeparate)
+        *end++ = ',';
+    if(name) { // the keys are literals, which don't need to be escaped
+        *end++ = '"';
+        memcpy(end, name, nameLength);
+        end += nameLength;
+        *end++ = '"';
+        *end++ = ':';
+    }
+    return end;
+}
+
+void JsonWriter::open(const char *name, char bracket) {
+    size_t nameLength = name ? strlen(name) : 0;
+    char *end = next(reserve(nameLength + 5), name, nameLength);
+    *end++ = bracket;
+    mLength = end - mData;
+    mSeparate = false;
+}
+
+// finds the first character, which has to be escaped, ie. '"', '\' and the control characters
+static size_t findEscape(const char *value, size_t length) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for(; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(value + i));
+        // unsigned chunk <= 0x1f, when max(chunk, 0x1f) == 0x1f
+        __m128i mask = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                    _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        int bits = _mm_movemask_epi8(mask);
+        if(bits)
+            return i + __builtin_ctz(bits);
+    }
+#else
+    // 8 bytes at a time, the high bit of a byte is set in the masks, when the byte is below 0x20, or it's zero after xor with
+    // '"', or '\\', see "Determine if a word has a byte less than n" of Bit Twiddling Hacks
+    const guint64 ones = G_GUINT64_CONSTANT(0x0101010101010101);
+    const guint64 highs = G_GUINT64_CONSTANT(0x8080808080808080);
+    for(; i + 8 <= length; i += 8) {
+        guint64 chunk;
+        memcpy(&chunk, value + i, sizeof(chunk));
+        guint64 quote = chunk ^ (ones * '"');
+        guint64 backslash = chunk ^ (ones * '\\');
+        guint64 mask = ((chunk - ones * 0x20) & ~chunk) | ((quote - ones) & ~quote) | ((backslash - ones) & ~backslash);
+        if(mask & highs)
+            break; // the character is found by the loop below
+    }
+#endif
+    for(; i < length; i++) {
+        unsigned char c = value[i];
+        if(c == '"' || c == '\\' || c < 0x20)
+            return i;
+    }
+    return length;
+}
+
+void JsonWriter::string(const char *name, const char *value) {
+    size_t nameLength = name ? strlen(name) : 0;
+    if(!value)
+        value = "";
+    size_t length = strlen(value);
+    // the room for the worst case, ie. each character escaped, is made only from the first character, which has to be escaped,
+    // so that the common string, which doesn't need to be escaped, doesn't grow the buffer more than the concatenation would
+    size_t run = findEscape(value, length);
+    char *end = next(reserve(nameLength + 6 + run + (length - run) * JSON_ESCAPE_MAX_LENGTH), name, nameLength);
+    *end++ = '"';
+    memcpy(end, value, run);
+    end += run;
+    if(run < length)
+        end = escape(end, value + run, length - run);
+    *end++ = '"';
+    mLength = end - mData;
+    mSeparate = true;
+}
+
+void JsonWriter::number(const char *name, gint64 value) {
+    char buffer[24];
+    int length = snprintf(buffer, sizeof(buffer), "%" G_GINT64_FORMAT, value);
+    size_t nameLength = name ? strlen(name) : 0;
+    char *end = next(reserve(nameLength + 4 + length), name, nameLength);
+    memcpy(end, buffer, length);
+    mLength = end + length - mData;
+    mSeparate = true;
+}
+
+void JsonWriter::raw(const char *name, const std::string &json) {
+    size_t nameLength = name ? strlen(name) : 0;
+    char *end = next(reserve(nameLength + 4 + json.length()), name, nameLength);
+    memcpy(end, json.data(), json.length());
+    mLength = end + json.length() - mData;
+    mSeparate = true;
+}
+
+char *JsonWriter::escape(char *end, const char *value, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    while(length > 0) {
+        size_t run = findEscape(value, length);
+        memcpy(end, value, run);
+        end += run;
+        if(run == length)
+            break;
+
+        unsigned char c = value[run];
+        *end++ = '\\';
+        switch(c) {
+            case '"':  *end++ = '"'; break;
+            case '\\': *end++ = '\\'; break;
+            case '\b': *end++ = 'b'; break;
+            case '\f': *end++ = 'f'; break;
+            case '\n': *end++ = 'n'; break;
+            case '\r': *end++ = 'r'; break;
+            case '\t': *end++ = 't'; break;
+            default:
+                *end++ = 'u';
+                *end++ = '0';
+                *end++ = '0';
+                *end++ = hex[c >> 4];
+                *end++ = hex[c & 0xf];
+        }
+        value += run + 1;
+        length -= run + 1;
+    }
+    return end;
+}
+
+} // PhoneD
+
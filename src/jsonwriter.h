@@ -0,0 +1,123 @@
+#ifndef JSONWRITER_H_
+#define JSONWRITER_H_
+
+#include <glib.h>
+#include <string>
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::JsonWriter
+ *  \brief Streaming writer of JSON text, which escapes the strings.
+ *
+ * The writer appends to the caller's string, which is sized up front, so that serializing an entry doesn't re-allocate it, and
+ * the text is copied directly into its buffer. The string has the final length once the writer is destroyed. The commas between
+ * the members, or the elements, are inserted by the writer. The strings are escaped as required by JSON, ie. quotation mark,
+ * reverse solidus and control characters, the runs of characters, which don't need to be escaped, are found 16 bytes at a time
+ * with SSE2, where available, or 8 bytes at a time otherwise, and copied at once. The keys of the members are not escaped, they are expected to be literals.
+ * The writer doesn't validate the structure, eg. that each member has a key, the callers make the structure by the calls.
+ */
+class JsonWriter {
+    public:
+        /**
+         * A constructor.
+         * @param[out] json A container, which the JSON text is appended to.
+         * @param[in] reserve Expected length of the appended JSON text, the container is sized for it.
+         */
+        JsonWriter(std::string &json, size_t reserve = 0);
+
+        /**
+         * A destructor. Trims the container to the length of the written text.
+         */
+        ~JsonWriter();
+
+        /**
+         * Starts an object, as a member, or an element.
+         * @param[in] name The key of the member, or \b NULL for an element of an array, or the top-level object.
+         */
+        void beginObject(const char *name = NULL) { open(name, '{'); }
+
+        /**
+         * Ends the object.
+         */
+        void endObject() { close('}'); }
+
+        /**
+         * Starts an array, as a member, or an element.
+         * @param[in] name The key of the member, or \b NULL for an element of an array, or the top-level array.
+         */
+        void beginArray(const char *name = NULL) { open(name, '['); }
+
+        /**
+         * Ends the array.
+         */
+        void endArray() { close(']'); }
+
+        /**
+         * Writes a string member, or element.
+         * @param[in] name The key of the member, or \b NULL for an element.
+         * @param[in] value UTF-8 string, which is escaped, \b NULL is written as an empty string.
+         */
+        void string(const char *name, const char *value);
+
+        /**
+         * Writes a string member, unless the value is empty.
+         * @param[in] name The key of the member.
+         * @param[in] value UTF-8 string, which is escaped.
+         */
+        void optionalString(const char *name, const char *value) { if(value && value[0]) string(name, value); }
+
+        /**
+         * Writes a number member, or element.
+         * @param[in] name The key of the member, or \b NULL for an element.
+         * @param[in] value The number.
+         */
+        void number(const char *name, gint64 value);
+
+        /**
+         * Writes a member, or an element, which is already serialized as JSON, eg. \b tizen.Contact of the entry.
+         * @param[in] name The key of the member, or \b NULL for an element.
+         * @param[in] json The JSON value, it's written as is.
+         */
+        void raw(const char *name, const std::string &json);
+
+    private:
+        JsonWriter(const JsonWriter&);
+        JsonWriter &operator=(const JsonWriter&);
+
+        // makes room for at least 'length' more characters and returns the end of the written text
+        char *reserve(size_t length) {
+            if(mJson.size() - mLength < length)
+                grow(length);
+            return mData + mLength;
+        }
+        void grow(size_t length);
+        // writes the separator and the key of the next member, or element, 'end' has room for them
+        char *next(char *end, const char *name, size_t nameLength);
+        // writes the string escaped as the content of JSON string, 'end' has room for 6 times its length
+        static char *escape(char *end, const char *value, size_t length);
+        // starts, or ends an object, or an array
+        void open(const char *name, char bracket);
+        void close(char bracket) {
+            *reserve(1) = bracket;
+            mLength++;
+            mSeparate = true;
+        }
+
+    private:
+        std::string &mJson; // sized ahead of the written text, it's trimmed by the destructor
+        char *mData;        // the buffer of mJson
+        size_t mLength;     // length of the written text
+        bool mSeparate;     // a value has been written, the next one is separated by a comma
+};
+
+} // PhoneD
+
+#endif /* JSONWRITER_H_ */
+
+/** @} */
+
@@ -1,12 +1,19 @@
 
 #include "obex.h"
 #include "utils.h"
+#include "vcard.h"
+#include "jsonwriter.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
-#include <fstream>
+#include <algorithm>
 
 #include "Logger.h"
 
@@ -20,6 +27,24 @@ namespace PhoneD {
 
 // check for stalled active transfer (in seconds)
 #define CHECK_STALLED_TRANSFER_TIMEOUT     120
+// timeouts of individual steps of synchronization (in seconds)
+#define SELECT_TIMEOUT                     10
+#define PULL_ALL_TIMEOUT                   30
+#define GET_TRANSFER_STATUS_TIMEOUT        10
+#define GET_FOLDER_VERSION_TIMEOUT         10
+
+// number of latest calls pulled on incremental synchronization, when the size of the call history doesn't change
+#define INCREMENTAL_CALLHISTORY_SYNC_COUNT 20
+
+// number of the last synchronized contacts pulled again to verify, that they haven't moved, when the device doesn't report the version counters
+#define INCREMENTAL_CONTACTS_OVERLAP       8
+
+// minimal size of the part of received VCards parsed by one worker thread (in bytes)
+#define VCARD_CHUNK_MIN_SIZE               (64*1024)
+
+// expected length of serialized entry, the buffer is reserved for it (in bytes)
+#define JSON_CONTACT_RESERVE               512
+#define JSON_CALL_RESERVE                  256
 
 /*! \class PhoneD::SyncPBData
  * A Class to provide a storage for Queued synchronization requests.
@@ -31,34 +56,217 @@ class SyncPBData {
          * @param[in] location Location of phonebook data, see SyncPBData::location.
          * @param[in] phonebook Phonebook data identification, see SyncPBData::phonebook.
          * @param[in] count Number of latest entries to be synchronized (the default is 0), see SyncPBData::count.
+         * @param[in] incremental Whether to pull only changed entries, see SyncPBData::incremental.
          */
-        SyncPBData(const char *location, const char *phonebook, unsigned long count = 0)
+        SyncPBData(const char *location, const char *phonebook, unsigned long count = 0, bool incremental = false)
         {
             this->location = location;
             this->phonebook = phonebook;
             this->count = count;
+            this->offset = 0;
+            this->overlap = 0;
+            this->limit = 0;
+            this->incremental = incremental;
+            this->merge = (count == 0) ? Obex::MERGE_REPLACE : Obex::MERGE_PREPEND;
+        }
+    public:
+        const char *location;    /*!< Location of phonebook data: "INT", "SIM1", "SIM2". */
+        const char *phonebook;   /*!< Phonebook data identification: "pb", "ich", "och", "mch", "cch". */
+        unsigned long count;     /*!< Number of latest entries to be synchronized (0 means to request all). */
+        unsigned long offset;    /*!< Offset of the first entry to be synchronized. */
+        unsigned long overlap;   /*!< Number of the first pulled entries, which are expected to be the last synchronized ones, see Obex::mergeEntries(). */
+        unsigned long limit;     /*!< Number of entries in the folder, the merged entries are trimmed to it (0 means not to trim), see Obex::mergeEntries(). */
+        bool incremental;        /*!< Whether the version of the folder is read first to pull only changed entries, see Obex::planIncrementalSync(). */
+        Obex::Merge merge;       /*!< How the pulled entries are merged into synchronized ones. */
+        PBFolderVersion version; /*!< Version of the folder read from the device, valid only for incremental synchronization. */
+};
+
+class IngestData;
+
+/*! \class PhoneD::VCardChunk
+ * A Class to store a part of received VCards, which is parsed on a worker thread, together with the entries parsed from it.
+ */
+class VCardChunk {
+    public:
+        /**
+         * A default constructor which allows to specify object data in the construction phase.
+         * @param[in] ingest Processing of received VCards the chunk belongs to, see VCardChunk::ingest.
+         * @param[in] data The VCards, see VCardChunk::data.
+         * @param[in] length Length of the VCards, see VCardChunk::length.
+         */
+        VCardChunk(IngestData *ingest, const char *data, size_t length)
+        {
+            this->ingest = ingest;
+            this->data = data;
+            this->length = length;
+        }
+    public:
+        IngestData *ingest;            /*!< Processing of received VCards the chunk belongs to. */
+        const char *data;              /*!< The VCards, they point to the mapped file owned by IngestData. */
+        size_t length;                 /*!< Length of the VCards. */
+        std::vector<PBEntryPtr> entries; /*!< Entries parsed from the VCards, in the order of VCards. */
+};
+
+/*! \class PhoneD::IngestData
+ * A Class to store the state of processing of received VCards: the VCards are parsed in chunks on worker threads, the last worker merges the entries into new snapshot, which is published on the main loop.
+ */
+class IngestData {
+    public:
+        /**
+         * A default constructor which allows to specify object data in the construction phase.
+         * @param[in] ctx The object processing the VCards, see IngestData::ctx.
+         * @param[in] transfer Identifier of the transfer, which has received the VCards, see IngestData::transfer.
+         * @param[in] type Type of the VCards, see IngestData::type.
+         * @param[in] origin MAC address of the device, see IngestData::origin.
+         * @param[in] merge Merging of the entries, see IngestData::merge.
+         */
+        IngestData(Obex *ctx, guint transfer, const char *type, const char *origin, Obex::Merge merge)
+        {
+            this->ctx = ctx;
+            this->transfer = transfer;
+            this->type = type;
+            this->origin = origin;
+            this->merge = merge;
+            this->overlap = 0;
+            this->limit = 0;
+            this->file = NULL;
+            this->pending = 0;
+            this->tailChanged = false;
+        }
+        /**
+         * A destructor. Deletes the chunks and unmaps the file.
+         */
+        ~IngestData()
+        {
+            for(unsigned int i=0; i<chunks.size(); i++)
+                delete chunks[i];
+            if(file)
+                g_mapped_file_unref(file);
+        }
+    public:
+        Obex *ctx;                        /*!< The object processing the VCards. */
+        guint transfer;                   /*!< Identifier of the transfer, which has received the VCards. The processing is cancelled, once it is not the active transfer. */
+        std::string type;                 /*!< Type of the VCards: "pb", or "cch". */
+        std::string origin;               /*!< MAC address of the device, which the VCards have been pulled from. */
+        Obex::Merge merge;                /*!< How the entries are merged into the synchronized ones. */
+        unsigned long overlap;            /*!< Number of the first entries, which are expected to be the last synchronized ones, see SyncPBData::overlap. */
+        unsigned long limit;              /*!< Number of entries the merged entries are trimmed to, see SyncPBData::limit. */
+        GMappedFile *file;                /*!< The file containing the VCards. */
+        std::vector<VCardChunk*> chunks;  /*!< Chunks of VCards, in the order of VCards in the file. */
+        volatile gint pending;            /*!< Number of chunks, which have not been parsed yet. */
+        PBSnapshotPtr base;               /*!< The snapshot, which the entries have been merged into. */
+        PBSnapshotPtr snapshot;           /*!< New snapshot with the merged entries, it's \b NULL if the processing has been cancelled. */
+        std::vector<PBEntryPtr> added;    /*!< New calls, which are not in the base snapshot. */
+        bool tailChanged;                 /*!< Whether the overlapping entries don't match the synchronized ones, the folder has to be pulled whole then. */
+};
+
+/*! \class PhoneD::TransferData
+ * A Class to store the data of the active transfer, which is watched on the ingest thread. The object is owned by the ingest thread.
+ */
+class TransferData {
+    public:
+        /**
+         * A default constructor which allows to specify object data in the construction phase.
+         * @param[in] ctx The object, which has started the transfer, see TransferData::ctx.
+         * @param[in] id Identifier of the transfer, see TransferData::id.
+         * @param[in] path D-Bus object path of the transfer, see TransferData::path.
+         * @param[in] fileName The file, which the transfer stores VCards into, see TransferData::fileName.
+         * @param[in] type Type of the VCards, see TransferData::type.
+         * @param[in] origin MAC address of the device, see TransferData::origin.
+         * @param[in] merge Merging of the entries, see TransferData::merge.
+         */
+        TransferData(Obex *ctx, guint id, const char *path, const char *fileName, const char *type, const char *origin, Obex::Merge merge) :
+            signals(this)
+        {
+            this->ctx = ctx;
+            this->id = id;
+            this->path = path;
+            this->fileName = fileName;
+            this->type = type;
+            this->origin = origin;
+            this->merge = merge;
+            this->overlap = 0;
+            this->limit = 0;
+            this->cancellable = g_cancellable_new();
+            this->watched = false;
+            this->finished = false;
+            signals.add("org.freedesktop.DBus.Properties", "PropertiesChanged", "(sa{sv}as)", &TransferData::propertiesChangedSignal);
+        }
+        /**
+         * A destructor.
+         */
+        ~TransferData()
+        {
+            g_object_unref(cancellable);
         }
+        /**
+         * Handles "PropertiesChanged" signal of the transfer, it finishes the transfer, once its status is "complete", or "error".
+         * It's routed by TransferData::signals on the ingest thread, see Obex::watchTransferCb().
+         * @param[in] objectPath D-Bus object path of the transfer.
+         * @param[in] parameters The parameters of the signal.
+         */
+        void propertiesChangedSignal(const gchar *objectPath, GVariant *parameters);
     public:
-        const char *location;   /*!< Location of phonebook data: "INT", "SIM1", "SIM2". */
-        const char *phonebook;  /*!< Phonebook data identification: "pb", "ich", "och", "mch", "cch". */
-        unsigned long count;    /*!< Number of latest entries to be synchronized (0 means to request all). */
+        Obex *ctx;                 /*!< The object, which has started the transfer. */
+        guint id;                  /*!< Identifier of the transfer, unique within the life-time of the process. */
+        std::string path;          /*!< D-Bus object path of the transfer. */
+        std::string fileName;      /*!< The file, which the transfer stores VCards into. */
+        std::string type;          /*!< Type of the VCards: "pb", or "cch". */
+        std::string origin;        /*!< MAC address of the device, which the VCards are pulled from. */
+        Obex::Merge merge;         /*!< How the entries are merged into the synchronized ones. */
+        unsigned long overlap;     /*!< Number of the first entries, which are expected to be the last synchronized ones, see SyncPBData::overlap. */
+        unsigned long limit;       /*!< Number of entries the merged entries are trimmed to, see SyncPBData::limit. */
+        GCancellable *cancellable; /*!< Cancels the query of the status, once the transfer is not watched anymore. */
+        bool watched;              /*!< Whether "PropertiesChanged" signal of the transfer is subscribed. */
+        bool finished;             /*!< Whether the transfer has finished, ie. it's reported by both the signal and the status query. */
+        SignalRouter<TransferData> signals; /*!< Routes the signals of the transfer. */
 };
 
 Obex::Obex() :
     mSelectedRemoteDevice(""),
     mSession(NULL),
-    mActiveTransfer(NULL)
+    mActiveTransfer(NULL),
+    mActiveTransferData(NULL),
+    mActiveTransferId(0),
+    mTransferCount(0),
+    mStalledTransferTimer(0),
+    mSyncCancellable(NULL),
+    mContacts(new PBSnapshot()),
+    mCallHistory(new PBSnapshot())
 {
     LoggerD("entered");
-    mContacts.clear();
-    mContactsOrder.clear();
-    mCallHistory.clear();
-    mCallHistoryOrder.clear();
+    mParserPool = g_thread_pool_new(Obex::parseVCardChunk, NULL, g_get_num_processors(), FALSE, NULL);
+    mIngestContext = g_main_context_new();
+    mIngestLoop = g_main_loop_new(mIngestContext, FALSE);
+    mIngestThread = g_thread_new("phoned-ingest", Obex::ingestThread, this);
 }
 
 Obex::~Obex() {
     LoggerD("entered");
     removeSession(false); // remove session if it's active
+    // stop the ingest thread and release the transfers, which it has not released yet
+    g_main_context_invoke(mIngestContext, Obex::quitIngestLoopCb, mIngestLoop);
+    g_thread_join(mIngestThread);
+    while(g_main_context_iteration(mIngestContext, FALSE));
+    g_main_loop_unref(mIngestLoop);
+    g_main_context_unref(mIngestContext);
+    // wait for the worker threads, the processing has been cancelled with the session
+    g_thread_pool_free(mParserPool, FALSE, TRUE);
+}
+
+gpointer Obex::ingestThread(gpointer data) {
+    Obex *ctx = static_cast<Obex*>(data);
+    // asynchronous calls made on the ingest thread are finished on its context
+    g_main_context_push_thread_default(ctx->mIngestContext);
+    g_main_loop_run(ctx->mIngestLoop);
+    g_main_context_pop_thread_default(ctx->mIngestContext);
+    return NULL;
+}
+
+// runs on the ingest thread
+gboolean Obex::quitIngestLoopCb(gpointer user_data) {
+    g_main_loop_quit(static_cast<GMainLoop*>(user_data));
+    return G_SOURCE_REMOVE;
 }
 
 void Obex::createSession(const char *bt_address) {
@@ -67,6 +275,10 @@ void Obex::createSession(const char *bt_address) {
     // remove existing session if exists
     removeSession(false);
 
+    // serve the entries from the cache, until they are synchronized
+    if(getContactsSnapshot()->entries.size() == 0 && getCallHistorySnapshot()->entries.size() == 0)
+        loadPhonebookCache(bt_address);
+
     GVariant *args[8];
     int nargs = 0;
 
@@ -83,7 +295,7 @@ void Obex::createSession(const char *bt_address) {
     g_variant_builder_add_value(builder, array);
     GVariant *parameters = g_variant_builder_end(builder);
 
-    g_dbus_connection_call( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    g_dbus_connection_call( BusConnection::get(G_BUS_TYPE_SESSION),
                             OBEX_PREFIX,
                             "/org/bluez/obex",
                             OBEX_CLIENT_IFACE,
@@ -107,7 +319,7 @@ void Obex::asyncCreateSessionReadyCallback(GObject *source, GAsyncResult *result
 
     GError *err = NULL;
     GVariant *reply;
-    reply = g_dbus_connection_call_finish(g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL), result, &err);
+    reply = g_dbus_connection_call_finish(BusConnection::get(G_BUS_TYPE_SESSION), result, &err);
     if(err || !reply) {
         ctx->createSessionFailed(err?err->message:"Invalid reply from 'CreateSession'");
         if(err)
@@ -130,67 +342,307 @@ void Obex::asyncCreateSessionReadyCallback(GObject *source, GAsyncResult *result
     g_variant_unref(reply);
 }
 
-// location:  "INT", "SIM1", "SIM2"
-// phonebook: "pb", "ich", "och", "mch", "cch"
-bool Obex::select(const char *location, const char *phonebook) {
-    LoggerD("Selecting phonebook: " << location << "/" << phonebook);
+// starts the synchronization request at the top of the queue - the first step is
+// asynchronous 'Select' of the phonebook, 'PullAll' is called once 'Select' succeeds
+void Obex::startSyncRequest() {
+    if(mSyncQueue.empty())
+        return;
+
+    SyncPBData *sync = mSyncQueue.front();
+    LoggerD("Selecting phonebook: " << sync->location << "/" << sync->phonebook << " count=" << sync->count);
 
     if(!mSession) {
         LoggerE("No session to execute operation on");
-        return false;
+        initiateNextSyncRequest();
+        return;
     }
 
+    // all asynchronous steps of the synchronization are cancelled, when the sync queue is cleared
+    if(!mSyncCancellable)
+        mSyncCancellable = g_cancellable_new();
+
+    g_dbus_connection_call( BusConnection::get(G_BUS_TYPE_SESSION),
+                            OBEX_PREFIX,
+                            mSession,
+                            OBEX_PHONEBOOK_IFACE,
+                            "Select",
+                            g_variant_new("(ss)", sync->location, sync->phonebook), // floating variants are consumed
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            SELECT_TIMEOUT*1000,
+                            mSyncCancellable,
+                            Obex::asyncSelectReadyCallback,
+                            this);
+}
+
+// callback for async call of "Select" method
+void Obex::asyncSelectReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data) {
     GError *err = NULL;
-    g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
-                                 OBEX_PREFIX,
-                                 mSession,
-                                 OBEX_PHONEBOOK_IFACE,
-                                 "Select",
-                                 g_variant_new("(ss)", location, phonebook), // floating variants are consumed
-                                 NULL,
-                                 G_DBUS_CALL_FLAGS_NONE,
-                                 -1,
-                                 NULL,
-                                 &err);
-    if(err) {
-        LoggerE("Failed to select phonebook " << location << "/" << phonebook << ": " << err->message);
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &err);
+    if(err && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // the sync queue has been cleared, don't touch the context - it may not exist anymore
         g_error_free(err);
-        return false;
+        return;
     }
 
-    return true;
+    Obex *ctx = static_cast<Obex*>(user_data);
+    if(!ctx) {
+        LoggerE("Failed to cast object: Obex");
+        if(err)
+            g_error_free(err);
+        if(reply)
+            g_variant_unref(reply);
+        return;
+    }
+
+    if(err || !reply) {
+        LoggerE("Failed to select phonebook: " << (err?err->message:"Invalid reply from 'Select'"));
+        if(err)
+            g_error_free(err);
+        // do call 'pullAll' only if 'select' operation was successful
+        ctx->initiateNextSyncRequest();
+        return;
+    }
+    g_variant_unref(reply);
+
+    if(ctx->mSyncQueue.empty()) // we should never get here, the queue is cleared only together with cancelling the call
+        return;
+
+    SyncPBData *sync = ctx->mSyncQueue.front();
+    if(sync->incremental) {
+        // read the size and the version of selected folder, before anything is pulled
+        g_dbus_connection_call( G_DBUS_CONNECTION(source),
+                                OBEX_PREFIX,
+                                ctx->mSession,
+                                OBEX_PHONEBOOK_IFACE,
+                                "GetSize",
+                                NULL,
+                                G_VARIANT_TYPE("(q)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                GET_FOLDER_VERSION_TIMEOUT*1000,
+                                ctx->mSyncCancellable,
+                                Obex::asyncGetSizeReadyCallback,
+                                ctx);
+        return;
+    }
+
+    ctx->pullSyncRequest(sync);
 }
 
-void Obex::removeSession(bool notify) {
-    if(!mSession) // there isn't active session to be removed
+void Obex::pullSyncRequest(SyncPBData *sync) {
+    if(OBEX_ERR_NONE != pullAll(sync->phonebook, sync->count, sync->offset)) {
+        // 'PullAll' has not started at all, ie. there will be no 'Complete'/'Error' signals
+        // on 'Transport' - no signal at all, threfore go to next sync request from sync queue
+        initiateNextSyncRequest();
+    }
+}
+
+// callback for async call of "GetSize" method
+void Obex::asyncGetSizeReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GError *err = NULL;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &err);
+    if(err && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // the sync queue has been cleared, don't touch the context - it may not exist anymore
+        g_error_free(err);
         return;
+    }
 
-    LoggerD("Removing session:" << mSession);
+    Obex *ctx = static_cast<Obex*>(user_data);
+    if(!ctx || ctx->mSyncQueue.empty()) {
+        LoggerE("Failed to cast object: Obex");
+        if(err)
+            g_error_free(err);
+        if(reply)
+            g_variant_unref(reply);
+        return;
+    }
+
+    SyncPBData *sync = ctx->mSyncQueue.front();
+    if(err || !reply) {
+        // the size is needed to find out what has changed, pull the entries as requested
+        LoggerD("Failed to get size of phonebook: " << (err?err->message:"Invalid reply from 'GetSize'"));
+        if(err)
+            g_error_free(err);
+        ctx->pullSyncRequest(sync);
+        return;
+    }
+
+    guint16 size = 0;
+    g_variant_get(reply, "(q)", &size);
+    g_variant_unref(reply);
+    sync->version.size = size;
+
+    // the version counters are optional, they are supported since PBAP 1.2
+    g_dbus_connection_call( G_DBUS_CONNECTION(source),
+                            OBEX_PREFIX,
+                            ctx->mSession,
+                            "org.freedesktop.DBus.Properties",
+                            "GetAll",
+                            g_variant_new("(s)", OBEX_PHONEBOOK_IFACE), // floating variants are consumed
+                            G_VARIANT_TYPE("(a{sv})"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            GET_FOLDER_VERSION_TIMEOUT*1000,
+                            ctx->mSyncCancellable,
+                            Obex::asyncGetVersionReadyCallback,
+                            ctx);
+}
+
+// callback for async call of "GetAll" method for phonebook's properties
+void Obex::asyncGetVersionReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GError *err = NULL;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &err);
+    if(err && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // the sync queue has been cleared, don't touch the context - it may not exist anymore
+        g_error_free(err);
+        return;
+    }
+
+    Obex *ctx = static_cast<Obex*>(user_data);
+    if(!ctx || ctx->mSyncQueue.empty()) {
+        LoggerE("Failed to cast object: Obex");
+        if(err)
+            g_error_free(err);
+        if(reply)
+            g_variant_unref(reply);
+        return;
+    }
 
-    // delete/unref individual contacts
-    for(auto it=mContacts.begin(); it!=mContacts.end(); ++it) {
-        EContact *contact = (*it).second;
-        if(contact) {
-            // TODO: delete also all its attribs?
-            g_object_unref(contact);
+    SyncPBData *sync = ctx->mSyncQueue.front();
+    if(err || !reply) {
+        // decide on the size only
+        LoggerD("Failed to get version of phonebook: " << (err?err->message:"Invalid reply from 'GetAll'"));
+        if(err)
+            g_error_free(err);
+    }
+    else {
+        GVariantIter *iter = NULL;
+        const char *key = NULL;
+        GVariant *value = NULL;
+        g_variant_get(reply, "(a{sv})", &iter);
+        while(g_variant_iter_loop(iter, "{&sv}", &key, &value)) {
+            if(!g_variant_is_of_type(value, G_VARIANT_TYPE_STRING))
+                continue;
+            if(!strcmp(key, "DatabaseIdentifier"))
+                sync->version.databaseId = g_variant_get_string(value, NULL);
+            else if(!strcmp(key, "PrimaryCounter"))
+                sync->version.primaryCounter = g_variant_get_string(value, NULL);
+            else if(!strcmp(key, "SecondaryCounter"))
+                sync->version.secondaryCounter = g_variant_get_string(value, NULL);
         }
+        g_variant_iter_free(iter);
+        g_variant_unref(reply);
+    }
+    sync->version.valid = true;
+
+    if(ctx->planIncrementalSync(sync)) {
+        ctx->pullSyncRequest(sync);
+    }
+    else {
+        LoggerD("Phonebook " << sync->location << "/" << sync->phonebook << " has not changed - nothing to pull");
+        ctx->initiateNextSyncRequest();
+    }
+}
+
+bool PBFolderVersion::getChanges(const PBFolderVersion &since, guint64 &changes) const {
+    // the counters are 128-bit numbers in hexadecimal notation, the changes between two synchronizations fit into the lower
+    // 64 bits, ie. the upper digits have to match
+    const size_t digits = 16;
+    size_t length = primaryCounter.length();
+    if(length == 0 || length != since.primaryCounter.length())
+        return false;
+    size_t upper = length > digits ? length - digits : 0;
+    if(primaryCounter.compare(0, upper, since.primaryCounter, 0, upper))
+        return false;
+
+    char *end = NULL;
+    guint64 current = g_ascii_strtoull(primaryCounter.c_str() + upper, &end, 16);
+    if(!end || *end)
+        return false;
+    guint64 known = g_ascii_strtoull(since.primaryCounter.c_str() + upper, &end, 16);
+    if(!end || *end || current < known)
+        return false;
+
+    changes = current - known;
+    return true;
+}
+
+bool Obex::planIncrementalSync(SyncPBData *sync) {
+    bool contacts = !strcmp(sync->phonebook, "pb");
+    PBSnapshotPtr items = contacts ? getContactsSnapshot() : getCallHistorySnapshot();
+    const PBFolderVersion &known = contacts ? mContactsVersion : mCallHistoryVersion;
+    const PBFolderVersion &current = sync->version;
+
+    // full synchronization, unless it's possible to tell what has changed
+    sync->count = 0;
+    sync->offset = 0;
+    sync->overlap = 0;
+    sync->limit = 0;
+    sync->merge = MERGE_REPLACE;
+
+    if(!known.valid || items->entries.size() == 0 || current.databaseId != known.databaseId) {
+        LoggerD("Phonebook " << sync->phonebook << " is not synchronized, or its database has changed - pulling all entries");
+        return true;
+    }
+
+    bool counters = current.hasCounters();
+    if(counters && current.primaryCounter == known.primaryCounter &&
+       current.secondaryCounter == known.secondaryCounter && current.size == known.size) {
+        return false; // nothing has changed
     }
-    mContacts.clear();
-    mContactsOrder.clear();
 
-    // delete/unref individual cll history entries
-    for(auto it=mCallHistory.begin(); it!=mCallHistory.end(); ++it) {
-        EContact *item = (*it).second;
-        if(item) {
-            // TODO: delete also all its attribs?
-            g_object_unref(item);
+    if(contacts) {
+        // new contacts get the highest handles, ie. they are at the end of the folder, however, without
+        // the counters there is no way to find out, whether the contacts have been also modified, or deleted;
+        // the last synchronized contacts are pulled again, if they have moved (eg. a contact has been deleted
+        // and another one added), the whole folder is pulled, see mergeEntries()
+        if(!counters && current.size >= known.size && items->entries.size() == known.size) {
+            sync->overlap = std::min(known.size, (unsigned long)INCREMENTAL_CONTACTS_OVERLAP);
+            sync->offset = known.size - sync->overlap;
+            sync->count = current.size - sync->offset;
+            sync->merge = MERGE_APPEND;
+        }
+    }
+    else {
+        // the latest calls are at the top of the call history
+        unsigned long count = 0;
+        if(current.size > known.size) {
+            count = current.size - known.size;
+        }
+        else if(current.size == known.size) {
+            // the size of the call history is limited, ie. the oldest calls are dropped, when new ones are added
+            count = INCREMENTAL_CALLHISTORY_SYNC_COUNT;
+        }
+        // each new call advances the counter, the calls beyond the pulled ones would be lost
+        guint64 changes = 0;
+        if(!current.primaryCounter.empty() && (!current.getChanges(known, changes) || changes > count)) {
+            LoggerD("Phonebook " << sync->phonebook << " has changed more than the latest " << count << " entries - pulling all entries");
+            count = 0;
+        }
+        if(count > 0) {
+            sync->count = count;
+            sync->limit = current.size; // the oldest calls are dropped
+            sync->merge = MERGE_PREPEND;
         }
     }
-    mCallHistory.clear();
-    mCallHistoryOrder.clear();
+
+    LoggerD("Phonebook " << sync->phonebook << " has changed - pulling " << (sync->count?sync->count:current.size) << " entries from " << sync->offset);
+    return true;
+}
+
+void Obex::removeSession(bool notify) {
+    if(!mSession) // there isn't active session to be removed
+        return;
+
+    LoggerD("Removing session:" << mSession);
+
+    // drop the entries, they are deleted once the last reader releases them
+    publishSnapshot("pb", PBSnapshotPtr(new PBSnapshot()));
+    mContactsVersion.clear();
+    publishSnapshot("cch", PBSnapshotPtr(new PBSnapshot()));
+    mCallHistoryVersion.clear();
 
     GError *err = NULL;
-    g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SESSION),
                                  OBEX_PREFIX,
                                  "/org/bluez/obex",
                                  OBEX_CLIENT_IFACE,
@@ -226,15 +678,7 @@ void Obex::initiateNextSyncRequest() {
         mSyncQueue.pop_front();
         if(!mSyncQueue.empty()) {
             // there is another sync request in the queue
-            SyncPBData *sync = mSyncQueue.front();
-            LoggerD("synchronizing data: " << sync->location << "/" << sync->phonebook);
-            if(select(sync->location, sync->phonebook)) { // do call 'pullAll' only if 'select' operation was successful
-                if(OBEX_ERR_NONE != pullAll(sync->phonebook, sync->count)) {
-                    // 'PullAll' has not started at all, ie. there will be no 'Complete'/'Error' signals
-                    // on 'Transport' - no signal at all, threfore go to next sync request from sync queue
-                    initiateNextSyncRequest();
-                }
-            }
+            startSyncRequest();
         }
         else {
             LoggerD("Synchronization done");
@@ -249,28 +693,15 @@ void Obex::initiateNextSyncRequest() {
 }
 
 void Obex::clearSyncQueue() {
-    /*
-    if(mActiveTransfer) {
-        GError *err = NULL;
-        g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
-                                     OBEX_PREFIX,
-                                     mActiveTransfer,
-                                     OBEX_TRANSFER_IFACE,
-                                     "Cancel",
-                                     NULL,
-                                     NULL,
-                                     G_DBUS_CALL_FLAGS_NONE,
-                                     -1,
-                                     NULL,
-                                     &err);
-        if(err) {
-            LoggerE("Failed to 'Cancel' active Transfer: " << err->message);
-            g_error_free(err);
-            return;
-        }
-        LoggerD("Active transfer 'Cancel'ed");
+    // cancel pending 'Select'/'PullAll' calls - their callbacks won't proceed with the synchronization
+    if(mSyncCancellable) {
+        g_cancellable_cancel(mSyncCancellable);
+        g_object_unref(mSyncCancellable);
+        mSyncCancellable = NULL;
     }
-    */
+
+    // stop watching active transfer, its VCards won't be processed
+    clearActiveTransfer();
 
     for(unsigned int i=0; i<mSyncQueue.size(); i++) {
         delete mSyncQueue.at(i);
@@ -278,12 +709,34 @@ void Obex::clearSyncQueue() {
     mSyncQueue.clear();
 }
 
+void Obex::clearActiveTransfer() {
+    if(mStalledTransferTimer) {
+        g_source_remove(mStalledTransferTimer);
+        mStalledTransferTimer = 0;
+    }
+
+    // drop the VCards being parsed, they belong to the active transfer
+    g_atomic_int_set(&mActiveTransferId, 0);
+
+    if(mActiveTransferData) {
+        // the transfer is released on the ingest thread, which watches it
+        g_cancellable_cancel(mActiveTransferData->cancellable);
+        g_main_context_invoke(mIngestContext, Obex::unwatchTransferCb, mActiveTransferData);
+        mActiveTransferData = NULL;
+    }
+
+    if(mActiveTransfer) {
+        free(mActiveTransfer);
+        mActiveTransfer = NULL;
+    }
+}
+
 void Obex::setSelectedRemoteDevice(std::string &btAddress) {
     mSelectedRemoteDevice = btAddress;
 }
 
 //DBUS: object, dict PullAll(string targetfile, dict filters)
-Obex::Error Obex::pullAll(const char *type, unsigned long count) {
+Obex::Error Obex::pullAll(const char *type, unsigned long count, unsigned long offset) {
     LoggerD("entered");
 
     if(!type) {
@@ -293,13 +746,9 @@ Obex::Error Obex::pullAll(const char *type, unsigned long count) {
 
     if(!mSession) {
         LoggerE("No session to execute operation on");
-        initiateNextSyncRequest();
         return OBEX_ERR_INVALID_SESSION;
     }
 
-    GError *err = NULL;
-    GVariant *reply;
-
     GVariant *filters[8];
     int nfilters = 0;
 
@@ -310,7 +759,7 @@ Obex::Error Obex::pullAll(const char *type, unsigned long count) {
     var = g_variant_new_variant(str);
     filters[nfilters++] = g_variant_new_dict_entry(name, var);
 
-    // "Offset" -> Offset of the first item, default is 0
+    // "MaxCount" -> Maximum number of items, default is unlimited
     if(count > 0) {
         name = g_variant_new_string("MaxCount");
         str = g_variant_new_uint16(count);
@@ -318,6 +767,14 @@ Obex::Error Obex::pullAll(const char *type, unsigned long count) {
         filters[nfilters++] = g_variant_new_dict_entry(name, var);
     }
 
+    // "Offset" -> Offset of the first item, default is 0
+    if(offset > 0) {
+        name = g_variant_new_string("Offset");
+        str = g_variant_new_uint16(offset);
+        var = g_variant_new_variant(str);
+        filters[nfilters++] = g_variant_new_dict_entry(name, var);
+    }
+
     GVariant *array = g_variant_new_array(G_VARIANT_TYPE("{sv}"), filters, nfilters);
 
     // build the parameters variant
@@ -325,118 +782,254 @@ Obex::Error Obex::pullAll(const char *type, unsigned long count) {
     g_variant_builder_add_value(builder, g_variant_new("s", "")); // target file name will be automatically calculated
     g_variant_builder_add_value(builder, array);
     GVariant *parameters = g_variant_builder_end(builder);
+    g_variant_builder_unref(builder);
+
+    g_dbus_connection_call( BusConnection::get(G_BUS_TYPE_SESSION),
+                            OBEX_PREFIX,
+                            mSession,
+                            OBEX_PHONEBOOK_IFACE,
+                            "PullAll",
+                            parameters,
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            PULL_ALL_TIMEOUT*1000,
+                            mSyncCancellable,
+                            Obex::asyncPullAllReadyCallback,
+                            this);
 
-    reply = g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
-                                         OBEX_PREFIX,
-                                         mSession,
-                                         OBEX_PHONEBOOK_IFACE,
-                                         "PullAll",
-                                         parameters,
-                                         NULL,
-                                         G_DBUS_CALL_FLAGS_NONE,
-                                         -1,
-                                         NULL,
-                                         &err);
+    return OBEX_ERR_NONE;
+}
 
-    if(err) {
-        LoggerE("Failed to 'PullAll': " << err->message);
-        initiateNextSyncRequest();
+// callback for async call of "PullAll" method
+void Obex::asyncPullAllReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GError *err = NULL;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &err);
+    if(err && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // the sync queue has been cleared, don't touch the context - it may not exist anymore
         g_error_free(err);
-        return OBEX_ERR_DBUS_ERROR;
+        return;
     }
 
-    if(!reply) {
-        LoggerE("Reply from call 'PullAll' is NULL");
-        initiateNextSyncRequest();
-        return OBEX_ERR_DBUS_INVALID_REPLY;
+    Obex *ctx = static_cast<Obex*>(user_data);
+    if(!ctx) {
+        LoggerE("Failed to cast object: Obex");
+        if(err)
+            g_error_free(err);
+        if(reply)
+            g_variant_unref(reply);
+        return;
+    }
+
+    if(err || !reply) {
+        LoggerE("Failed to 'PullAll': " << (err?err->message:"Invalid reply from 'PullAll'"));
+        if(err)
+            g_error_free(err);
+        ctx->initiateNextSyncRequest();
+        return;
     }
 
     const char *transfer = NULL;
     GVariantIter *iter;
-    g_variant_get(reply, "(oa{sv})", &transfer, &iter);
+    g_variant_get(reply, "(&oa{sv})", &transfer, &iter);
     LoggerD("transfer path = " << transfer);
-    mActiveTransfer = strdup(transfer);
-    g_timeout_add(CHECK_STALLED_TRANSFER_TIMEOUT*1000,
-                  Obex::checkStalledTransfer,
-                  new CtxCbData(this, NULL, strdup(transfer), NULL));
-
-    // let's abuse 'cb' field from CtxCbData to store selected remote device's MAC
-    CtxCbData *data = new CtxCbData(this, strdup(mSelectedRemoteDevice.c_str()), NULL, (void*)type);
 
     const char *key;
     GVariant *value;
-    while(g_variant_iter_next(iter, "{sv}", &key, &value)) {
-        if(!strcmp(key, "Size")) { // "Size"
-            //guint64 val = g_variant_get_uint64(value);
-            //LoggerD(key << " = " << val);
-        }
-        else { // "Name", "Filename"
-            //LoggerD(key << " = " << g_variant_get_string(value, NULL));
-            if(!strcmp(key, "Filename")) {
-                const char *fileName = g_variant_get_string(value, NULL);
-                if(fileName) {
-                    LoggerD("Saving pulled data/VCards into: " << fileName);
-                    // we call subscribe for "Complete" signal here, since we need to know path of stored file
-                    // !!! what if signal comes before we subscribe for it? ... CAN IT? ... signals from DBUS
-                    // should be executed in the thread the registration was made from, ie. this method has to
-                    // to be completed first
-		    data->data1 = strdup(fileName);
-                    Utils::setSignalListener(G_BUS_TYPE_SESSION, OBEX_PREFIX,
-                                             "org.freedesktop.DBus.Properties", transfer, "PropertiesChanged",
-                                             Obex::handleSignal, data);
-                }
-            }
+    const char *fileName = NULL;
+    while(g_variant_iter_loop(iter, "{&sv}", &key, &value)) {
+        // "Size", "Name", "Filename"
+        if(!strcmp(key, "Filename") && !fileName) {
+            fileName = g_variant_get_string(value, NULL);
         }
     }
 
+    if(!transfer || !fileName) {
+        LoggerE("Failed to get 'transfer'/'Filename' from the 'PullAll' reply");
+        g_variant_iter_free(iter);
+        g_variant_unref(reply);
+        ctx->initiateNextSyncRequest();
+        return;
+    }
+
+    LoggerD("Saving pulled data/VCards into: " << fileName);
+    SyncPBData *sync = ctx->mSyncQueue.front();
+    if(++ctx->mTransferCount == 0) // 0 means no transfer
+        ctx->mTransferCount++;
+    // remember the device, which the data are pulled from
+    TransferData *data = new TransferData(ctx, ctx->mTransferCount, transfer, fileName, sync->phonebook,
+                                          ctx->mSelectedRemoteDevice.c_str(), sync->merge);
+    data->overlap = sync->overlap;
+    data->limit = sync->limit;
+    ctx->mActiveTransfer = strdup(transfer);
+    ctx->mActiveTransferData = data;
+    g_atomic_int_set(&ctx->mActiveTransferId, data->id);
+    ctx->mStalledTransferTimer = g_timeout_add(CHECK_STALLED_TRANSFER_TIMEOUT*1000, Obex::checkStalledTransfer, ctx);
+
+    // completion of the transfer and processing of its VCards are handled on the ingest thread,
+    // so that handling of D-Bus method calls on the main loop is not delayed by the synchronization
+    g_main_context_invoke(ctx->mIngestContext, Obex::watchTransferCb, data);
+
+    g_variant_iter_free(iter);
     g_variant_unref(reply);
+}
 
-    return OBEX_ERR_NONE;
+// runs on the ingest thread
+gboolean Obex::watchTransferCb(gpointer user_data) {
+    TransferData *data = static_cast<TransferData*>(user_data);
+    if(!data || g_cancellable_is_cancelled(data->cancellable))
+        return G_SOURCE_REMOVE; // released by unwatchTransferCb()
+
+    // the transfer may have finished before the subscription was made, therefore
+    // check its status, once subscribed - whichever comes first finishes the transfer
+    data->watched = data->signals.subscribe(G_BUS_TYPE_SESSION, OBEX_PREFIX,
+                                            "org.freedesktop.DBus.Properties", data->path.c_str(), "PropertiesChanged");
+    g_dbus_connection_call( BusConnection::get(G_BUS_TYPE_SESSION),
+                            OBEX_PREFIX,
+                            data->path.c_str(),
+                            "org.freedesktop.DBus.Properties",
+                            "Get",
+                            g_variant_new("(ss)", OBEX_TRANSFER_IFACE, "Status"), // floating variants are consumed
+                            G_VARIANT_TYPE("(v)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            GET_TRANSFER_STATUS_TIMEOUT*1000,
+                            data->cancellable,
+                            Obex::asyncTransferStatusReadyCallback,
+                            data);
+
+    return G_SOURCE_REMOVE;
 }
 
-gboolean Obex::checkStalledTransfer(gpointer user_data) {
-    CtxCbData *data = static_cast<CtxCbData*>(user_data);
+// runs on the ingest thread
+gboolean Obex::unwatchTransferCb(gpointer user_data) {
+    TransferData *data = static_cast<TransferData*>(user_data);
     if(!data)
-        return G_SOURCE_REMOVE; // single shot timeout
+        return G_SOURCE_REMOVE;
 
-    Obex *ctx = static_cast<Obex*>(data->ctx);
-    char *transfer = static_cast<char*>(data->data1);
-    if(!ctx || !transfer) {
-        LoggerE("Failed to cast to Obex");
-        return G_SOURCE_REMOVE; // single shot timeout
-    }
-    if(ctx->mActiveTransfer && !strcmp(ctx->mActiveTransfer, transfer)) {
-        LoggerD("The active transfer is Stalled");
-        ctx->clearSyncQueue();
-        ctx->transferStalled();
-    }
-    free(transfer);
+    // the status query is cancelled, its callback doesn't access the data
+    // and the signals of the transfer are unsubscribed by its router
     delete data;
-    return G_SOURCE_REMOVE; // single shot timeout
+
+    return G_SOURCE_REMOVE;
 }
 
-Obex::Error Obex::syncContacts(unsigned long count) {
-    LoggerD("entered");
-    if(!mSession) {
-        LoggerD("Session not created, you have to call createSession before calling any method");
-        return OBEX_ERR_INVALID_SESSION;
+// callback for async call of "Get" method for transfer's "Status" property, runs on the ingest thread
+void Obex::asyncTransferStatusReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GError *err = NULL;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &err);
+    if(err && g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // the transfer is not watched anymore, don't touch the data - it may not exist anymore
+        g_error_free(err);
+        return;
     }
-    mSyncQueue.push_back(new SyncPBData("INT", "pb", count));
 
-    // if the size is one, that means that there has not been
+    TransferData *data = static_cast<TransferData*>(user_data);
+    if(!data) {
+        LoggerE("Failed to cast object: TransferData");
+        if(err)
+            g_error_free(err);
+        if(reply)
+            g_variant_unref(reply);
+        return;
+    }
+
+    if(err || !reply) {
+        // the status is also reported by the signal, or the transfer is reported stalled
+        LoggerD("Failed to get status of transfer " << data->path << ": " << (err?err->message:"Invalid reply from 'Get'"));
+        if(err)
+            g_error_free(err);
+        return;
+    }
+
+    GVariant *value = NULL;
+    g_variant_get(reply, "(v)", &value);
+    if(!g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+        // the status is also reported by the signal, or the transfer is reported stalled
+        LoggerE("Invalid type of status of transfer " << data->path << ": " << g_variant_get_type_string(value));
+    }
+    else {
+        const char *status = g_variant_get_string(value, NULL);
+        LoggerD("Status of transfer " << data->path << " is: " << status);
+        if(!strcmp(status, "complete") || !strcmp(status, "error"))
+            transferFinished(data, status);
+    }
+
+    g_variant_unref(value);
+    g_variant_unref(reply);
+}
+
+// runs on the ingest thread
+void Obex::transferFinished(TransferData *data, const char *status) {
+    // handle the transfer only once, it's reported by both the signal and the status query
+    if(data->finished || g_cancellable_is_cancelled(data->cancellable))
+        return;
+    data->finished = true;
+
+    if(data->watched) {
+        Utils::removeSignalListener(G_BUS_TYPE_SESSION, OBEX_PREFIX, "org.freedesktop.DBus.Properties",
+                                    data->path.c_str(), "PropertiesChanged");
+        data->watched = false;
+    }
+
+    if(!strcmp(status, "complete")) {
+        // the VCards are parsed on worker threads, the synchronization continues once they are merged, see ingestDoneCb()
+        if(data->ctx->processVCards(data))
+            return;
+    }
+    else {
+        LoggerE("Transfer " << data->path << " failed");
+    }
+
+    // continue with the synchronization on the main loop
+    g_main_context_invoke(NULL, Obex::transferFailedCb, new CtxCbData(data->ctx, NULL, GUINT_TO_POINTER(data->id), NULL));
+}
+
+gboolean Obex::transferFailedCb(gpointer user_data) {
+    CtxCbData *data = static_cast<CtxCbData*>(user_data);
+    if(!data)
+        return G_SOURCE_REMOVE;
+    Obex *ctx = static_cast<Obex*>(data->ctx);
+    guint transfer = GPOINTER_TO_UINT(data->data1);
+    delete data;
+
+    // ignore the transfer, if the sync queue has been cleared meanwhile
+    if(!ctx->mActiveTransfer || transfer != (guint)g_atomic_int_get(&ctx->mActiveTransferId))
+        return G_SOURCE_REMOVE;
+
+    ctx->clearActiveTransfer();
+    ctx->initiateNextSyncRequest();
+
+    return G_SOURCE_REMOVE;
+}
+
+gboolean Obex::checkStalledTransfer(gpointer user_data) {
+    Obex *ctx = static_cast<Obex*>(user_data);
+    if(!ctx) {
+        LoggerE("Failed to cast to Obex");
+        return G_SOURCE_REMOVE; // single shot timeout
+    }
+    ctx->mStalledTransferTimer = 0; // the source is removed, once returned
+    if(ctx->mActiveTransfer) {
+        LoggerD("The active transfer is Stalled");
+        ctx->clearSyncQueue();
+        ctx->transferStalled();
+    }
+    return G_SOURCE_REMOVE; // single shot timeout
+}
+
+Obex::Error Obex::syncContacts(unsigned long count, bool incremental) {
+    LoggerD("entered");
+    if(!mSession) {
+        LoggerD("Session not created, you have to call createSession before calling any method");
+        return OBEX_ERR_INVALID_SESSION;
+    }
+    mSyncQueue.push_back(new SyncPBData("INT", "pb", count, incremental));
+
+    // if the size is one, that means that there has not been
     // synchronization on-going and therefore we can initiate
     // synchronization from here, otherwise it will be initiated
     // once the current one will have finished
     if(mSyncQueue.size() == 1) {
-        SyncPBData *sync = mSyncQueue.front();
-        LoggerD("synchronizing data: " << sync->location << "/" << sync->phonebook << " count=" << count);
-        if(select(sync->location, sync->phonebook)) { // do call 'pullAll' only if 'select' operation was successful
-            if(OBEX_ERR_NONE != pullAll(sync->phonebook, sync->count)) {
-                // 'PullAll' has not started at all, ie. there will be no 'Complete'/'Error' signals
-                // on 'Transport' - no signal at all, threfore go to next sync request from sync queue
-                initiateNextSyncRequest();
-            }
-        }
+        startSyncRequest();
     }
 
     return OBEX_ERR_NONE;
@@ -449,16 +1042,17 @@ void Obex::getContactByPhoneNumber(const char *phoneNumber, std::string &contact
         return;
     }
 
-    for(auto it=mContacts.begin(); it!=mContacts.end(); ++it) {
-        GList *phoneNumbersList = (GList*)e_contact_get((*it).second, E_CONTACT_TEL);
-        if(phoneNumbersList) {
-            const char *phoneNumberToCheck = phoneNumbersList->data?(const char*)phoneNumbersList->data:NULL;
-            if(phoneNumberToCheck && !strcmp(phoneNumberToCheck, phoneNumber)) {
-                parseEContactToJsonTizenContact((*it).second, contact);
-                g_list_free(phoneNumbersList);
-                return;
-            }
-            g_list_free(phoneNumbersList);
+    PBSnapshotPtr contacts = getContactsSnapshot();
+    const std::string *uid = contacts->numbers.find(phoneNumber);
+    if(uid) {
+        const PBEntry *entry = contacts->entries.find(*uid);
+        if(entry) {
+            PhotoPins pins(&mPhotos);
+            if(!entry->photo.empty())
+                pins.materialize(entry->photo);
+            if(!makeJsonContact(*entry, contact))
+                contact = entry->json;
+            return;
         }
     }
 
@@ -469,51 +1063,195 @@ void Obex::getContactByPhoneNumber(const char *phoneNumber, std::string &contact
 void Obex::getJsonContacts(std::string& contacts, unsigned long count) {
     LoggerD("entered");
 
-    contacts = "[";
-
+    PBSnapshotPtr snapshot = getContactsSnapshot();
     // if count == 0, ie. return all contacts
-    count = (count>0 && count<mContactsOrder.size())?count:mContactsOrder.size();
-
-    for(unsigned int i = 0; i<count; ++i) { // get 'count' latest contacts, ie. 'count' first from the list
-        EContact *item = mContacts[mContactsOrder.at(i)];
-        if(item) { // make sure, that the item exists
-            //if(i!=0) // exclude ',' for the first entry - DON'T compare it against the index - What if first item is not found in the map?
-            if(contacts.compare("[")) // exclude ',' for the first entry
-                contacts += ",";
-            std::string contact;
-            parseEContactToJsonTizenContact(item, contact);
-            contacts += contact;
+    std::vector<const PBEntry*> entries;
+    snapshot->getEntries(0, count, entries);
+    PhotoPins pins(&mPhotos);
+    materializePhotos(entries, pins);
+    makeJsonContacts(entries, contacts);
+}
+
+Obex::Error Obex::getContactsRange(const PBSnapshot &snapshot, unsigned long offset, unsigned long limit, const char *sortKey, std::vector<const PBEntry*> &entries, PhotoPins &pins) {
+    if(!sortKey || !sortKey[0]) { // order of synchronization
+        snapshot.getEntries(offset, limit, entries);
+    }
+    else {
+        const std::vector<const PBEntry*> *sorted = snapshot.getSorted(sortKey);
+        if(!sorted) {
+            LoggerE("Invalid sort key: " << sortKey);
+            return OBEX_ERR_INVALID_ARGUMENTS;
+        }
+        if(offset < sorted->size()) {
+            unsigned long count = (limit>0 && limit<sorted->size()-offset)?limit:sorted->size()-offset;
+            entries.assign(sorted->begin() + offset, sorted->begin() + offset + count);
         }
     }
 
+    materializePhotos(entries, pins);
+    return OBEX_ERR_NONE;
+}
+
+Obex::Error Obex::getJsonContactsRange(std::string& contacts, unsigned long offset, unsigned long limit, const char *sortKey) {
+    LoggerD("entered: offset=" << offset << " limit=" << limit << " sortKey=" << (sortKey?sortKey:""));
+
+    PBSnapshotPtr snapshot = getContactsSnapshot();
+    std::vector<const PBEntry*> entries;
+    PhotoPins pins(&mPhotos);
+    Obex::Error err = getContactsRange(*snapshot, offset, limit, sortKey, entries, pins);
+    if(OBEX_ERR_NONE != err)
+        return err;
+
+    makeJsonContacts(entries, contacts);
+    return OBEX_ERR_NONE;
+}
+
+Obex::Error Obex::getContactsVariant(GVariant **contacts, unsigned long offset, unsigned long limit, const char *sortKey) {
+    LoggerD("entered: offset=" << offset << " limit=" << limit << " sortKey=" << (sortKey?sortKey:""));
+
+    PBSnapshotPtr snapshot = getContactsSnapshot();
+    std::vector<const PBEntry*> entries;
+    PhotoPins pins(&mPhotos);
+    Obex::Error err = getContactsRange(*snapshot, offset, limit, sortKey, entries, pins);
+    if(OBEX_ERR_NONE != err)
+        return err;
+
+    // the values are serialized directly from the records of the entries, into the buffer of the array
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+    for(unsigned int i=0; i<entries.size(); i++)
+        g_variant_builder_add_value(&builder, makeContactVariant(*entries[i], &mPhotos, pins.contains(entries[i]->photo)));
+    *contacts = g_variant_builder_end(&builder);
+    return OBEX_ERR_NONE;
+}
+
+// adds the string to the dictionary, unless it's empty
+static void addString(GVariantBuilder *builder, const char *key, const char *value) {
+    if(value && value[0])
+        g_variant_builder_add(builder, "{sv}", key, g_variant_new_string(value));
+}
+
+GVariant *Obex::makeContactVariant(const PBEntry &entry, const PhotoStore *photos, bool photo) {
+    const ContactRecord &record = entry.record;
+    GVariantBuilder contact;
+    g_variant_builder_init(&contact, G_VARIANT_TYPE("a{sv}"));
+
+    addString(&contact, "uid", entry.uid.c_str());
+    addString(&contact, "firstName", record.get(ContactRecord::GIVEN_NAME));
+    addString(&contact, "lastName", record.get(ContactRecord::FAMILY_NAME));
+    addString(&contact, "displayName", record.get(ContactRecord::FULL_NAME));
+
+    // photoURI and thumbnailURI, the photos are stored in PhotoStore, see processVCards() method
+    const char *uri = photo ? record.get(ContactRecord::PHOTO_URI) : NULL;
+    if(uri) {
+        addString(&contact, "photoURI", uri);
+        std::string key, thumbnail;
+        if(photos && photos->getKey(uri, key) && photos->hasThumbnail(key)) {
+            photos->getThumbnailUri(key, thumbnail);
+            addString(&contact, "thumbnailURI", thumbnail.c_str());
+        }
+    }
+
+    // phoneNumbers, the first one is used as personId
+    if(record.numberCount()) {
+        addString(&contact, "personId", record.number(0));
+        GVariantBuilder numbers;
+        g_variant_builder_init(&numbers, G_VARIANT_TYPE("as"));
+        for(unsigned int i=0; i<record.numberCount(); i++)
+            g_variant_builder_add(&numbers, "s", record.number(i));
+        g_variant_builder_add(&contact, "{sv}", "phoneNumbers", g_variant_builder_end(&numbers));
+    }
+
+    // emails
+    GVariantBuilder emails;
+    g_variant_builder_init(&emails, G_VARIANT_TYPE("as"));
+    for(unsigned int i=0; i<record.emailCount(); i++)
+        g_variant_builder_add(&emails, "s", record.email(i));
+    g_variant_builder_add(&contact, "{sv}", "emails", g_variant_builder_end(&emails));
+
+    // addresses
+    static const char *keys[ContactRecord::ADDRESS_FIELD_COUNT] = {
+        "type", "country", "region", "city", "streetAddress", "postalCode"
+    };
+    GVariantBuilder addresses;
+    g_variant_builder_init(&addresses, G_VARIANT_TYPE("aa{ss}"));
+    for(unsigned int i=0; i<record.addressCount(); i++) {
+        g_variant_builder_open(&addresses, G_VARIANT_TYPE("a{ss}"));
+        for(int field=0; field<ContactRecord::ADDRESS_FIELD_COUNT; field++) {
+            const char *value = record.address(i, (ContactRecord::AddressField)field);
+            if(value)
+                g_variant_builder_add(&addresses, "{ss}", keys[field], value);
+        }
+        g_variant_builder_close(&addresses);
+    }
+    g_variant_builder_add(&contact, "{sv}", "addresses", g_variant_builder_end(&addresses));
+
+    return g_variant_builder_end(&contact);
+}
+
+bool Obex::makeJsonContact(const PBEntry &entry, std::string &contact) const {
+    // the thumbnail is made in the background, after the JSON of the entry has been made, its URI is added to the response
+    std::string key, thumbnail;
+    const char *uri = entry.record.get(ContactRecord::PHOTO_URI);
+    if(!uri || !mPhotos.getKey(uri, key) || !mPhotos.hasThumbnail(key) || entry.json.size() < 2)
+        return false;
+    std::string member;
+    mPhotos.getThumbnailUri(key, thumbnail);
+    {
+        JsonWriter json(member);
+        json.beginObject();
+        json.string("thumbnailURI", thumbnail.c_str());
+        json.endObject();
+    }
+
+    // the member is inserted before the closing brace of the entry
+    contact.clear();
+    contact.reserve(entry.json.size() + member.size());
+    contact.append(entry.json, 0, entry.json.size() - 1);
+    contact += ",";
+    contact.append(member, 1, std::string::npos);
+    return true;
+}
+
+void Obex::makeJsonContacts(const std::vector<const PBEntry*> &entries, std::string &contacts) const {
+    // pre-size the buffer, like PBSnapshot::makeJsonArray(), the thumbnails may re-allocate it
+    size_t length = 2;
+    for(unsigned int i = 0; i<entries.size(); ++i)
+        length += entries[i]->json.length() + 1;
+
+    std::string contact;
+    contacts.clear();
+    contacts.reserve(length);
+    contacts += "[";
+    for(unsigned int i = 0; i<entries.size(); ++i) {
+        if(i != 0) // exclude ',' for the first entry
+            contacts += ",";
+        if(!entries[i]->photo.empty() && makeJsonContact(*entries[i], contact))
+            contacts += contact;
+        else
+            contacts += entries[i]->json;
+    }
     contacts += "]";
 }
 
-void Obex::parseEContactToJsonTizenContact(EContact *econtact, std::string &contact) {
-       const char *uid = (const char*)e_contact_get_const(econtact, E_CONTACT_UID);
+void Obex::parseEntryToJsonTizenContact(const PBEntry &entry, std::string &contact) {
+       const ContactRecord &record = entry.record;
 
-       if(!econtact || !uid) {
+       contact.clear();
+       if(entry.uid.empty()) {
            contact = "{}"; // empty contact
            return;
        }
 
+       JsonWriter json(contact, JSON_CONTACT_RESERVE);
+       json.beginObject();
+
        // uid:
-       contact = "{";
-       contact += "\"uid\":\"";
-       contact += uid;
-       contact += "\"";
+       json.string("uid", entry.uid.c_str());
 
        // personId:
-       GList *phoneNumbersList = (GList*)e_contact_get(econtact, E_CONTACT_TEL);
-       const char *personId = (phoneNumbersList && phoneNumbersList->data)?(const char*)phoneNumbersList->data:NULL; // phoneNumber is used as personId - first number from the list is used
-       if(personId && strcmp(personId, "")) {
-           contact += ",\"personId\":\"";
-           contact += personId;
-           contact += "\"";
-       }
-       // DON'T free the list yet, it will be used later in the function
-       //if(phoneNumbersList)
-       //    g_list_free(phoneNumbersList);
+       const char *personId = record.numberCount() ? record.number(0) : NULL; // phoneNumber is used as personId - first number from the list is used
+       json.optionalString("personId", personId);
 
        // addressBookId: not parsed
 
@@ -522,137 +1260,57 @@ void Obex::parseEContactToJsonTizenContact(EContact *econtact, std::string &cont
        // isFavorite: not parsed
 
        // name:
-       contact += ",\"name\":{";
-       const char *firstName = (const char*)e_contact_get_const(econtact, E_CONTACT_GIVEN_NAME);
-       const char *lastName = (const char*)e_contact_get_const(econtact, E_CONTACT_FAMILY_NAME);
-       const char *displayName = (const char*)e_contact_get_const(econtact, E_CONTACT_FULL_NAME);
-       bool firstAttr = true; // used to indicate whether separating comma should be used
-       if(firstName && strcmp(firstName, "")) {
-           firstAttr = false;
-           contact += "\"firstName\":\"";
-           contact += firstName;
-           contact += "\"";
-       }
-       if(lastName && strcmp(lastName, "")) {
-           if(firstAttr)
-               contact += "\"lastName\":\"";
-           else
-               contact += ",\"lastName\":\"";
-           firstAttr = false;
-           contact += lastName;
-           contact += "\"";
-       }
-       if(displayName && strcmp(displayName, "")) {
-           if(firstAttr)
-               contact += "\"displayName\":\"";
-           else
-               contact += ",\"displayName\":\"";
-           firstAttr = false;
-           contact += displayName;
-           contact += "\"";
-       }
-       contact += "}";
+       json.beginObject("name");
+       json.optionalString("firstName", record.get(ContactRecord::GIVEN_NAME));
+       json.optionalString("lastName", record.get(ContactRecord::FAMILY_NAME));
+       json.optionalString("displayName", record.get(ContactRecord::FULL_NAME));
+       json.endObject();
 
        // addresses:
-       contact += ",\"addresses\":[";
-       for(int id=E_CONTACT_ADDRESS_HOME; id<=E_CONTACT_ADDRESS_OTHER; id++) {
-           EContactAddress *address = (EContactAddress*)e_contact_get(econtact, (EContactField)id);
-           if(address) {
-               contact += "{";
-               contact += "\"isDefault\":\"false\"";
-               if(address->country && strcmp(address->country,"")) {
-                   contact += ",\"country\":\"";
-                   contact += address->country;
-                   contact += "\"";
-               }
-               if(address->region && strcmp(address->region,"")) {
-                   contact += ",\"region\":\"";
-                   contact += address->region;
-                   contact += "\"";
-               }
-               if(address->locality && strcmp(address->locality,"")) {
-                   contact += ",\"city\":\"";
-                   contact += address->locality;
-                   contact += "\"";
-               }
-               if(address->street && strcmp(address->street,"")) {
-                   contact += ",\"streetAddress\":\"";
-                   contact += address->street;
-                   contact += "\"";
-               }
-               if(address->code && strcmp(address->code,"")) {
-                   contact += ",\"postalCode\":\"";
-                   contact += address->code;
-                   contact += "\"";
-               }
-               contact += ",\"types\":[\"";
-               contact += id==E_CONTACT_ADDRESS_HOME ? "HOME" : (id==E_CONTACT_ADDRESS_WORK ? "WORK" : (id==E_CONTACT_ADDRESS_OTHER ? "OTHER" : ""));
-               contact += "\"]";
-               contact += "}";
-
-               e_contact_address_free(address);
-           }
+       json.beginArray("addresses");
+       for(unsigned int i=0; i<record.addressCount(); i++) {
+           json.beginObject();
+           json.string("isDefault", "false");
+           json.optionalString("country", record.address(i, ContactRecord::ADDRESS_COUNTRY));
+           json.optionalString("region", record.address(i, ContactRecord::ADDRESS_REGION));
+           json.optionalString("city", record.address(i, ContactRecord::ADDRESS_CITY));
+           json.optionalString("streetAddress", record.address(i, ContactRecord::ADDRESS_STREET));
+           json.optionalString("postalCode", record.address(i, ContactRecord::ADDRESS_POSTAL_CODE));
+           json.beginArray("types");
+           json.string(NULL, record.address(i, ContactRecord::ADDRESS_TYPE));
+           json.endArray();
+           json.endObject();
        }
-       contact += "]";
+       json.endArray();
 
        // photoURI:
-       EContactPhoto *photo = (EContactPhoto*)e_contact_get(econtact, E_CONTACT_PHOTO);
-       if(photo) {
-           // we should have only URI type of contact photo, ... see processVCards() method
-           if(E_CONTACT_PHOTO_TYPE_URI == photo->type) {
-                const char *uri = e_contact_photo_get_uri(photo);
-                if(uri && strcmp(uri, "")) {
-                    //LoggerD("photoURI = " << uri);
-                    contact += ",\"photoURI\":\"";
-                    contact += uri;
-                    contact += "\"";
-                }
-           }
-       }
-       e_contact_photo_free(photo);
+       // we should have only URI type of contact photo, ... see processVCards() method
+       const char *uri = record.get(ContactRecord::PHOTO_URI);
+       if(uri)
+           json.string("photoURI", uri);
+       // thumbnailURI: added to the response, once the thumbnail is made, see makeJsonContact()
 
        // phoneNumbers
-       contact += ",\"phoneNumbers\":[";
-       bool firstNumber = true;
-       while(phoneNumbersList && phoneNumbersList->data) {
-           const char *phoneNumber = (phoneNumbersList && phoneNumbersList->data)?(const char*)phoneNumbersList->data:"";
-           if(phoneNumber && strcmp(phoneNumber, "")) {
-               if(firstNumber)
-                   contact += "{\"number\":\"";
-               else
-                   contact += ",{\"number\":\"";
-               firstNumber = false;
-               contact += phoneNumber;
-               contact += "\"}";
-           }
-           phoneNumbersList = phoneNumbersList->next;
+       json.beginArray("phoneNumbers");
+       for(unsigned int i=0; i<record.numberCount(); i++) {
+           json.beginObject();
+           json.string("number", record.number(i));
+           json.endObject();
        }
-       contact += "]";
-       // now we can free the list
-       if(phoneNumbersList)
-           g_list_free(phoneNumbersList);
+       json.endArray();
 
        // emails:
-       contact += ",\"emails\":[";
-       bool firstEmail = true;
-       for(int id=E_CONTACT_FIRST_EMAIL_ID; id<=E_CONTACT_LAST_EMAIL_ID; id++) {
-           const char *email = (const char*)e_contact_get_const(econtact, (EContactField)id);
-           if(email && strcmp(email, "")) {
-               if(firstEmail)
-                   contact += "{\"email\":\"";
-               else
-                   contact += ",{\"email\":\"";
-
-               contact += email;
-               contact += "\"";
-               contact += ",\"isDefault\":\"false\""; // TODO: ?use 'firstEmail' value to set the first e-mail address as default?
-               contact += ",\"types\":[\"WORK\"]"; // just some default value
-
-               firstEmail = false;
-               contact += "}";
-           }
+       json.beginArray("emails");
+       for(unsigned int i=0; i<record.emailCount(); i++) {
+           json.beginObject();
+           json.string("email", record.email(i));
+           json.string("isDefault", "false"); // TODO: ?use the first e-mail address as default?
+           json.beginArray("types");
+           json.string(NULL, "WORK"); // just some default value
+           json.endArray();
+           json.endObject();
        }
-       contact += "]";
+       json.endArray();
 
        // birthday: not parsed
 
@@ -668,344 +1326,711 @@ void Obex::parseEContactToJsonTizenContact(EContact *econtact, std::string &cont
 
        // groupIds: not parsed
 
-       contact += "}";
+       json.endObject();
 }
 
-Obex::Error Obex::syncCallHistory(unsigned long count) {
+Obex::Error Obex::syncCallHistory(unsigned long count, bool incremental) {
     LoggerD("entered");
     if(!mSession) {
         LoggerD("Session not created, you have to call createSession before calling any method");
         return OBEX_ERR_INVALID_SESSION;
     }
-    mSyncQueue.push_back(new SyncPBData("INT", "cch", count));
+    mSyncQueue.push_back(new SyncPBData("INT", "cch", count, incremental));
 
     // if the size is one, that means that there has not been
     // synchronization on-going and therefore we can initiate
     // synchronization from here, otherwise it will be initiated
     // once the current one will have finished
     if(mSyncQueue.size() == 1) {
-        SyncPBData *sync = mSyncQueue.front();
-        LoggerD("synchronizing data: " << sync->location << "/" << sync->phonebook << " count=" << count);
-        if(select(sync->location, sync->phonebook)) { // do call 'pullAll' only if 'select' operation was successful
-            if(OBEX_ERR_NONE != pullAll(sync->phonebook, sync->count)) {
-                // 'PullAll' has not started at all, ie. there will be no 'Complete'/'Error' signals
-                // on 'Transport' - no signal at all, threfore go to next sync request from sync queue
-                initiateNextSyncRequest();
-            }
-        }
+        startSyncRequest();
     }
 
     return OBEX_ERR_NONE;
 }
 
-void Obex::getJsonCallHistory(std::string& calls, unsigned long count) {
+void Obex::searchContacts(const char *query, unsigned long limit, std::string &contacts) {
+    LoggerD("entered: query=" << (query?query:"") << " limit=" << limit);
+
+    std::vector<const PBEntry*> entries;
+    if(query)
+        getContactsSnapshot()->search.search(query, limit, entries);
+    PhotoPins pins(&mPhotos);
+    materializePhotos(entries, pins);
+    makeJsonContacts(entries, contacts);
+}
+
+void Obex::predictContacts(const char *digits, unsigned long limit, std::string &contacts, gint64 *lookup) {
+    LoggerD("entered: digits=" << (digits?digits:"") << " limit=" << limit);
+
+    PBSnapshotPtr snapshot = getContactsSnapshot();
+    std::vector<const PBEntry*> entries;
+    snapshot->search.predict(digits, limit, entries, lookup);
+    PhotoPins pins(&mPhotos);
+    materializePhotos(entries, pins);
+    makeJsonContacts(entries, contacts);
+}
+
+bool Obex::getContactsExport(std::string &path, guint64 &generation) {
     LoggerD("entered");
 
-    calls = "[";
+    if(!mExporter.enable(getContactsSnapshot()))
+        return false;
+    path = mExporter.getPath();
+    generation = mExporter.getGeneration();
+    return true;
+}
+
+bool Obex::getContactPhoto(const char *key, std::string &photoURI, std::string &thumbnailURI) {
+    LoggerD("entered: key=" << (key?key:""));
 
+    photoURI.clear();
+    thumbnailURI.clear();
+    // the key is made of hex digits only, ie. it can't reference a file outside the store
+    if(!key || !key[0] || strspn(key, "0123456789abcdef") != strlen(key))
+        return false;
+    if(!mPhotos.materialize(key))
+        return false;
+    mPhotos.getUri(key, photoURI);
+    if(mPhotos.hasThumbnail(key))
+        mPhotos.getThumbnailUri(key, thumbnailURI);
+    return true;
+}
+
+void Obex::materializePhotos(const std::vector<const PBEntry*> &entries, PhotoPins &pins) {
+    for(unsigned int i = 0; i<entries.size(); ++i) {
+        if(!entries[i]->photo.empty())
+            pins.materialize(entries[i]->photo);
+    }
+}
+
+void Obex::getJsonCallHistory(std::string& calls, unsigned long count) {
+    LoggerD("entered");
+
+    PBSnapshotPtr snapshot = getCallHistorySnapshot();
     // if count == 0, ie. return all calls
-    count = (count>0 && count<mCallHistoryOrder.size())?count:mCallHistoryOrder.size();
-
-    for(unsigned int i = 0; i<count; ++i) { // get 'count' latest calls, ie. 'count' first from the list
-        EContact *item = mCallHistory[mCallHistoryOrder.at(i)];
-        if(item) { // make sure, that the item exists
-            //if(i!=0) // exclude ',' for the first entry - DON'T compare it against the index - What if first item is not found in the map?
-            if(calls.compare("[")) // exclude ',' for the first entry
-                calls += ",";
-            std::string call;
-            parseEContactToJsonTizenCallHistoryEntry(item, call);
-            calls += call;
-        }
+    if(count == 0 || count >= snapshot->entries.size()) {
+        calls = snapshot->getJson();
+        return;
     }
 
-    calls += "]";
+    std::vector<const PBEntry*> entries;
+    snapshot->getEntries(0, count, entries);
+    PBSnapshot::makeJsonArray(entries, calls);
+}
+
+void Obex::getJsonCallHistoryRange(std::string& calls, unsigned long offset, unsigned long limit) {
+    LoggerD("entered: offset=" << offset << " limit=" << limit);
+
+    std::vector<const PBEntry*> entries;
+    getCallHistorySnapshot()->getEntries(offset, limit, entries);
+    PBSnapshot::makeJsonArray(entries, calls);
 }
 
-void Obex::parseEContactToJsonTizenCallHistoryEntry(EContact *econtact, std::string &call) {
-       const char *uid = (const char*)e_contact_get_const(econtact, E_CONTACT_UID);
-       if(!econtact || !uid) {
+void Obex::parseEntryToJsonTizenCallHistoryEntry(const PBEntry &entry, std::string &call) {
+       const ContactRecord &record = entry.record;
+
+       call.clear();
+       if(entry.uid.empty()) {
            call = "{}"; // empty call history entry
            return;
        }
 
+       JsonWriter json(call, JSON_CALL_RESERVE);
+       json.beginObject();
+
        // uid:
-       call = "{";
-       call += "\"uid\":\"";
-       call += uid;
-       call += "\",";
+       json.string("uid", entry.uid.c_str());
 
        // type: not parsing - use some DEFAULT value, eg. "TEL"
-       call += "\"type\":\"TEL\",";
+       json.string("type", "TEL");
 
        // features: not parsing - use some DEFAULT value, eg. "VOICECALL"
-       call += "\"features\":[\"VOICECALL\"],";
+       json.beginArray("features");
+       json.string(NULL, "VOICECALL");
+       json.endArray();
 
        // remoteParties
-       call += "\"remoteParties\":[";
-       call += "{";
-       call += "\"personId\":\"";
-       GList *phoneNumbersList = (GList*)e_contact_get(econtact, E_CONTACT_TEL);
-       const char *personId = (phoneNumbersList && phoneNumbersList->data)?(const char*)phoneNumbersList->data:""; // phoneNumber is used as personId - first number from the list is used
-       call += personId;
-       call += "\"";
-       if(phoneNumbersList)
-           g_list_free(phoneNumbersList);
-       const char *fullName = (const char*)e_contact_get_const(econtact, E_CONTACT_FULL_NAME);
-       if(fullName && strcmp(fullName, "")) {
-           call += ",\"remoteParty\":\"";
-           call += fullName;
-           call += "\"";
-       }
-       call += "}";
-       call += "],";
+       json.beginArray("remoteParties");
+       json.beginObject();
+       const char *personId = record.numberCount() ? record.number(0) : ""; // phoneNumber is used as personId - first number from the list is used
+       json.string("personId", personId);
+       json.optionalString("remoteParty", record.get(ContactRecord::FULL_NAME));
+       json.endObject();
+       json.endArray();
 
        // startTime
-       const char *startTime = (const char*)e_contact_get_const(econtact, E_CONTACT_REV); // 'REV' holds call date/time
-       if(startTime && strcmp(startTime, "")) {
+       const char *startTime = record.get(ContactRecord::CALL_TIME); // 'REV' holds call date/time
+       if(startTime && strlen(startTime) >= 13) {
            std::string startTimeStr = startTime;
            startTimeStr.insert(13,":");
            startTimeStr.insert(11,":");
            startTimeStr.insert(6,"-");
            startTimeStr.insert(4,"-");
-           call += "\"startTime\":\"";
-           call += startTimeStr;
-           call += "\",";
+           json.string("startTime", startTimeStr.c_str());
        }
 
        // duration: not parsing - use 0 as default value
-       call += "\"duration\":\"0\",";
+       json.string("duration", "0");
 
        //  direction:
-       call += "\"direction\":\"";
-       const char *direction = (const char*)e_contact_get_const(econtact, E_CONTACT_NOTE); // 'NOTE' holds direction of the call
-       call += direction?direction:(char*)"UNDEFINED";
-       call += "\"";
+       const char *direction = record.get(ContactRecord::CALL_DIRECTION); // 'NOTE' holds direction of the call
+       json.string("direction", direction?direction:"UNDEFINED");
 
-       call += "}";
+       json.endObject();
 }
 
-void Obex::handleSignal(GDBusConnection       *connection,
-                         const gchar           *sender,
-                         const gchar           *object_path,
-                         const gchar           *interface_name,
-                         const gchar           *signal_name,
-                         GVariant              *parameters,
-                         gpointer               user_data)
-{
-    LoggerD("signal received: '" << interface_name << "' -> '" << signal_name << "' -> '" << object_path << "'");
+// runs on the ingest thread, the parameters are checked by the router
+void TransferData::propertiesChangedSignal(const gchar *objectPath, GVariant *parameters) {
+    LoggerD("PropertiesChanged on transfer: " << objectPath);
 
-    CtxCbData *data = static_cast<CtxCbData*>(user_data);
-    if(!data) {
-        LoggerE("Failed to cast object: CtxCbData");
-        return;
+    GVariantIter *iter = NULL;
+    g_variant_get(parameters, "(&sa{sv}as)", NULL, &iter, NULL);
+
+    const char *prop = NULL;
+    GVariant *var = NULL;
+    std::string status;
+    while(g_variant_iter_loop(iter, "{&sv}", &prop, &var)) {
+        if(!strcmp(prop, "Status") && g_variant_is_of_type(var, G_VARIANT_TYPE_STRING))
+            status = g_variant_get_string(var, NULL);
     }
-    Obex *ctx = static_cast<Obex*>(data->ctx);
-    if(!ctx) {
-        LoggerE("Failed to cast object: Obex");
-        return;
+    g_variant_iter_free(iter);
+
+    // "queued" and "active" statuses are not interesting
+    if(status == "complete" || status == "error") {
+        LoggerD("Status is: " << status);
+        Obex::transferFinished(this, status.c_str());
     }
+}
 
-    if(!strcmp(signal_name, "PropertiesChanged"))
-    {
-		char *objPath = NULL;
-		GVariantIter* iter, iter2;
-
-		g_variant_get(parameters, "(sa{sv}as)", &objPath, &iter, &iter2);
-
-		if(objPath)
-		{
-			GVariant* var;
-			char *prop = NULL;
-
-			while(g_variant_iter_next(iter, "{sv}", &prop, &var))
-			{
-				if(!strcmp(prop, "Status"))
-				{
-					char *status_str=0;
-					g_variant_get(var, "s", &status_str);
-					//LoggerD("Status is: " << status_str);
-
-					if(!strcmp(status_str, "complete"))
-					{
-						const char *path = static_cast<const char *>(data->data1);
-						const char *type = static_cast<const char *>(data->data2);
-						const char *origin = static_cast<const char *>(data->cb);
-						ctx->processVCards(path, type, origin);
-
-
-						if(data->data1) free(data->data1); // path - to the file containing received VCards
-						if(data->cb) free(data->cb);       // origin - MAC address of selected remote device
-					   	delete data;
-						ctx->initiateNextSyncRequest();
-					}
-				}
-			}
-		}
-		else
-		{
-			LoggerD("No objectPath found. Exiting.");
-		}
+// the cache file starts with the magic and the version, followed by the contacts and the call history, each stored as:
+// folder version: uint32 valid, uint32 size, { uint32 length, string } * 3 (database identifier, primary/secondary counter)
+// entries: uint32 count, { uint32 length, UID, ContactRecord, uint32 length, JSON } * count, see ContactRecord::write()
+// followed by the contact photos, which have not been written into the photo store yet:
+// photos: uint32 count, { uint32 length, key, uint32 length, photo } * count
+#define PB_CACHE_MAGIC                     "PHONEDPB"
+#define PB_CACHE_VERSION                   6 // the JSON of version 3 is not escaped, version 4 stores VCards instead of the records,
+                                             // the JSON of version 5 references the thumbnails
+
+static void appendUInt32(std::string &buffer, guint32 value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void appendString(std::string &buffer, const char *str, size_t length) {
+    appendUInt32(buffer, length);
+    buffer.append(str, length);
+}
+
+static bool readUInt32(const char **data, const char *end, guint32 &value) {
+    if((size_t)(end - *data) < sizeof(value))
+        return false;
+    memcpy(&value, *data, sizeof(value));
+    *data += sizeof(value);
+    return true;
+}
+
+static bool readString(const char **data, const char *end, std::string &str) {
+    guint32 length = 0;
+    if(!readUInt32(data, end, length) || (size_t)(end - *data) < length)
+        return false;
+    str.assign(*data, length);
+    *data += length;
+    return true;
+}
+
+bool Obex::makeCacheFileName(const char *bt_address, std::string &fileName) {
+    char *home = ::getenv("HOME");
+    if(!home || !bt_address)
+        return false;
+
+    std::string mac = bt_address;
+    if(!makeRawMAC(mac)) // AABBCCDDEEFF
+        return false;
+
+    fileName = home;
+    fileName += "/.phoned-" + mac + ".cache";
+    return true;
+}
+
+bool Obex::storePhonebookCache(const char *bt_address) {
+    std::string fileName;
+    if(!makeCacheFileName(bt_address, fileName)) {
+        LoggerE("Invalid cache file for device: " << (bt_address?bt_address:""));
+        return false;
     }
+
+    std::string buffer;
+    buffer.append(PB_CACHE_MAGIC, strlen(PB_CACHE_MAGIC));
+    appendUInt32(buffer, PB_CACHE_VERSION);
+
+    PBSnapshotPtr snapshots[] = { getContactsSnapshot(), getCallHistorySnapshot() };
+    PBFolderVersion *versions[] = { &mContactsVersion, &mCallHistoryVersion };
+    for(unsigned int l=0; l<sizeof(snapshots)/sizeof(snapshots[0]); l++) {
+        const PBList &entries = snapshots[l]->entries;
+        appendUInt32(buffer, versions[l]->valid ? 1 : 0);
+        appendUInt32(buffer, versions[l]->size);
+        appendString(buffer, versions[l]->databaseId.data(), versions[l]->databaseId.size());
+        appendString(buffer, versions[l]->primaryCounter.data(), versions[l]->primaryCounter.size());
+        appendString(buffer, versions[l]->secondaryCounter.data(), versions[l]->secondaryCounter.size());
+
+        appendUInt32(buffer, entries.size());
+        for(size_t i=0; i<entries.size(); i++) {
+            const PBEntryPtr &entry = entries.at(i);
+            appendString(buffer, entry->uid.data(), entry->uid.size());
+            entry->record.write(buffer);
+            appendString(buffer, entry->json.data(), entry->json.size());
+        }
+    }
+
+    // the photos are referenced by the entries, but their files are written only once requested
+    std::unordered_set<std::string> referenced;
+    collectPhotos(*snapshots[0], referenced);
+    collectPhotos(*snapshots[1], referenced);
+    std::vector<std::pair<std::string, std::string> > pending, photos;
+    mPhotos.getPending(pending);
+    for(size_t i=0; i<pending.size(); i++) {
+        if(referenced.find(pending[i].first) != referenced.end())
+            photos.push_back(pending[i]);
+    }
+    appendUInt32(buffer, photos.size());
+    for(size_t i=0; i<photos.size(); i++) {
+        appendString(buffer, photos[i].first.data(), photos[i].first.size());
+        appendString(buffer, photos[i].second.data(), photos[i].second.size());
+    }
+
+    // the file is replaced atomically, ie. a reader never gets partially written cache, and it's readable only by the user,
+    // since it contains the contacts and the calls
+    std::string tmpFileName = fileName + ".tmp";
+    int fd = g_open(tmpFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(fd < 0) {
+        LoggerE("Failed to store phonebook cache " << tmpFileName << ": " << strerror(errno));
+        return false;
+    }
+    fchmod(fd, 0600); // the file may have been left by previous run with other permissions
+    const char *data = buffer.data();
+    size_t written = 0;
+    while(written < buffer.size()) {
+        ssize_t ret = write(fd, data + written, buffer.size() - written);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0)
+            break;
+        written += ret;
+    }
+    bool stored = written == buffer.size() && fsync(fd) == 0;
+    if(close(fd) != 0)
+        stored = false;
+    if(!stored || g_rename(tmpFileName.c_str(), fileName.c_str()) != 0) {
+        LoggerE("Failed to store phonebook cache " << fileName << ": " << strerror(errno));
+        g_unlink(tmpFileName.c_str());
+        return false;
+    }
+
+    LoggerD("Stored " << snapshots[0]->entries.size() << " contacts and " << snapshots[1]->entries.size() << " calls into " << fileName);
+    return true;
 }
 
-void Obex::processVCards(const char *filePath, const char *type, const char *origin) {
+bool Obex::loadPhonebookCache(const char *bt_address) {
+    std::string fileName;
+    if(!makeCacheFileName(bt_address, fileName)) {
+        LoggerE("Invalid cache file for device: " << (bt_address?bt_address:""));
+        return false;
+    }
+
+    GMappedFile *file = g_mapped_file_new(fileName.c_str(), FALSE, NULL);
+    if(!file) {
+        LoggerD("No phonebook cache for device: " << bt_address);
+        return false;
+    }
+    const char *data = g_mapped_file_get_contents(file);
+    const char *end = data + (data ? g_mapped_file_get_length(file) : 0);
+
+    // the cache replaces currently synchronized entries, new snapshots are published once loaded
+    PBSnapshot *snapshots[] = { new PBSnapshot(), new PBSnapshot() };
+    PBFolderVersion versions[2];
+
+    guint32 version = 0;
+    bool valid = data && (size_t)(end - data) >= strlen(PB_CACHE_MAGIC) && !memcmp(data, PB_CACHE_MAGIC, strlen(PB_CACHE_MAGIC));
+    if(valid) {
+        data += strlen(PB_CACHE_MAGIC);
+        valid = readUInt32(&data, end, version) && version == PB_CACHE_VERSION;
+    }
+
+    for(unsigned int l=0; valid && l<sizeof(snapshots)/sizeof(snapshots[0]); l++) {
+        guint32 versionValid = 0, size = 0;
+        valid = readUInt32(&data, end, versionValid) && readUInt32(&data, end, size) &&
+                readString(&data, end, versions[l].databaseId) &&
+                readString(&data, end, versions[l].primaryCounter) &&
+                readString(&data, end, versions[l].secondaryCounter);
+        versions[l].valid = valid && versionValid;
+        versions[l].size = size;
+
+        guint32 count = 0;
+        valid = valid && readUInt32(&data, end, count);
+        for(guint32 i=0; valid && i<count; i++) {
+            PBEntry *entry = new PBEntry();
+            valid = readString(&data, end, entry->uid) && entry->record.read(&data, end) && readString(&data, end, entry->json);
+            if(!valid || entry->uid.empty()) {
+                delete entry;
+                continue;
+            }
+            const char *uri = entry->record.get(ContactRecord::PHOTO_URI);
+            if(uri)
+                mPhotos.getKey(uri, entry->photo);
+            PBEntryPtr shared(entry);
+            if(!snapshots[l]->entries.pushBack(shared))
+                continue;
+            if(l == 0) // contacts
+                snapshots[l]->indexContact(*entry);
+        }
+        snapshots[l]->prepare();
+    }
+
+    guint32 count = 0;
+    valid = valid && readUInt32(&data, end, count);
+    std::string key, photo;
+    for(guint32 i=0; valid && i<count; i++) {
+        valid = readString(&data, end, key) && readString(&data, end, photo);
+        if(valid)
+            mPhotos.addPending(key, photo);
+    }
+
+    g_mapped_file_unref(file);
+
+    if(!valid) {
+        LoggerE("Invalid phonebook cache: " << fileName);
+        delete snapshots[0];
+        delete snapshots[1];
+        snapshots[0] = new PBSnapshot();
+        snapshots[1] = new PBSnapshot();
+        versions[0].clear();
+        versions[1].clear();
+    }
+    else {
+        LoggerD("Loaded " << snapshots[0]->entries.size() << " contacts and " << snapshots[1]->entries.size() << " calls from " << fileName);
+    }
+
+    publishSnapshot("pb", PBSnapshotPtr(snapshots[0]));
+    mContactsVersion = versions[0];
+    publishSnapshot("cch", PBSnapshotPtr(snapshots[1]));
+    mCallHistoryVersion = versions[1];
+    contactsChanged();
+    callHistoryChanged();
+
+    return valid;
+}
+
+bool Obex::processVCards(TransferData *transfer) {
     LoggerD("entered");
 
-    if(!filePath || !type || !origin) {
-        LoggerE("Invalid argument(s)");
+    const char *filePath = transfer->fileName.c_str();
+    const char *type = transfer->type.c_str();
+    if(strcmp(type, "pb") && strcmp(type, "cch")) {
+        LoggerE("Unknown type of VCards: " << type);
+        return false;
+    }
+
+    IngestData *ingest = new IngestData(this, transfer->id, type, transfer->origin.c_str(), transfer->merge);
+    ingest->overlap = transfer->overlap;
+    ingest->limit = transfer->limit;
+    GError *err = NULL;
+    ingest->file = g_mapped_file_new(filePath, FALSE, &err);
+    if(!ingest->file) {
+        LoggerE("Unable to read VCards from " << filePath << ": " << (err?err->message:"unknown error"));
+        if(err)
+            g_error_free(err);
+        delete ingest;
+        return false;
+    }
+    const char *data = g_mapped_file_get_contents(ingest->file); // NULL for empty file
+    size_t length = data ? g_mapped_file_get_length(ingest->file) : 0;
+
+    // split the VCards into chunks at VCard boundaries, so that each worker thread gets a few chunks to parse
+    size_t chunks = length / VCARD_CHUNK_MIN_SIZE;
+    size_t maxChunks = 2 * g_thread_pool_get_max_threads(mParserPool);
+    if(chunks > maxChunks)
+        chunks = maxChunks;
+    if(chunks < 1)
+        chunks = 1;
+    size_t begin = 0;
+    for(size_t i=1; i<=chunks && begin<length; i++) {
+        size_t end = length;
+        if(i != chunks) {
+            // the search has to start at the beginning of a line, ie. after the line the split falls in
+            size_t split = begin + length / chunks;
+            const char *eol = split < length ? static_cast<const char*>(memchr(data + split, '\n', length - split)) : NULL;
+            if(eol)
+                end = VCardReader::findVCard(data, length, (eol - data) + 1);
+        }
+        ingest->chunks.push_back(new VCardChunk(ingest, data + begin, end - begin));
+        begin = end;
+    }
+    if(ingest->chunks.empty()) // empty file
+        ingest->chunks.push_back(new VCardChunk(ingest, NULL, 0));
+
+    LoggerD("Parsing " << length << " bytes of VCards in " << ingest->chunks.size() << " chunk(s)");
+
+    ingest->pending = ingest->chunks.size();
+    for(unsigned int i=0; i<ingest->chunks.size(); i++)
+        g_thread_pool_push(mParserPool, ingest->chunks[i], NULL);
+
+    return true;
+}
+
+PBEntry *Obex::parseVCard(const std::string &vcard, bool contact, PhotoStore *photos) {
+    EContact *item = e_contact_new_from_vcard(vcard.c_str());
+    if(!item) {
+        LoggerD("Failed to create EContact from vcard");
+        return NULL;
+    }
+
+    // won't use E_CONTACT_UID as a key to the map, since it is not returned by all phone devices
+    if(!makeUid(item)) {
+        // failed to create UID from EContact
+        // won't add the entry to the list - UID used as a key to the map
+        g_object_unref(item);
+        return NULL;
+    }
+    const char *uid = (const char*)e_contact_get_const(item, E_CONTACT_UID);
+
+    // check if item has photo and it's INLINED type
+    // if so, change it to URI type, since the data are in binary form
+    // and as such can't be processed in JSON directly
+    // to avoid yet another conversion to eg. BASE64 format, the photo
+    // is put into the photo store and the URI references the photo instead
+    // the file of the photo is written only once the contact is requested
+    std::string photoKey;
+    EContactPhoto *photo = (EContactPhoto*)e_contact_get(item, E_CONTACT_PHOTO);
+    if(photo) {
+        if(E_CONTACT_PHOTO_TYPE_INLINED == photo->type) {
+            gsize length = 0;
+            const guchar *data = e_contact_photo_get_inlined (photo, &length);
+            if(photos->add(data, length, photoKey)) {
+                // change photo attribute from INLINED to URI
+                e_contact_photo_free(photo);
+                photo = e_contact_photo_new();
+                if(photo) {
+                    photo->type = E_CONTACT_PHOTO_TYPE_URI;
+                    std::string uri;
+                    photos->getUri(photoKey, uri);
+                    e_contact_photo_set_uri(photo, uri.c_str());
+                    e_contact_set(item, E_CONTACT_PHOTO, photo);
+                }
+            }
+        }
+        e_contact_photo_free(photo);
+    }
+
+    // the fields are copied into the record of the entry, the EContact is not kept
+    PBEntry *entry = new PBEntry();
+    entry->uid = uid;
+    entry->photo = photoKey;
+    entry->record.assign(item);
+    g_object_unref(item);
+    // serialize the entry once, JSON is served from the cache on each request
+    if(contact)
+        parseEntryToJsonTizenContact(*entry, entry->json);
+    else
+        parseEntryToJsonTizenCallHistoryEntry(*entry, entry->json);
+
+    return entry;
+}
+
+// runs on a worker thread of the parser pool
+void Obex::parseVCardChunk(gpointer data, gpointer user_data) {
+    VCardChunk *chunk = static_cast<VCardChunk*>(data);
+    if(!chunk)
         return;
+    IngestData *ingest = chunk->ingest;
+
+    // don't parse the VCards, if the processing has been cancelled, ie. the transfer is not active anymore
+    if((guint)g_atomic_int_get(&ingest->ctx->mActiveTransferId) == ingest->transfer) {
+        bool contact = ingest->type == "pb";
+        VCardReader reader;
+        reader.open(chunk->data, chunk->length);
+        std::string vcard;
+        while(reader.next(vcard)) {
+            PBEntry *entry = parseVCard(vcard, contact, &ingest->ctx->mPhotos);
+            if(entry)
+                chunk->entries.push_back(PBEntryPtr(entry));
+        }
+    }
+
+    // the last parsed chunk builds new snapshot off the main loop, which publishes it
+    if(g_atomic_int_dec_and_test(&ingest->pending)) {
+        Obex *ctx = ingest->ctx;
+        if((guint)g_atomic_int_get(&ctx->mActiveTransferId) == ingest->transfer) {
+            ingest->base = (ingest->type == "pb") ? ctx->getContactsSnapshot() : ctx->getCallHistorySnapshot();
+            ingest->snapshot.reset(mergeEntries(*ingest->base, ingest, ingest->added));
+        }
+        g_idle_add(Obex::ingestDoneCb, ingest);
     }
+}
+
+gboolean Obex::ingestDoneCb(gpointer user_data) {
+    IngestData *ingest = static_cast<IngestData*>(user_data);
+    if(!ingest)
+        return G_SOURCE_REMOVE;
+
+    // the context is destroyed only after the main loop has quit, when this callback is not dispatched anymore
+    Obex *ctx = ingest->ctx;
+    if(!ctx->mActiveTransfer || ingest->transfer != (guint)g_atomic_int_get(&ctx->mActiveTransferId)) {
+        // the sync queue has been cleared meanwhile
+        delete ingest;
+        return G_SOURCE_REMOVE;
+    }
+
+    ctx->clearActiveTransfer();
 
-    if(strcmp(origin, mSelectedRemoteDevice.c_str())) {
+    const char *type = ingest->type.c_str();
+    if(strcmp(ingest->origin.c_str(), ctx->mSelectedRemoteDevice.c_str())) {
         LoggerD("Received VCards don't belong to currently selected device - IGNORING");
-        return;
     }
+    else {
+        PBSnapshotPtr current = !strcmp(type, "pb") ? ctx->getContactsSnapshot() : ctx->getCallHistorySnapshot();
+        if(!ingest->snapshot || ingest->base != current) {
+            // other snapshot has been published meanwhile, eg. loaded from the cache
+            ingest->added.clear();
+            ingest->snapshot.reset(mergeEntries(*current, ingest, ingest->added));
+        }
+        if(ingest->tailChanged) {
+            // the overlapping entries have moved, the folder can't be merged, pull it whole
+            LoggerD("Synchronized entries of " << type << " have changed - pulling all entries");
+            SyncPBData *sync = ctx->mSyncQueue.front();
+            sync->count = 0;
+            sync->offset = 0;
+            sync->overlap = 0;
+            sync->limit = 0;
+            sync->merge = MERGE_REPLACE;
+            delete ingest;
+            ctx->pullSyncRequest(sync);
+            return G_SOURCE_REMOVE;
+        }
+        ctx->publishSnapshot(type, ingest->snapshot);
 
-    std::map<std::string, EContact*> *items = NULL;
-    std::vector<std::string> *order = NULL;
-    if(!strcmp(type, "pb")) { // Contacts
-        items = &mContacts;
-        order = &mContactsOrder;
+        for(unsigned int i=0; i<ingest->added.size(); i++) {
+            std::string json = ingest->added[i]->json;
+            ctx->callHistoryEntryAdded(json);
+        }
+
+        // notify listener about Contacts/CallHistory being changed/synchronized
+        if(!strcmp(type, "pb")) // Contacts
+            ctx->contactsChanged();
+        else // CallHistory
+            ctx->callHistoryChanged();
     }
-    else if(!strcmp(type, "cch")) { // CallHistory
-        items = &mCallHistory;
-        order = &mCallHistoryOrder;
+    delete ingest;
+
+    // the entries are synchronized with the version of the folder read before the pull
+    if(!ctx->mSyncQueue.empty()) {
+        SyncPBData *sync = ctx->mSyncQueue.front();
+        if(sync->version.valid) {
+            if(!strcmp(sync->phonebook, "pb"))
+                ctx->mContactsVersion = sync->version;
+            else
+                ctx->mCallHistoryVersion = sync->version;
+        }
     }
-    // if the size of items map is 0, ie. that the received
-    // VCards are from first sync request and they should
-    // be added to the map (uid order vector) in the order they
-    // are processed (push_back), otherwise they should be
-    // inserted at the front (push_front)
-    bool firstData = items->size() == 0 ? true : false;
-
-    // process VCards one-by-one
-    std::ifstream file(filePath);
-    std::string vcard;
-    for(std::string line; getline(file, line);)
-    {
-        //std::replace( line.begin(), line.end(), '\r', '\n'); // removes carriage return
-        line.replace(line.find("\r"), 1, "\n");
 
-        if(line.find("BEGIN:VCARD") == 0) {
-            vcard = line; // start collecting new VCard
+    ctx->initiateNextSyncRequest();
+
+    return G_SOURCE_REMOVE;
+}
+
+PBSnapshot *Obex::mergeEntries(const PBSnapshot &base, IngestData *ingest, std::vector<PBEntryPtr> &added) {
+    bool contacts = ingest->type == "pb";
+    Obex::Merge merge = ingest->merge;
+
+    // the first pulled entries have to be the last synchronized ones, in the same order,
+    // otherwise the entries have moved and the new ones can't be just appended
+    ingest->tailChanged = false;
+    if(merge == MERGE_APPEND && ingest->overlap) {
+        size_t overlap = ingest->overlap;
+        bool matches = base.entries.size() >= overlap;
+        size_t first = matches ? base.entries.size() - overlap : 0;
+        size_t checked = 0;
+        for(unsigned int c=0; matches && checked < overlap && c<ingest->chunks.size(); c++) {
+            const std::vector<PBEntryPtr> &entries = ingest->chunks[c]->entries;
+            for(unsigned int i=0; matches && checked < overlap && i<entries.size(); i++, checked++)
+                matches = entries[i]->uid == base.entries.at(first + checked)->uid;
+        }
+        if(!matches || checked != overlap) {
+            ingest->tailChanged = true;
+            return NULL;
         }
-        else if(line.find("END:VCARD") == 0) {
-            vcard += line;
+    }
 
-            // start processing VCard
-            //printf("%s\n", vcard.c_str());
+    // when all entries are pulled, they replace the current ones,
+    // otherwise they are merged into a copy of the current ones
+    PBSnapshot *snapshot = new PBSnapshot();
+    if(merge != MERGE_REPLACE) {
+        snapshot->entries = base.entries; // the entries are shared
+        snapshot->numbers = base.numbers;
+        snapshot->search = base.search;
+    }
+    PBList &items = snapshot->entries;
 
-            EContact *item = e_contact_new_from_vcard(vcard.c_str());
-            if(!item) {
-                LoggerD("Failed to create EContact from vcard");
-                continue;
+    // if the size of items list is 0, ie. that the received
+    // VCards are from first sync request and they should
+    // be added to the list in the order they are processed
+    // (push_back), otherwise they are the latest entries and
+    // they should be inserted at the front, in the order they
+    // are processed, ie. the latest entry first, unless they
+    // are new entries at the end of the folder (MERGE_APPEND)
+    bool atFront = items.size() != 0 && merge != MERGE_APPEND;
+    size_t inserted = 0;
+
+    for(unsigned int c=0; c<ingest->chunks.size(); c++) {
+        const std::vector<PBEntryPtr> &entries = ingest->chunks[c]->entries;
+        for(unsigned int i=0; i<entries.size(); i++) {
+            const PBEntryPtr &entry = entries[i];
+
+            // skip the entry, if an item with the given UID exists in the list
+            if(atFront) {
+                if(!items.insert(inserted, entry)) // insert at the front, behind already inserted entries
+                    continue;
+                inserted++;
             }
-
-            // won't use E_CONTACT_UID as a key to the map, since it is not returned by all phone devices
-            if(!makeUid(item)) {
-                // failed to create UID from EContact
-                // won't add the entry to the list - UID used as a key to the map
+            else if(!items.pushBack(entry)) {
                 continue;
             }
-            const char *uid = (const char*)e_contact_get_const(item, E_CONTACT_UID);
-
-            // check if item has photo and it's INLINED type
-            // if so, change it to URI type, since the data are in binary form
-            // and as such can't be processed in JSON directly
-            // to avoid yet another conversion to eg. BASE64 format, save the
-            // contact photo in /tmp and use the URI to reference the photo instead
-            EContactPhoto *photo = (EContactPhoto*)e_contact_get(item, E_CONTACT_PHOTO);
-            if(photo) {
-                if(E_CONTACT_PHOTO_TYPE_INLINED == photo->type) {
-                    gsize length = 0;
-                    const guchar *data = e_contact_photo_get_inlined (photo, &length);
-                    //uid is used as a file name
-                    char fileName[128];
-                    snprintf(fileName, sizeof(fileName), "/tmp/%s.jif", uid);
-                    FILE *fd = fopen(fileName,"wb");
-                    if(!fd) {
-                        LoggerD("Unable to store contact photo: " << fileName);
-                    }
-                    else {
-                        LoggerD("Saving contact photo: " << fileName);
-                        size_t written = fwrite(data, sizeof(guchar), length, fd);
-                        fclose(fd);
-                        if(written == length) {
-                            // contact photo has been successfully saved
-                            // change photo attribute from INLINED to URI
-                            e_contact_photo_free(photo);
-                            photo = NULL;
-                            photo = e_contact_photo_new();
-                            if(photo) {
-                                photo->type = E_CONTACT_PHOTO_TYPE_URI;
-                                //e_contact_photo_set_mime_type(photo, "");
-                                char uri[128];
-                                snprintf(uri, sizeof(uri), "file://%s", fileName);
-                                e_contact_photo_set_uri(photo, uri);
-                                e_contact_set(item, E_CONTACT_PHOTO, photo);
-                            }
-                        }
-                    }
-                }
-                e_contact_photo_free(photo);
-            }
 
-            // check if an item with the given UID exists in the list
-            if((*items)[uid] == NULL) {
-                //LoggerD("NEW ITEM: " << uid);
-                (*items)[uid] = item;
-                if(firstData)
-                    order->push_back(uid);
-                else
-                    order->insert(order->begin(), uid); // push at the front
-                if(!strcmp(type, "cch")) { // notify only for CallHistory
-                    std::string entry;
-                    parseEContactToJsonTizenCallHistoryEntry(item, entry);
-                    callHistoryEntryAdded(entry);
-                }
+            if(contacts) { // index all phone numbers of the contact for caller look-up
+                snapshot->indexContact(*entry);
             }
-            else {
-                // the item already exists in the list, unref the item,
-                // since we loose any reference to it
-                g_object_unref(item);
+            else if(!base.entries.find(entry->uid)) { // notify only for CallHistory, and only new calls
+                added.push_back(entry);
             }
         }
-        else {
-            // the current implementation of EContact doesn't support
-            // X-IRMC-CALL-DATETIME field, so as a workaround we use
-            // two separate fields instead: E_CONTACT_NOTE
-            //                              E_CONTACT_REV
-            if((line.find("NOTE") == 0) || (line.find("REV") == 0)) {
-                // exclude NOTE and REV as we are using it to store
-                // X-IRMC-CALL-DATETIME attribute
-                // exclude = do not copy it to vcard
-            }
-            else if(line.find("UID") == 0) {
-                // exclude UID as we are creating own UID
-                // exclude = do not copy it to vcard
-            }
-            else if(line.find("X-IRMC-CALL-DATETIME") == 0) {
-                size_t index1 = line.find( "TYPE=" ) + 5;
-                size_t index2 = line.find( ":", index1 ) + 1;
+    }
+    // the calls, which the device has dropped from the call history, are dropped too
+    if(merge == MERGE_PREPEND && ingest->limit && !contacts)
+        items.truncate(ingest->limit);
+    snapshot->prepare();
 
-                std::string note = line.substr (index1, index2-index1-1);
-                std::string rev = line.substr (index2, line.length()-index2);
+    return snapshot;
+}
 
-                vcard += "NOTE:" + note + "\n";
-                vcard += "REV:" + rev; // '\n' is taken from 'line'
-            }
-            else {
-                vcard += line;
-            }
-        }
+void Obex::publishSnapshot(const char *type, const PBSnapshotPtr &snapshot) {
+    // readers holding the previous snapshot keep using it, until they release it
+    if(!strcmp(type, "pb")) {
+        std::atomic_store(&mContacts, snapshot);
+        mExporter.publish(snapshot);
     }
+    else
+        std::atomic_store(&mCallHistory, snapshot);
 
-    // notify listener about Contacts/CallHistory being changed/synchronized
-    if(type) {
-        if(!strcmp(type, "pb")) // Contacts
-            contactsChanged();
-        else if(!strcmp(type, "cch")) // CallHistory
-            callHistoryChanged();
+    // drop the pending photos, which are not referenced anymore
+    std::unordered_set<std::string> photos;
+    collectPhotos(*getContactsSnapshot(), photos);
+    collectPhotos(*getCallHistorySnapshot(), photos);
+    mPhotos.prune(photos);
+}
+
+void Obex::collectPhotos(const PBSnapshot &snapshot, std::unordered_set<std::string> &photos) {
+    for(size_t i=0; i<snapshot.entries.size(); i++) {
+        const std::string &photo = snapshot.entries.at(i)->photo;
+        if(!photo.empty())
+            photos.insert(photo);
     }
 }
 
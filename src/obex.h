@@ -8,6 +8,11 @@
 #include <map>
 #include <vector>
 #include <deque>
+#include <unordered_set>
+
+#include "pbsnapshot.h"
+#include "photostore.h"
+#include "pbexporter.h"
 
 namespace PhoneD {
 
@@ -17,6 +22,44 @@ namespace PhoneD {
  */
 
 class SyncPBData;
+class IngestData;
+class TransferData;
+
+/*! \class PhoneD::PBFolderVersion
+ * A Class to store the version of phonebook folder, as reported by the remote device. It is used to find out, whether the folder has changed since it was synchronized.
+ */
+class PBFolderVersion {
+    public:
+        /**
+         * A default constructor. Constructs invalid (unknown) version.
+         */
+        PBFolderVersion() : size(0), valid(false) {}
+
+        /**
+         * Resets the version to invalid (unknown) one.
+         */
+        void clear() { databaseId.clear(); primaryCounter.clear(); secondaryCounter.clear(); size = 0; valid = false; }
+
+        /**
+         * Returns whether the device reports version counters of the folder (PBAP 1.2).
+         * @return \b True, if the counters are reported.
+         */
+        bool hasCounters() const { return !primaryCounter.empty() || !secondaryCounter.empty(); }
+
+        /**
+         * Gets the number of changes of the entries in the folder since given version, ie. by how much the primary counter has advanced.
+         * @param[in] since The earlier version of the folder.
+         * @param[out] changes The number of changes.
+         * @return \b False, if the counters are not reported, or the counter has not advanced, eg. it has been reset.
+         */
+        bool getChanges(const PBFolderVersion &since, guint64 &changes) const;
+    public:
+        std::string databaseId;       /*!< Identifier of the phonebook database, it changes, when the handles of the entries are no longer valid. */
+        std::string primaryCounter;   /*!< Counter, which changes on any change of the entries in the folder. */
+        std::string secondaryCounter; /*!< Counter, which changes on change of the names/phone numbers of the entries in the folder. */
+        unsigned long size;           /*!< Number of the entries in the folder. */
+        bool valid;                   /*!< Whether the version is known. */
+};
 
 /*! \class PhoneD::Obex
  *  \brief Class which is utilizing Obex D-Bus service. It is a base class and is not meant to be instantiated directly.
@@ -34,6 +77,13 @@ class Obex {
             OBEX_ERR_INVALID_ARGUMENTS    /*!< Invalid arguments specified. */
         };
 
+        /*! Modes of merging pulled entries into synchronized ones. */
+        enum Merge {
+            MERGE_REPLACE = 0,            /*!< Pulled entries replace all synchronized ones (full synchronization). */
+            MERGE_PREPEND,                /*!< New pulled entries are inserted at the front, eg. the latest calls. */
+            MERGE_APPEND                  /*!< New pulled entries are appended at the end, eg. new contacts. */
+        };
+
     public:
         /**
          * A default constructor. Constructs and initializes an object.
@@ -63,18 +113,20 @@ class Obex {
         /**
          * Synchronizes phones PhoneBook contacts. Pulls the contacts from remote device that the Obex session is created to. The pull is done on \b "INT" internal phone's contacts list.
          * @param[in] count Specifies the number of latest contacts to be pulled from the phone. \b 0 means to pull all contacts.
+         * @param[in] incremental Specifies whether the size and the version of the contacts list is read first, to pull only new contacts, or nothing, if the list has not changed. The \b count is ignored in this case.
          * @see createSession()
          * @return The status of the operation, ie. whether pull-ing the contacts has successfuly started.
          */
-        Obex::Error syncContacts(unsigned long count = 0);
+        Obex::Error syncContacts(unsigned long count = 0, bool incremental = false);
 
         /**
          * Synchronizes phone's call history . Pulls the call history entries from remote device that the Obex session is created to. The pull is done on \b "INT" internal phone's call history. It retrieves \b "cch", ie. any kind of call (DIALED,MISSED,....).
          * @param[in] count Specifies the number of latest calls from the call history to be pulled from the phone. \b 0 means to pull all call entries.
+         * @param[in] incremental Specifies whether the size and the version of the call history is read first, to pull only the latest calls, or nothing, if the call history has not changed. The \b count is ignored in this case.
          * @see createSession()
          * @return The status of the operation, ie. whether pull-ing the call entries has successfuly started.
          */
-        Obex::Error syncCallHistory(unsigned long count = 0);
+        Obex::Error syncCallHistory(unsigned long count = 0, bool incremental = false);
 
         /**
          * Method to get synchronized contacts in JSON format as an array of \b tizen.Contacts. Returns empty array \b "[]", if the contacts are not yet synchronized , or if there are no contacts.
@@ -91,12 +143,108 @@ class Obex {
         void getJsonCallHistory(std::string& calls, unsigned long count);
 
         /**
-         * Returns contact in \b tizen.Contact JSON format, which matches given phone number. It returns an empty JSON object "{}" if the contact is not found.
+         * Method to get a page of synchronized contacts in JSON format as an array of \b tizen.Contacts. Returns empty array \b "[]", if there are no contacts in the requested range.
+         * @param[out] contacts A container for the contacts. The contacts are in \b tizen.Contact format.
+         * @param[in] offset Index of the first contact to be returned.
+         * @param[in] limit Maximum number of contacts to be returned. \b 0 means to return all contacts from the \b offset.
+         * @param[in] sortKey Specifies the order of contacts: \b "firstName", \b "lastName", \b "displayName", or \b "" for the order of synchronization.
+         * @return \b OBEX_ERR_INVALID_ARGUMENTS if the sort key is not valid, otherwise \b OBEX_ERR_NONE.
+         */
+        Obex::Error getJsonContactsRange(std::string& contacts, unsigned long offset, unsigned long limit, const char *sortKey);
+
+        /**
+         * Method to get a page of synchronized contacts as typed GVariant, which is sent over D-Bus as is, instead of \b tizen.Contact JSON. Each contact is a dictionary \b a{sv} with keys:
+         * \b "uid" (s), \b "personId" (s), \b "firstName" (s), \b "lastName" (s), \b "displayName" (s), \b "photoURI" (s), \b "thumbnailURI" (s), \b "phoneNumbers" (as), \b "emails" (as) and \b "addresses" (aa{ss}, with keys
+         * \b "country", \b "region", \b "city", \b "streetAddress", \b "postalCode" and \b "type"). The keys, which the contact doesn't have a value for, are omitted.
+         * @param[out] contacts A container for floating \b aa{sv} array of the contacts. It's set only if the call succeeds.
+         * @param[in] offset Index of the first contact to be returned.
+         * @param[in] limit Maximum number of contacts to be returned. \b 0 means to return all contacts from the \b offset.
+         * @param[in] sortKey Specifies the order of contacts: \b "firstName", \b "lastName", \b "displayName", or \b "" for the order of synchronization.
+         * @return \b OBEX_ERR_INVALID_ARGUMENTS if the sort key is not valid, otherwise \b OBEX_ERR_NONE.
+         */
+        Obex::Error getContactsVariant(GVariant **contacts, unsigned long offset, unsigned long limit, const char *sortKey);
+
+        /**
+         * Method to get a page of synchronized call history entries in JSON format as an array of \b tizen.CallHisoryEntry-ies, the latest calls first. Returns empty array \b "[]", if there are no calls in the requested range.
+         * @param[out] calls A container for the call history entries. The call history entries are in \b tizen.CallHistoryEntry format.
+         * @param[in] offset Index of the first call history entry to be returned.
+         * @param[in] limit Maximum number of call history entries to be returned. \b 0 means to return all calls from the \b offset.
+         */
+        void getJsonCallHistoryRange(std::string& calls, unsigned long offset, unsigned long limit);
+
+        /**
+         * Method to search synchronized contacts by the name, or the phone number, eg. for type-ahead in the dialer. Each word of the query matches a prefix of a word of the contact's name, regardless of the case and diacritics. The query made of digits matches also the phone numbers, anywhere in the number, and the names typed on the dial pad. See ContactSearchIndex for details.
+         * @param[in] query The query, eg. \b "jo sm", or \b "0905".
+         * @param[in] limit Maximum number of contacts to be returned. \b 0 means to return all matching contacts.
+         * @param[out] contacts A container for the matching contacts in \b tizen.Contact JSON format, in the order of synchronization.
+         */
+        void searchContacts(const char *query, unsigned long limit, std::string &contacts);
+
+        /**
+         * Method to predict synchronized contacts for the digits typed on the dial pad. The digits match the names mapped to the digits by T9 letter groups and the phone numbers, from the beginning of the word, or of the number, optionally without its prefix. See DialPadTrie for details.
+         * @param[in] digits The digits, eg. \b "5264".
+         * @param[in] limit Maximum number of contacts to be returned. \b 0 means to return all matching contacts.
+         * @param[out] contacts A container for the matching contacts in \b tizen.Contact JSON format, the best match first: the first names, then other words of the names, then the phone numbers.
+         * @param[out] lookup A container for the duration of the look-up of the contacts (in microseconds), without writing their photos and the serialization, or \b NULL.
+         */
+        void predictContacts(const char *digits, unsigned long limit, std::string &contacts, gint64 *lookup = NULL);
+
+        /**
+         * Method to get the file, which the contacts are exported into, see PBExporter. The export is enabled by the first call, the contacts are then exported each time they change.
+         * @param[out] path A container for the path of the file. The layout of the file is described in pbexport.h.
+         * @param[out] generation A container for the number of the latest exported snapshot of the contacts.
+         * @return \b False, if the contacts can't be exported.
+         */
+        bool getContactsExport(std::string &path, guint64 &generation);
+
+        /**
+         * Method to get the photo of the exported contact, see PhonedPBContact::photo. The photo is written into its file, if it has not been written yet.
+         * @param[in] key The key of the photo.
+         * @param[out] photoURI A container for the URI of the photo.
+         * @param[out] thumbnailURI A container for the URI of the thumbnail of the photo, it's empty, if the thumbnail has not been made yet.
+         * @return \b False, if there isn't such photo.
+         */
+        bool getContactPhoto(const char *key, std::string &photoURI, std::string &thumbnailURI);
+
+        /**
+         * Returns contact in \b tizen.Contact JSON format, which matches given phone number. Any of contact's phone numbers is matched, regardless of its formatting, or national/international prefix. It returns an empty JSON object "{}" if the contact is not found.
          * @param[in] phoneNumber A phone number for which the contact should be returned.
          * @param[out] contact A container for the contact that match the phone number. The contact is in \b tizen.Contact JSON format.
          */
         void getContactByPhoneNumber(const char *phoneNumber, std::string &contact);
 
+        /**
+         * Loads contacts and call history of the device from the persistent cache, see storePhonebookCache(). The loaded entries replace currently synchronized ones and they are replaced by the entries of next full synchronization.
+         * @param[in] bt_address A MAC address of the device, which the cache belongs to.
+         * @return \b True, if the cache has been loaded.
+         */
+        bool loadPhonebookCache(const char *bt_address);
+
+        /**
+         * Stores synchronized contacts and call history into the persistent cache of the device, ie. into \b $HOME/.phoned-AABBCCDDEEFF.cache file. Both, the entries and their JSON representation, are stored.
+         * @param[in] bt_address A MAC address of the device, which the entries are synchronized from.
+         * @return \b True, if the cache has been stored.
+         */
+        bool storePhonebookCache(const char *bt_address);
+
+        /**
+         * Checks whether the synchronization of contacts, or call history is in progress, ie. there are queued synchronization requests.
+         * @return \b True, if the synchronization is in progress.
+         */
+        bool isSynchronizing() const { return !mSyncQueue.empty(); }
+
+        /**
+         * Gets the current snapshot of synchronized contacts. The snapshot is not modified by the synchronization, which publishes a new one instead, and it can be read from any thread.
+         * @return The snapshot, it's never \b NULL.
+         */
+        PBSnapshotPtr getContactsSnapshot() const { return std::atomic_load(&mContacts); }
+
+        /**
+         * Gets the current snapshot of synchronized call history, see getContactsSnapshot().
+         * @return The snapshot, it's never \b NULL.
+         */
+        PBSnapshotPtr getCallHistorySnapshot() const { return std::atomic_load(&mCallHistory); }
+
     protected:
         /**
          * Sets selected remote device, which is used when processing received VCards to make sure that they belong to the device selected remote device.
@@ -118,35 +266,88 @@ class Obex {
         // the method, which will be called when active Transfer is stalled
         virtual void transferStalled() = 0;
         // method to clear the sync queue, eg. when the transfer is stalled
+        // pending asynchronous steps of the synchronization are cancelled
         void clearSyncQueue();
+        // stops watching the active transfer
+        void clearActiveTransfer();
 
-        // Select phonebook object for other operations
-        bool select(const char *location, const char *phonebook);
+        // starts the sync request at the top of the queue: Select -> PullAll -> Transfer status
+        // all steps are asynchronous, so that the main loop is not blocked by the synchronization
+        void startSyncRequest();
+        static void asyncSelectReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data);
 
         // type: type of pull request - "pb" for Contacts, "cch" for CallHistory
-        Obex::Error pullAll(const char *type, unsigned long count); // retrieves 'count' selected (select()) entries from
-                                                                    // the phonebook (0=ALL)
+        Obex::Error pullAll(const char *type, unsigned long count, unsigned long offset = 0); // retrieves 'count' selected (Select) entries from
+                                                                                              // the phonebook (0=ALL), starting at 'offset'
+        // pulls the entries of the sync request, or goes to the next one, if the pull fails
+        void pullSyncRequest(SyncPBData *sync);
+        static void asyncGetSizeReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data);
+        static void asyncGetVersionReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data);
+        // compares the version of the folder read from the device with the synchronized one and sets the
+        // range of entries to be pulled; returns false, if the folder has not changed, ie. nothing is pulled
+        bool planIncrementalSync(SyncPBData *sync);
+        static void asyncPullAllReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data);
+        // the active transfer is watched and its VCards are processed on the ingest thread, which runs its own main loop
+        static gpointer ingestThread(gpointer data);
+        static gboolean quitIngestLoopCb(gpointer user_data);
+        // subscribe for/unsubscribe from the status of the transfer, they run on the ingest thread
+        static gboolean watchTransferCb(gpointer user_data);
+        static gboolean unwatchTransferCb(gpointer user_data);
+        static void asyncTransferStatusReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data);
+        // status: "complete", or "error"; it runs on the ingest thread
+        static void transferFinished(TransferData *data, const char *status);
+        // called on the main loop, when the transfer, or the processing of its VCards has failed
+        static gboolean transferFailedCb(gpointer user_data);
 
-        static void handleSignal(GDBusConnection *connection,  const gchar     *sender,
-                                 const gchar     *object_path, const gchar     *interface_name,
-                                 const gchar     *signal_name, GVariant        *parameters,
-                                 gpointer         user_data);
+        // the signals of the transfer are routed to TransferData, which finishes the transfer
+        friend class TransferData;
 
         // method to add "E_CONTACT_UID" to the EContact
         // will remove existing one, if it exists
         // returns: bool indicating successfull UID creation
-        bool makeUid(EContact *entry);
+        static bool makeUid(EContact *entry);
         // process received VCARD contacts' data
         // check the data against origin MAC, ie. the user may have selected other
         // remote device while synchronization was ongoing and thus the data (VCards)
         // may not belong to the device selected at the time
-        void processVCards(const char *filePath, const char *type, const char *origin);
+        // the transfer holds the type of VCards, the origin and how the VCards are merged into the entries of
+        // given type, eg. full synchronization replaces all entries
+        // it's called on the ingest thread, the VCards are parsed on worker threads and merged on the main loop, see ingestDoneCb()
+        // returns false, if the processing has not started
+        bool processVCards(TransferData *transfer);
+        // parses the VCard into the entry (contact, or call history entry), it's called on worker threads
+        // the photo of the contact is put into the store
+        static PBEntry *parseVCard(const std::string &vcard, bool contact, PhotoStore *photos);
+        static void parseVCardChunk(gpointer data, gpointer user_data);
+        // called on the main loop, once all VCards are parsed
+        static gboolean ingestDoneCb(gpointer user_data);
+        // builds new snapshot by merging parsed entries into the snapshot 'base', it's called on a worker thread,
+        // or on the main loop; new calls, which are not in 'base', are stored in 'added'
+        static PBSnapshot *mergeEntries(const PBSnapshot &base, IngestData *ingest, std::vector<PBEntryPtr> &added);
+        // publishes the snapshot of contacts ("pb"), or call history ("cch"); it's called on the main loop
+        void publishSnapshot(const char *type, const PBSnapshotPtr &snapshot);
+        // adds the keys of the photos referenced by the entries of the snapshot
+        static void collectPhotos(const PBSnapshot &snapshot, std::unordered_set<std::string> &photos);
+        // makes the name of the cache file for the device, see storePhonebookCache()
+        static bool makeCacheFileName(const char *bt_address, std::string &fileName);
         static void asyncCreateSessionReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data);
 
         void initiateNextSyncRequest();
 
-        void parseEContactToJsonTizenContact(EContact *econtact, std::string &contact);
-        void parseEContactToJsonTizenCallHistoryEntry(EContact *econtact, std::string &call);
+        // serialize the record of the entry, see ContactRecord
+        static void parseEntryToJsonTizenContact(const PBEntry &entry, std::string &contact);
+        static void parseEntryToJsonTizenCallHistoryEntry(const PBEntry &entry, std::string &call);
+        // makes the contact as a{sv} dictionary with the same keys as tizen.Contact JSON, see getContactsVariant()
+        // photo: whether the photo of the contact has been materialized, its URIs are omitted otherwise
+        static GVariant *makeContactVariant(const PBEntry &entry, const PhotoStore *photos, bool photo);
+        // selects the contacts of the page, see getJsonContactsRange()
+        Obex::Error getContactsRange(const PBSnapshot &snapshot, unsigned long offset, unsigned long limit, const char *sortKey, std::vector<const PBEntry*> &entries, PhotoPins &pins);
+        // makes JSON of the contact with URI of its thumbnail, returns false, if the thumbnail has not been made, ie. JSON of the entry is used
+        bool makeJsonContact(const PBEntry &entry, std::string &contact) const;
+        // makes JSON array of the contacts, the thumbnails are referenced at the time of the response, see makeJsonContact()
+        void makeJsonContacts(const std::vector<const PBEntry*> &entries, std::string &contacts) const;
+        // writes the photos of the contacts, which are returned to a client, they are pinned until the response is serialized
+        void materializePhotos(const std::vector<const PBEntry*> &entries, PhotoPins &pins);
 
         static gboolean checkStalledTransfer(gpointer user_data);
 
@@ -154,14 +355,26 @@ class Obex {
         std::string mSelectedRemoteDevice;
         char *mSession;
         char *mActiveTransfer;
+        TransferData *mActiveTransferData; // the active transfer, it's owned by the ingest thread
+        volatile gint mActiveTransferId;   // identifier of the active transfer (0 if none), read by the worker threads
+        guint mTransferCount;              // the last identifier of transfer
+        guint mStalledTransferTimer;
+        GCancellable *mSyncCancellable;    // cancels pending asynchronous steps of the synchronization
+        GThreadPool *mParserPool;          // worker threads parsing received VCards
+        GMainContext *mIngestContext;      // main context of the ingest thread
+        GMainLoop *mIngestLoop;
+        GThread *mIngestThread;
         // only one synchronization operation getContacts/getCallHistory,
         // is allowed at a time via Obex due to the selection of phonebook
         // use std::deque to handle this limitation
         std::deque<SyncPBData*> mSyncQueue;
-        std::map<std::string, EContact*> mContacts;
-        std::vector<std::string> mContactsOrder; // order of contacts inserted into the MAP
-        std::map<std::string, EContact*> mCallHistory;
-        std::vector<std::string> mCallHistoryOrder; // order of calls inserted into the MAP
+        // snapshots are accessed only by std::atomic_load/std::atomic_store
+        PBSnapshotPtr mContacts;    // contacts in the order of synchronization
+        PBSnapshotPtr mCallHistory; // calls, the latest first
+        PBFolderVersion mContactsVersion;    // version of contacts folder on the device, which the contacts are synchronized with
+        PBFolderVersion mCallHistoryVersion; // version of call history folder on the device, which the calls are synchronized with
+        PhotoStore mPhotos; // photos of the contacts
+        PBExporter mExporter; // exports the contacts into shared memory
 };
 
 #endif /* BLUEZ_H_ */
@@ -21,11 +21,15 @@ namespace PhoneD {
 #define OFONO_VOICECALL_IFACE            OFONO_PREFIX ".VoiceCall"
 #define OFONO_CALLVOLUME_IFACE           OFONO_PREFIX ".CallVolume"
 
-#define CHECK_FOR_MODEM_POWERED_INTERVAL 60 // interval for check whether 'Selected' remote device is Powered, and power it on, if it is not (in seconds)
+#define MODEM_POWER_RETRY_MIN_INTERVAL   2  // first delay of powering the 'Selected' modem on again, when it's not Powered (in seconds)
+#define MODEM_POWER_RETRY_MAX_INTERVAL   60 // the delay is doubled with each failed attempt up to this one (in seconds)
 
 OFono::OFono() :
     mModemPath( NULL ),
-    mActiveCall( NULL )
+    mModemPowered( false ),
+    mPowerRetrySource( 0 ),
+    mPowerRetryInterval( 0 ),
+    mSignals( this )
 {
     LoggerD("entered");
 
@@ -34,14 +38,19 @@ OFono::OFono() :
         LoggerD("Failed to call 'GetModems'");
     }
     */
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
-                             OFONO_MANAGER_IFACE, "/",
-                             "ModemAdded", OFono::handleSignal,
-                             this);
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
-                             OFONO_MANAGER_IFACE, "/",
-                             "ModemRemoved", OFono::handleSignal,
-                             this);
+    mSignals.add(OFONO_MANAGER_IFACE, "ModemAdded", "(oa{sv})", &OFono::modemAddedSignal);
+    mSignals.add(OFONO_MANAGER_IFACE, "ModemRemoved", "(o)", &OFono::modemRemovedSignal);
+    mSignals.add(OFONO_MODEM_IFACE, "PropertyChanged", "(sv)", &OFono::modemPropertyChangedSignal);
+    mSignals.add(OFONO_VOICECALLMANAGER_IFACE, "CallAdded", "(oa{sv})", &OFono::callAddedSignal);
+    mSignals.add(OFONO_VOICECALLMANAGER_IFACE, "CallRemoved", "(o)", &OFono::callRemovedSignal);
+    mSignals.add(OFONO_VOICECALL_IFACE, "PropertyChanged", "(sv)", &OFono::callPropertyChangedSignal);
+
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
+                       OFONO_MANAGER_IFACE, "/",
+                       "ModemAdded");
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
+                       OFONO_MANAGER_IFACE, "/",
+                       "ModemRemoved");
 
     // won't request calls here, since the service OFONO_VOICECALLMANAGER_IFACE may not be available yet
     //get active calls
@@ -49,69 +58,46 @@ OFono::OFono() :
     //    getCalls();
     //}
 
-    // periodic check whether modem for 'Selected' remote device is powered
-    // among other things, it handles also the case when the phone gets out of the range of HMI BT
-    g_timeout_add(CHECK_FOR_MODEM_POWERED_INTERVAL*1000, OFono::checkForModemPowered, this);
+    // the power of the modem is watched by "PropertyChanged" of the modem, see modemPropertyChangedSignal(), it's powered on again
+    // with a backoff, when it goes off, eg. when the phone gets out of the range of HMI BT, see schedulePowerRetry()
 }
 
 OFono::~OFono() {
     LoggerD("entered");
+    // the listener is already destroyed, the calls are removed without notification
+    removeCalls(false);
     removeModem(mModemPath);
+    cancelPowerRetry();
 }
 
-gboolean OFono::checkForModemPowered(gpointer user_data) {
-    OFono *ctx = static_cast<OFono*>(user_data);
-    if(!ctx || !ctx->mModemPath)
-        return G_SOURCE_CONTINUE; // continuous timeout
-
-    if(!ctx->isModemPowered(ctx->mModemPath)) {
-        ctx->setModemPowered(ctx->mModemPath, true);
-    }
+void OFono::schedulePowerRetry() {
+    if(!mModemPath || mModemPowered || mPowerRetrySource)
+        return;
 
-    return G_SOURCE_CONTINUE; // continuous timeout
+    mPowerRetryInterval = mPowerRetryInterval ? std::min(2*mPowerRetryInterval, (guint)MODEM_POWER_RETRY_MAX_INTERVAL) : MODEM_POWER_RETRY_MIN_INTERVAL;
+    LoggerD("Powering modem on in " << mPowerRetryInterval << "s");
+    mPowerRetrySource = g_timeout_add_seconds(mPowerRetryInterval, OFono::retryModemPowered, this);
 }
 
-bool OFono::isModemPowered(const char *modem) {
-    if(modem)
-        return false;
-
-    GError *err = NULL;
-    GVariant *reply = NULL;
-    reply = g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL),
-                                         OFONO_SERVICE,
-                                         modem,
-                                         OFONO_MODEM_IFACE,
-                                         "GetProperties",
-                                         NULL,
-                                         NULL,
-                                         G_DBUS_CALL_FLAGS_NONE,
-                                         -1,
-                                         NULL,
-                                         &err);
-
-
-    if(err || !reply) {
-        if(err)
-            g_error_free(err);
-        return false;
+void OFono::cancelPowerRetry() {
+    if(mPowerRetrySource) {
+        g_source_remove(mPowerRetrySource);
+        mPowerRetrySource = 0;
     }
+    mPowerRetryInterval = 0;
+}
 
-    GVariant *prop = NULL;
-    GVariantIter *iter = NULL;
-    g_variant_get(reply, "(a{sv})", &iter);
-    bool powered = false;
-    while((prop = g_variant_iter_next_value(iter))) {
-        const char *name = NULL;
-        GVariant *value = NULL;
-        g_variant_get(prop, "{sv}", &name, &value);
-        if(name && !strcmp(name, "Powered")) {
-            powered = g_variant_get_boolean(value);
-        }
-    }
+gboolean OFono::retryModemPowered(gpointer user_data) {
+    OFono *ctx = static_cast<OFono*>(user_data);
+    if(!ctx)
+        return G_SOURCE_REMOVE;
 
-    g_variant_unref(reply);
+    ctx->mPowerRetrySource = 0;
+    // the next attempt is scheduled, when this one fails, see asyncSetModemPoweredCallback()
+    if(ctx->mModemPath && !ctx->mModemPowered)
+        ctx->setModemPowered(ctx->mModemPath, true);
 
-    return powered;
+    return G_SOURCE_REMOVE; // single shot timeout
 }
 
 // synchronous version of method for setting property
@@ -122,7 +108,7 @@ bool OFono::setProperty(const char* iface, const char* path, const char *propert
     sprintf(signature, "%c", type); // eg. "b" for boolean
 
     GError *err = NULL;
-    g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,NULL),
+    g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SYSTEM),
                                  OFONO_SERVICE,
                                  path,
                                  iface,
@@ -153,7 +139,7 @@ void OFono::setPropertyAsync(const char* iface, const char* path, const char *pr
     char signature[2];
     sprintf(signature, "%c", type); // eg. "b" for boolean
 
-    g_dbus_connection_call( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,NULL),
+    g_dbus_connection_call( BusConnection::get(G_BUS_TYPE_SYSTEM),
                             OFONO_SERVICE,
                             path,
                             iface,
@@ -183,7 +169,7 @@ void OFono::setModemPowered(const char *modem, bool powered) {
 
 void OFono::asyncSetModemPoweredCallback(GObject *source, GAsyncResult *result, gpointer user_data) {
     GError *err = NULL;
-    g_dbus_connection_call_finish(g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL), result, &err);
+    g_dbus_connection_call_finish(BusConnection::get(G_BUS_TYPE_SYSTEM), result, &err);
     if(err) {
         LoggerE("Failed to set 'Powered' property on modem: " << err->message);
         OFono *ctx = static_cast<OFono*>(user_data);
@@ -191,10 +177,12 @@ void OFono::asyncSetModemPoweredCallback(GObject *source, GAsyncResult *result,
             LoggerE("Invalid ctx");
             return;
         }
-        // notify about the failure
-        if(!ctx->isModemPowered(ctx->mModemPath)) // Modem is not 'Powered', ie. the remote BT device is not 'Selected' for BT operations
+        // notify about the failure, only the first one, the repeated attempts are not reported
+        if(ctx->mModemPath && !ctx->mModemPowered && !ctx->mPowerRetryInterval) // Modem is not 'Powered', ie. the remote BT device is not 'Selected' for BT operations
             ctx->setModemPoweredFailed(err?err->message:"Failed to set 'Powered' property on Modem.");
         g_error_free(err);
+        // try again later, eg. the remote device may be out of the range
+        ctx->schedulePowerRetry();
     }
     else
         LoggerE("Property 'Powered' successfuly set on modem");
@@ -216,7 +204,7 @@ void OFono::asyncSelectModemCallback(GObject *source, GAsyncResult *result, gpoi
 
     GError *err = NULL;
     GVariant *reply;
-    reply = g_dbus_connection_call_finish(g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL), result, &err);
+    reply = g_dbus_connection_call_finish(BusConnection::get(G_BUS_TYPE_SYSTEM), result, &err);
     if(err || !reply) {
         if(err) {
             LoggerE("Failed to 'GetModems': " << err->message);
@@ -264,7 +252,7 @@ void OFono::asyncSelectModemCallback(GObject *source, GAsyncResult *result, gpoi
 void OFono::selectModem(std::string &btAddress) {
     LoggerD("Selecting modem: " << btAddress);
     // Retrieving list of available modems to get the one that is for 'wanted' device
-    g_dbus_connection_call( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL),
+    g_dbus_connection_call( BusConnection::get(G_BUS_TYPE_SYSTEM),
                             OFONO_SERVICE,
                             "/",
                             OFONO_MANAGER_IFACE,
@@ -289,38 +277,38 @@ void OFono::addModem(const char *path, GVariantIter *props) {
         free(mModemPath);
 
     mModemPath = strdup(path); // make a copy of path, 'cause it will be unref-ed
+    mModemPowered = false;
+    cancelPowerRetry();
 
     const char *key = NULL;
     GVariant *value = NULL;
     bool online = FALSE;
-    while(g_variant_iter_next(props, "{sv}", &key, &value)) {
-        if(!strcmp(key, "Powered")) {
-            //bool powered = g_variant_get_boolean(value);
+    while(g_variant_iter_next(props, "{&sv}", &key, &value)) {
+        if(!strcmp(key, "Powered") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+            mModemPowered = g_variant_get_boolean(value);
         }
-        else if(!strcmp(key, "Online")) {
+        else if(!strcmp(key, "Online") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
             online = g_variant_get_boolean(value);
         }
+        g_variant_unref(value);
     }
 
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
-                             OFONO_VOICECALLMANAGER_IFACE, mModemPath,
-                             "CallAdded", OFono::handleSignal,
-                             this);
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
+                       OFONO_VOICECALLMANAGER_IFACE, mModemPath,
+                       "CallAdded");
 
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
-                             OFONO_VOICECALLMANAGER_IFACE, mModemPath,
-                             "PropertyChanged", OFono::handleSignal,
-                             this);
+    // there isn't a route for the properties of the manager, the signals are counted as un-handled, see SignalStats
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
+                       OFONO_VOICECALLMANAGER_IFACE, mModemPath,
+                       "PropertyChanged");
 
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
-                             OFONO_VOICECALLMANAGER_IFACE, mModemPath,
-                             "CallRemoved", OFono::handleSignal,
-                             this);
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
+                       OFONO_VOICECALLMANAGER_IFACE, mModemPath,
+                       "CallRemoved");
 
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
-                             OFONO_MODEM_IFACE, mModemPath,
-                             "PropertyChanged", OFono::handleSignal,
-                             this);
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
+                       OFONO_MODEM_IFACE, mModemPath,
+                       "PropertyChanged");
 
     if(!online) {
         // power on modem
@@ -358,6 +346,13 @@ void OFono::removeModem(const char *modemPath) {
                                     OFONO_MODEM_IFACE, modemPath,
                                     "PropertyChanged");
 
+        // the calls of the modem are gone with it, CallRemoved won't come anymore
+        removeCalls(true);
+
+        // the modem is not powered on again anymore
+        cancelPowerRetry();
+        mModemPowered = false;
+
         // power off modem
         setModemPowered(modemPath, false);
         // at this point we will not get notification "PropertyChanged" on 'Powered' property,
@@ -378,7 +373,7 @@ void OFono::getCalls()
 
     GError *err = NULL;
     GVariant *reply = NULL;
-    reply = g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL),
+    reply = g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SYSTEM),
                                          OFONO_SERVICE,
                                          mModemPath,
                                          OFONO_VOICECALLMANAGER_IFACE,
@@ -415,191 +410,202 @@ void OFono::getCalls()
     return;
 }
 
-void OFono::handleSignal(GDBusConnection       *connection,
-                         const gchar           *sender,
-                         const gchar           *object_path,
-                         const gchar           *interface_name,
-                         const gchar           *signal_name,
-                         GVariant              *parameters,
-                         gpointer               user_data)
-{
-    LoggerD("signal received: \"" << interface_name << "\" -> \"" << signal_name << "\"");
+// the parameters of the signals are checked by mSignals, see OFono::OFono()
+void OFono::modemAddedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *modem = NULL;
+    g_variant_get(parameters, "(&oa{sv})", &modem, NULL);
+    LoggerD("Modem added: " << modem);
 
-    OFono* ctx = static_cast<OFono*>(user_data);
-    if(!ctx) {
-        LoggerE("Failed to cast object");
-        return;
+    std::string modemString(modem);
+    size_t idx = modemString.find( "_" ) + 1; // index of address of remote device
+    std::string modemRemoteBtAddress = modemString.substr (idx, modemString.length()-idx);
+    if(makeMACFromRawMAC(modemRemoteBtAddress)) {
+        modemAdded(modemRemoteBtAddress);
     }
+}
 
-    if(!interface_name || !signal_name) {
-        LoggerE("Invalid callback data");
-        return;
+void OFono::modemRemovedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *modem = NULL;
+    g_variant_get(parameters, "(&o)", &modem);
+    LoggerD("Modem removed: " << modem);
+    if(mModemPath && !strcmp(modem, mModemPath)) {
+        removeModem(mModemPath);
     }
-    if(!strcmp(interface_name, OFONO_MANAGER_IFACE)) {
-        if(!strcmp(signal_name, "ModemAdded")) {
-            const char *modem = NULL;
-            GVariantIter *props = NULL;
-            g_variant_get(parameters, "(oa{sv})", &modem, &props);
-            if(modem) {
-                std::string modemString(modem);
-                size_t idx = modemString.find( "_" ) + 1; // index of address of remote device
-                std::string modemRemoteBtAddress = modemString.substr (idx, modemString.length()-idx);
-                if(makeMACFromRawMAC(modemRemoteBtAddress)) {
-                    ctx->modemAdded(modemRemoteBtAddress);
-                }
-            }
-        }
-    }
-    else if(!strcmp(interface_name, OFONO_MANAGER_IFACE)) {
-        if(!strcmp(signal_name, "ModemRemoved")) {
-            const char *modem = NULL;
-            g_variant_get(parameters, "(o)", &modem);
-            if(modem) {
-                LoggerD("Modem removed: " << modem);
-                if(ctx->mModemPath && !strcmp(modem, ctx->mModemPath)) {
-                    ctx->removeModem(ctx->mModemPath);
-                }
-            }
-        }
-    }
-    else if(!strcmp(interface_name, OFONO_MODEM_IFACE)) {
-        if(!strcmp(signal_name, "PropertyChanged")) {
-            const char *name = NULL;
-            GVariant *value = NULL;
-            g_variant_get(parameters, "(sv)", &name, &value);
-            if(!strcmp(name, "Powered")) {
-                bool powered = g_variant_get_boolean(value);
-                LoggerD("\t" << name << " = " << (powered?"TRUE":"FALSE"));
-                ctx->modemPowered(powered);
-                // !!! won't request calls here, since the service may not be available yet
-                // see "Interfaces" "PropertyChanged" on OFONO_MODEM_IFACE
-                //if(powered)
-                //    ctx->getCalls();
-            }
-            else if(!strcmp(name, "Online")) {
-                bool online = g_variant_get_boolean(value);
-                LoggerD("\t" << name << " = " << (online?"TRUE":"FALSE"));
-            }
-            else if(!strcmp(name, "Interfaces")) {
-                GVariantIter iter;
-                GVariant *interface;
-                GVariant *variant = g_variant_get_child_value(parameters,1); // signature: "v"
-                GVariant *interfaces = g_variant_get_child_value(variant,0); // signature: "as"
-                g_variant_iter_init(&iter, interfaces);
-                while((interface = g_variant_iter_next_value(&iter))) {
-                    const char *iface = g_variant_get_string(interface, NULL);
-                    if(!strcmp(iface, OFONO_VOICECALLMANAGER_IFACE)) {
-                        //TODO: ??? check if the service is newly added ??? - not to request calls multiple times
-                        // service is up, request active calls now
-                        ctx->getCalls();
-                    }
-                };
-            }
-        }
-    }
-    else if(!strcmp(interface_name, OFONO_VOICECALLMANAGER_IFACE)) {
-        if(!strcmp(signal_name, "CallAdded")) {
-            if(!parameters) {
-                LoggerE("Invalid parameters");
-                return;
-            }
+}
 
-            const char *path = NULL;
-            GVariantIter *props = NULL;
-            g_variant_get(parameters, "(oa{sv})", &path, &props);
-            ctx->addCall(path, props);
-        }
-        else if(!strcmp(signal_name, "CallRemoved")) {
-            if(!parameters) {
-                LoggerD("Invalid parameters");
-                return;
+void OFono::modemPropertyChangedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *name = NULL;
+    GVariant *value = NULL;
+    g_variant_get(parameters, "(&sv)", &name, &value);
+    if(!strcmp(name, "Powered") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+        bool powered = g_variant_get_boolean(value);
+        LoggerD("\t" << name << " = " << (powered?"TRUE":"FALSE"));
+        mModemPowered = powered;
+        if(powered)
+            cancelPowerRetry(); // the backoff starts from the beginning, next time the modem goes off
+        else
+            schedulePowerRetry();
+        modemPowered(powered);
+        // !!! won't request calls here, since the service may not be available yet
+        // see "Interfaces" "PropertyChanged" on OFONO_MODEM_IFACE
+        //if(powered)
+        //    getCalls();
+    }
+    else if(!strcmp(name, "Online") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+        bool online = g_variant_get_boolean(value);
+        LoggerD("\t" << name << " = " << (online?"TRUE":"FALSE"));
+    }
+    else if(!strcmp(name, "Interfaces") && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING_ARRAY)) {
+        GVariantIter iter;
+        const char *iface = NULL;
+        g_variant_iter_init(&iter, value);
+        while(g_variant_iter_next(&iter, "&s", &iface)) {
+            if(!strcmp(iface, OFONO_VOICECALLMANAGER_IFACE)) {
+                //TODO: ??? check if the service is newly added ??? - not to request calls multiple times
+                // service is up, request active calls now
+                getCalls();
             }
-            // TODO: do the check for the call
-            // for now, remove just the active one
-            ctx->removeCall(&ctx->mActiveCall);
-        }
-        else {
-            LoggerD("un-handled signal \"" << signal_name << "\" on " << interface_name);
         }
     }
-    else if(!strcmp(interface_name, OFONO_VOICECALL_IFACE)) {
-        if(!strcmp(signal_name, "PropertyChanged")) {
-            const char *key = NULL;
-            GVariant *value = NULL;
-            g_variant_get(parameters, "(sv)", &key, &value);
-            if(!strcmp(key, "State")) {
-                const char *state = NULL;
-                g_variant_get(value, "s", &state);
-                if(ctx->mActiveCall->state)
-                    g_free(ctx->mActiveCall->state);
-                ctx->mActiveCall->state = strdup(state);
-                LoggerD("PROPERTY CHANGED: " << key << " = " << state);
-            }
-            else {
-                LoggerD("PROPERTY CHANGED: " << key);
-            }
-            // TODO: check for the remaining properties
-            ctx->callChanged(ctx->mActiveCall->state, ctx->mActiveCall->line_id);
-        }
+    g_variant_unref(value);
+}
+
+void OFono::callAddedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *path = NULL;
+    GVariantIter *props = NULL;
+    g_variant_get(parameters, "(&oa{sv})", &path, &props);
+    addCall(path, props);
+    g_variant_iter_free(props);
+}
+
+void OFono::callRemovedSignal(const gchar *objectPath, GVariant *parameters) {
+    const char *path = NULL;
+    g_variant_get(parameters, "(&o)", &path);
+    removeCall(path);
+}
+
+void OFono::callPropertyChangedSignal(const gchar *objectPath, GVariant *parameters) {
+    auto it = mCalls.find(objectPath);
+    if(it == mCalls.end()) {
+        LoggerD("PROPERTY CHANGED on unknown call " << objectPath);
+        return;
     }
-    else {
-        LoggerD("signal received for un-handled IFACE: " << interface_name);
+    OFono::Call *call = (*it).second;
+
+    const char *key = NULL;
+    GVariant *value = NULL;
+    g_variant_get(parameters, "(&sv)", &key, &value);
+    LoggerD("PROPERTY CHANGED: " << objectPath << ": " << key);
+    bool changed = updateCall(call, key, value);
+    g_variant_unref(value);
+
+    // notify listener about call state changed
+    if(changed && !!call->state && !!call->line_id) {
+        callChanged(*call);
     }
 }
 
+bool OFono::updateCall(OFono::Call *call, const char *key, GVariant *value) {
+    if(!strcmp(key, "State") && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+        const char *state = g_variant_get_string(value, NULL);
+        if(call->state && !strcmp(call->state, state))
+            return false;
+        g_free(call->state);
+        call->state = strdup(state);
+        return true;
+    }
+    else if(!strcmp(key, "LineIdentification") && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+        const char *line_id = g_variant_get_string(value, NULL);
+        if(call->line_id && !strcmp(call->line_id, line_id))
+            return false;
+        g_free(call->line_id);
+        call->line_id = strdup(line_id);
+        return true;
+    }
+    else if(!strcmp(key, "Multiparty") && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+        bool multiparty = g_variant_get_boolean(value);
+        if(call->multiparty == multiparty)
+            return false;
+        call->multiparty = multiparty;
+        return true;
+    }
+    // the remaining properties are not reported to the clients
+    return false;
+}
+
 void OFono::addCall(const char *path, GVariantIter *props) {
     LoggerD("entered");
 
-    // only one call at a time is curently supported
-    if(mActiveCall) {
-        LoggerD("Unable to add a call when another is on-going");
+    if(!path)
         return;
-    }
 
-    if(!path)
+    // the call may already be known, eg. when the calls are requested by getCalls() after CallAdded has come
+    if(mCalls.find(path) != mCalls.end()) {
+        LoggerD("Call " << path << " is already added");
         return;
+    }
 
-    mActiveCall = new OFono::Call();
-    mActiveCall->path = strdup(path);
+    OFono::Call *call = new OFono::Call();
+    call->path = strdup(path);
+    mCalls[path] = call;
 
-    Utils::setSignalListener(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
-                             OFONO_VOICECALL_IFACE, path,
-                             "PropertyChanged", OFono::handleSignal,
-                             this);
+    mSignals.subscribe(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
+                       OFONO_VOICECALL_IFACE, path,
+                       "PropertyChanged");
 
     const char *key = NULL;
     GVariant *value = NULL;
-    while(g_variant_iter_next(props, "{sv}", &key, &value)) {
-        if(!strcmp(key, "State")) {
-            const char *state = NULL;
-            g_variant_get(value, "s", &state);
-            mActiveCall->state = state ? strdup(state) : NULL;
-        }
-        else if(!strcmp(key, "LineIdentification")) {
-            const char *line_id = NULL;
-            g_variant_get(value, "s", &line_id);
-            mActiveCall->line_id = line_id ? strdup(line_id) : NULL;
-        }
+    while(g_variant_iter_next(props, "{&sv}", &key, &value)) {
+        updateCall(call, key, value);
+        g_variant_unref(value);
     }
 
+    LoggerD("Call added: " << path << ", " << mCalls.size() << " call(s) present");
+
     // notify listener about call state changed
-    if(!!mActiveCall->state && !!mActiveCall->line_id) {
-        callChanged(mActiveCall->state, mActiveCall->line_id);
+    if(!!call->state && !!call->line_id) {
+        callChanged(*call);
     }
 }
 
-void OFono::removeCall(OFono::Call **call) {
+void OFono::removeCall(const char *path) {
     LoggerD("entered");
 
+    auto it = mCalls.find(path);
+    if(it == mCalls.end()) {
+        LoggerD("Call " << path << " is not known");
+        return;
+    }
+
     // unsubscribe and remove signal listeners for the call
     Utils::removeSignalListener(G_BUS_TYPE_SYSTEM, OFONO_SERVICE,
-                                OFONO_VOICECALL_IFACE, (*call)->path,
+                                OFONO_VOICECALL_IFACE, path,
                                 "PropertyChanged");
 
-    if(*call) {
-        delete *call;
-        *call = NULL;
+    delete (*it).second;
+    mCalls.erase(it);
+}
+
+void OFono::removeCalls(bool notify) {
+    while(!mCalls.empty()) {
+        OFono::Call *call = (*mCalls.begin()).second;
+        // oFono reports 'disconnected' state before the call is removed, do it here, since it won't
+        if(notify && call->state && strcmp(call->state, "disconnected") && call->line_id) {
+            g_free(call->state);
+            call->state = strdup("disconnected");
+            callChanged(*call);
+        }
+        removeCall(call->path);
+    }
+}
+
+OFono::Call *OFono::findCall(const char *state) const {
+    for(auto it = mCalls.begin(); it != mCalls.end(); ++it) {
+        OFono::Call *call = (*it).second;
+        if(call->state && !strcmp(call->state, state))
+            return call;
     }
+    return NULL;
 }
 
 bool OFono::invokeCall(const char* phoneNumber, char **error) {
@@ -608,14 +614,15 @@ bool OFono::invokeCall(const char* phoneNumber, char **error) {
         return false;
     }
 
-    if(mActiveCall) { // active call
-        *error = strdup("Already active call");
+    // oFono puts the active call on hold, when another one is dialed, but there can't be two calls being set up at a time
+    if(findCall("incoming") || findCall("waiting") || findCall("dialing") || findCall("alerting")) {
+        *error = strdup("Another call is being set up");
         return false;
     }
 
     GError *err = NULL;
     GVariant *reply;
-    reply = g_dbus_connection_call_sync( g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,NULL),
+    reply = g_dbus_connection_call_sync( BusConnection::get(G_BUS_TYPE_SYSTEM),
                                          OFONO_SERVICE,
                                          mModemPath,
                                          OFONO_VOICECALLMANAGER_IFACE,
@@ -650,17 +657,76 @@ bool OFono::invokeCall(const char* phoneNumber, char **error) {
 }
 
 bool OFono::answerCall(char **error) {
-    if(!mActiveCall) { // no active call to hangup
+    OFono::Call *call = findCall("incoming");
+    if(!call) { // no incoming call to answer
+        *error = strdup(findCall("waiting") ? "The call is waiting, it has to be answered by HoldAndAnswer, or ReleaseAndAnswer" : "No incoming call");
+        return false;
+    }
+
+    return callMethod(call->path, "Answer", error);
+}
+
+bool OFono::hangupCall(char **error) {
+    OFono::Call *call = activeCall();
+    if(!call) { // no active call to hangup
         *error = strdup("No active call");
         return false;
     }
 
+    bool success = callMethod(call->path, "Hangup", error);
+    delete call;
+    return success;
+}
+
+bool OFono::swapCalls(char **error) {
+    if(!findCall("active") && !findCall("held")) {
+        *error = strdup("No active, or held call");
+        return false;
+    }
+
+    return callManagerMethod("SwapCalls", error);
+}
+
+bool OFono::holdAndAnswer(char **error) {
+    if(!findCall("waiting")) {
+        *error = strdup("No waiting call");
+        return false;
+    }
+
+    return callManagerMethod("HoldAndAnswer", error);
+}
+
+bool OFono::releaseAndAnswer(char **error) {
+    if(!findCall("waiting") && !findCall("held")) {
+        *error = strdup("No waiting, or held call");
+        return false;
+    }
+
+    return callManagerMethod("ReleaseAndAnswer", error);
+}
+
+bool OFono::mergeCalls(char **error) {
+    if(!findCall("active") || !findCall("held")) {
+        *error = strdup("Both active and held call are needed to merge the calls");
+        return false;
+    }
+
+    return callManagerMethod("CreateMultiparty", error);
+}
+
+bool OFono::callManagerMethod(const char *method, char **error) {
+    if(!mModemPath) { // no selected modem to perform operation on
+        *error = strdup("No active modem set");
+        return false;
+    }
+
     GError *err = NULL;
-    g_dbus_connection_call_sync (g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,NULL),
+    GVariant *reply;
+    reply = g_dbus_connection_call_sync (BusConnection::get(G_BUS_TYPE_SYSTEM),
                     OFONO_SERVICE,
-                    mActiveCall->path,
-                    OFONO_VOICECALL_IFACE,
-                    "Answer",
+                    mModemPath,
+                    OFONO_VOICECALLMANAGER_IFACE,
+                    method,
                     NULL,
                     NULL,
                     G_DBUS_CALL_FLAGS_NONE,
@@ -669,27 +735,27 @@ bool OFono::answerCall(char **error) {
                     &err);
 
     if(err) {
-        LoggerD("Failed to call 'Answer' DBUS method: " << err->message);
+        LoggerD("Failed to call '" << method << "' DBUS method: " << err->message);
         *error = strdup(err->message);
         g_error_free(err);
         return false;
     }
 
+    // the changes of the calls are reported by the signals, the reply (eg. the paths of the merged calls) is not needed
+    if(reply)
+        g_variant_unref(reply);
+
     return true;
 }
 
-bool OFono::hangupCall(char **error) {
-    if(!mActiveCall) { // no active call to hangup
-        *error = strdup("No active call");
-        return false;
-    }
-
+bool OFono::callMethod(const char *path, const char *method, char **error) {
     GError *err = NULL;
-    g_dbus_connection_call_sync (g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL,NULL),
+    GVariant *reply;
+    reply = g_dbus_connection_call_sync (BusConnection::get(G_BUS_TYPE_SYSTEM),
                     OFONO_SERVICE,
-                    mActiveCall->path,
+                    path,
                     OFONO_VOICECALL_IFACE,
-                    "Hangup",
+                    method,
                     NULL,
                     NULL,
                     G_DBUS_CALL_FLAGS_NONE,
@@ -698,23 +764,47 @@ bool OFono::hangupCall(char **error) {
                     &err);
 
     if(err) {
-        LoggerD("Failed to call 'Hangup' DBUS method: " << err->message);
+        LoggerD("Failed to call '" << method << "' DBUS method: " << err->message);
         *error = strdup(err->message);
         g_error_free(err);
         return false;
     }
 
+    if(reply)
+        g_variant_unref(reply);
+
     return true;
 }
 
 OFono::Call *OFono::activeCall() {
     LoggerD("OFono::activeCall()");
-    // make a copy of object, since it may be destroyed meanwhile
-    return mActiveCall ? new OFono::Call(mActiveCall) : NULL;
+
+    static const char *states[] = { "active", "incoming", "dialing", "alerting", "waiting", "held" };
+    for(unsigned int i=0; i<sizeof(states)/sizeof(states[0]); i++) {
+        OFono::Call *call = findCall(states[i]);
+        if(call) {
+            // make a copy of object, since it may be destroyed meanwhile
+            return new OFono::Call(call);
+        }
+    }
+    return NULL;
+}
+
+static bool comparePaths(const OFono::Call *a, const OFono::Call *b) {
+    return strcmp(a->path, b->path) < 0;
+}
+
+void OFono::listCalls(std::vector<OFono::Call*> &calls) {
+    size_t first = calls.size();
+    for(auto it = mCalls.begin(); it != mCalls.end(); ++it) {
+        // make a copy of object, since it may be destroyed meanwhile
+        calls.push_back(new OFono::Call((*it).second));
+    }
+    std::sort(calls.begin() + first, calls.end(), comparePaths);
 }
 
 bool OFono::muteCall(bool mute, char **error) {
-    if(!mActiveCall) { // no active call to hangup
+    if(mCalls.empty()) { // no call to mute
         *error = strdup("No active call");
         return false;
     }
@@ -7,6 +7,10 @@
 #include <string>
 #include <string.h>
 #include <map>
+#include <vector>
+#include <unordered_map>
+
+#include "utils.h"
 
 namespace PhoneD {
 
@@ -27,22 +31,24 @@ class OFono {
     /*! \class Call
      *  \brief A Class describing phone call object.
      *
-     * A class describing phone call object. It is used to get information about active call.
+     * A class describing phone call object. It is used to get information about the calls present on the modem, there may be more
+     * of them at a time, eg. an active call and a waiting one, a held call, or the calls of a multiparty call.
      */
     class Call {
         public:
             /**
              * A default constructor which constructs an empty object with NULL initialized members.
              */
-            Call() : path(NULL), state(NULL), line_id(NULL) {};
+            Call() : path(NULL), state(NULL), line_id(NULL), multiparty(false) {};
             /**
              * Copy constructor to make a copy from the Call object specified by the pointer to it.
              * @param[in] call A pointer to Call object to make a copy of.
              */
-            Call(OFono::Call *call) {
-                if(call->path)  path = strdup(call->path);
-                if(call->state) state = strdup(call->state);
-                if(call->line_id) line_id = strdup(call->line_id);
+            Call(const OFono::Call *call) {
+                path = call->path ? strdup(call->path) : NULL;
+                state = call->state ? strdup(call->state) : NULL;
+                line_id = call->line_id ? strdup(call->line_id) : NULL;
+                multiparty = call->multiparty;
             };
             /**
              * A destructor which frees the allocated memory of member variables and destroys the object.
@@ -52,10 +58,14 @@ class OFono {
                 if(state)   { g_free(state);   state=NULL;   }
                 if(line_id) { g_free(line_id); line_id=NULL; }
             };
+        private:
+            Call(const Call&);
+            Call &operator=(const Call&);
         public:
             char *path;     /*!< A path to the call object */
-            char *state;    /*!< A state of phone call (incoming,dialing,active,disconnected) */
+            char *state;    /*!< A state of phone call (incoming,dialing,alerting,active,held,waiting,disconnected) */
             char *line_id;  /*!< A line identifier. It contains a phone number of the caller, or the calling person respectively. */
+            bool multiparty; /*!< Whether the call is a part of multiparty call. */
     };
 
     public:
@@ -65,9 +75,9 @@ class OFono {
          * <li> "ModemAdded" on \b org.ofono.Manager interface - To get notified when modem is added. </li>
          * <li> "ModemRemoved" on \b org.ofono.Manager interface - To get notified when modem is removed.</li>
          * </ul>
-         * It starts a timer to check whether default modem is \b Powered, or not. It handles the case, when the device gets out of the range, or when the user
-         * turns OFF and then turns ON the BT on the phone device, in which case there isn't a notification that the remote device got back.
-         * The timer in specific interval checks whether the modem is \b Powered and if not, it tries to power it up.
+         * The \b Powered property of default modem is watched by "PropertyChanged" signal on \b org.ofono.Modem interface. When the modem goes off, eg. when the device
+         * gets out of the range, or when the user turns OFF and then turns ON the BT on the phone device, in which case there isn't a notification that the remote device got back,
+         * it tries to power the modem up again. The attempts are repeated with exponentially growing delay until the modem is \b Powered, or it is removed.
          */
         OFono();
 
@@ -98,19 +108,47 @@ class OFono {
         bool invokeCall(const char* phoneNumber, char **error);
 
         /**
-         * A method to answer incoming phone call.
+         * A method to answer incoming phone call. A waiting call (an incoming call while there is another one) is answered by holdAndAnswer(), or releaseAndAnswer().
          * @param[out] error If the return value from the method is \b false, it contains a description of the error. The caller is responsible for freeing the memory if the error is set.
          * @return \b True if D-Bus "Answer" method was successfuly called on \b org.ofono.VoiceCall interface, otherwise it returns \b false.
          */
         bool answerCall(char **error);
 
         /**
-         * A method to decline incoming, or hangup active phone call.
+         * A method to decline incoming, or hangup active phone call. It's applied to the call returned by activeCall().
          * @param[out] error If the return value from the method is \b false, it contains a description of the error. The caller is responsible for freeing the memory if the error is set.
          * @return \b True if D-Bus "Hangup" method was successfuly called on \b org.ofono.VoiceCall interface, otherwise it returns \b false.
          */
         bool hangupCall(char **error);
 
+        /**
+         * A method to swap the active and the held calls. If there is only an active call, it's put on hold, if there is only a held call, it's resumed.
+         * @param[out] error If the return value from the method is \b false, it contains a description of the error. The caller is responsible for freeing the memory if the error is set.
+         * @return \b True if D-Bus "SwapCalls" method was successfuly called on \b org.ofono.VoiceCallManager interface, otherwise it returns \b false.
+         */
+        bool swapCalls(char **error);
+
+        /**
+         * A method to put the active call on hold and to answer the waiting call.
+         * @param[out] error If the return value from the method is \b false, it contains a description of the error. The caller is responsible for freeing the memory if the error is set.
+         * @return \b True if D-Bus "HoldAndAnswer" method was successfuly called on \b org.ofono.VoiceCallManager interface, otherwise it returns \b false.
+         */
+        bool holdAndAnswer(char **error);
+
+        /**
+         * A method to hangup the active call and to answer the waiting, or the held call.
+         * @param[out] error If the return value from the method is \b false, it contains a description of the error. The caller is responsible for freeing the memory if the error is set.
+         * @return \b True if D-Bus "ReleaseAndAnswer" method was successfuly called on \b org.ofono.VoiceCallManager interface, otherwise it returns \b false.
+         */
+        bool releaseAndAnswer(char **error);
+
+        /**
+         * A method to merge the active and the held calls into multiparty call.
+         * @param[out] error If the return value from the method is \b false, it contains a description of the error. The caller is responsible for freeing the memory if the error is set.
+         * @return \b True if D-Bus "CreateMultiparty" method was successfuly called on \b org.ofono.VoiceCallManager interface, otherwise it returns \b false.
+         */
+        bool mergeCalls(char **error);
+
         /**
          * A method to mute/unmute active phone call.
          * @param[in] mute Specifies whether to mute/unmute phone call.
@@ -121,44 +159,64 @@ class OFono {
 
         /**
          * Gets the information about active phone call. It creates new object (allocates a memory) and the caller has to delete it.
-         * @return OFono::Call object describing active phone call.
+         * If there are more calls, the call in \b active state is preferred, then the call which is being set up (incoming, dialing, alerting), then the waiting and the held one.
+         * @return OFono::Call object describing active phone call, or \b NULL if there isn't any call.
          */
         OFono::Call *activeCall();
 
+        /**
+         * Gets the information about all phone calls, ordered by the path of the call. It creates new objects (allocates a memory) and the caller has to delete them.
+         * @param[out] calls OFono::Call objects describing the calls, they are appended to the vector.
+         */
+        void listCalls(std::vector<OFono::Call*> &calls);
+
     private:
         static void asyncSelectModemCallback(GObject *source, GAsyncResult *result, gpointer user_data); // async callback for "GetModems" invoked from selectModem() method
-        virtual void callChanged(const char* state, const char* phoneNumber) = 0;
+        virtual void callChanged(const OFono::Call &call) = 0; // called for each change of the call, including its addition
 
         void addModem(const char *path, GVariantIter *props);
         virtual void modemAdded(std::string &modem) = 0; // MAC address of modem ... from ModemAdded DBUS
         void removeModem(const char *modemPath);
         virtual void modemPowered(bool powered) = 0;
         virtual void setModemPoweredFailed(const char *err) = 0;
-        static void handleSignal(GDBusConnection *connection,  const gchar     *sender,
-                                 const gchar     *object_path, const gchar     *interface_name,
-                                 const gchar     *signal_name, GVariant        *parameters,
-                                 gpointer         user_data);
+        // targets of the signals, see mSignals
+        void modemAddedSignal(const gchar *objectPath, GVariant *parameters);
+        void modemRemovedSignal(const gchar *objectPath, GVariant *parameters);
+        void modemPropertyChangedSignal(const gchar *objectPath, GVariant *parameters);
+        void callAddedSignal(const gchar *objectPath, GVariant *parameters);
+        void callRemovedSignal(const gchar *objectPath, GVariant *parameters);
+        void callPropertyChangedSignal(const gchar *objectPath, GVariant *parameters);
 
         //DBUS: array{object,dict} GetCalls()
         void getCalls(); //Get an array of call object paths and properties that represents the currently present calls.
         void addCall(const char *path, GVariantIter *props);
-        void removeCall(OFono::Call **call);
+        void removeCall(const char *path);
+        void removeCalls(bool notify); // removes all calls, eg. when the modem is removed, notify - whether to report them 'disconnected'
+        static bool updateCall(OFono::Call *call, const char *key, GVariant *value); // returns true, if the call has changed
+        OFono::Call *findCall(const char *state) const; // the first call in given state, or NULL
+        bool callManagerMethod(const char *method, char **error); // calls the method, with no arguments, on the VoiceCallManager of the modem
+        bool callMethod(const char *path, const char *method, char **error); // calls the method, with no arguments, on the VoiceCall
 
         // used to set property on ifaces that do have same object path, eg. Modem, CallVolume, ...
         bool setProperty(const char* iface, const char* path, const char *property, int type, void *value); // returns success of the operation
         void setPropertyAsync(const char* iface, const char* path, const char *property, int type, void *value, GAsyncReadyCallback callback);
 
         void setModemPowered(const char *path, bool powered); // path of Modem object
-        bool isModemPowered(const char *modem);
         static void asyncSetModemPoweredCallback(GObject *source, GAsyncResult *result, gpointer user_data); // async callback for "SetProperty" invoked from setModemPowered() method
-        static gboolean checkForModemPowered(gpointer user_data); // continuous timeout method to check for 'Selected' modem being Powered and power it on, if it's not
+        void schedulePowerRetry(); // schedules powering the 'Selected' modem on, if it's not Powered, the delay grows with each attempt
+        void cancelPowerRetry(); // cancels the scheduled attempt and resets the delay
+        static gboolean retryModemPowered(gpointer user_data); // single shot timeout scheduled by schedulePowerRetry()
 
         static void GDbusAsyncReadyCallback(GObject *source, GAsyncResult *result, gpointer user_data);
 
     private:
         DBusConnection               *mDBusConnection;
         gchar                        *mModemPath;
-        OFono::Call                  *mActiveCall;
+        bool                          mModemPowered;       // 'Powered' property of the 'Selected' modem
+        guint                         mPowerRetrySource;   // the scheduled attempt to power the modem on, or 0
+        guint                         mPowerRetryInterval; // delay of the last scheduled attempt (in seconds), 0 - no attempt has failed yet
+        std::unordered_map<std::string, OFono::Call*> mCalls; // path -> call
+        SignalRouter<OFono>           mSignals;
 };
 
 #endif /* OFONO_H_ */
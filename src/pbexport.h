@@ -0,0 +1,169 @@
+#ifndef PBEXPORT_H_
+#define PBEXPORT_H_
+
+/*
+ * Layout of the contacts exported by phoned into a memory-mapped file, and inline functions for the clients to read it.
+ * The header doesn't depend on phoned, nor on GLib, it can be included by C and C++ clients.
+ *
+ * The path of the file is returned by \b GetContactsExport D-Bus method of \b org.tizen.Phone interface. phoned writes each new
+ * snapshot of the contacts into a new file, which replaces the previous one, and marks the previous file as stale, so that the
+ * clients, which keep the file mapped, don't read the file again, unless it has changed:
+ *
+ *     PhonedPB pb;
+ *     if(phoned_pb_open(&pb, path) == 0) {
+ *         ...
+ *         if(phoned_pb_refresh(&pb, path) > 0) // eg. on ContactsChanged signal, or before the contacts are read
+ *             ; // the contacts have changed
+ *         for(uint32_t i = 0; i < phoned_pb_count(&pb); i++) {
+ *             const PhonedPBContact *contact = phoned_pb_contact(&pb, i);
+ *             printf("%s\n", phoned_pb_string(&pb, contact->displayName));
+ *         }
+ *         phoned_pb_close(&pb);
+ *     }
+ *
+ * The file is made of the header, the array of the contacts, the array of the phone numbers and the strings. All offsets are in bytes
+ * from the beginning of the file, except the offsets of the strings, which are from the beginning of the strings, and the indexes
+ * of the phone numbers. The strings are UTF-8, terminated by zero, offset \b 0 is an empty string. The numbers are in the byte
+ * order of the host.
+ *
+ * The photos are not written, when the contacts are exported, the file references them by their keys. The client gets the URIs of
+ * the photo and its thumbnail by \b GetContactPhoto D-Bus method, which writes the photo, once it's displayed.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PHONED_PB_MAGIC        "PBEXPORT"  /* the first 8 bytes of the file */
+#define PHONED_PB_VERSION      2           /* version of the layout, it's changed, when the layout is not compatible */
+
+typedef struct {
+    char magic[8];              /* PHONED_PB_MAGIC, not terminated */
+    uint32_t version;           /* PHONED_PB_VERSION */
+    uint32_t stale;             /* non-zero, once the file is replaced by a newer one, it's read by phoned_pb_is_stale() */
+    uint64_t generation;        /* number of the snapshot, it grows with each export */
+    uint32_t size;              /* size of the file */
+    uint32_t contactCount;
+    uint32_t contactsOffset;    /* array of contactCount PhonedPBContact-s */
+    uint32_t numberCount;
+    uint32_t numbersOffset;     /* array of numberCount offsets of the phone numbers in the strings */
+    uint32_t stringsSize;
+    uint32_t stringsOffset;
+    uint32_t reserved[3];
+} PhonedPBHeader;
+
+typedef struct {
+    uint32_t uid;               /* offsets of the strings */
+    uint32_t displayName;
+    uint32_t firstName;
+    uint32_t lastName;
+    uint32_t photo;             /* key of the photo, empty if the contact doesn't have one, see GetContactPhoto */
+    uint32_t reserved;
+    uint32_t json;              /* the contact in tizen.Contact JSON format, as returned by GetContacts, its photoURI is valid after GetContactPhoto */
+    uint32_t firstNumber;       /* index of the first phone number of the contact in the array of the phone numbers */
+    uint32_t numberCount;
+} PhonedPBContact;
+
+typedef struct {
+    const PhonedPBHeader *header; /* NULL, if the file is not open */
+    size_t size;
+} PhonedPB;
+
+/* Maps the file and validates it. Returns 0 on success, -1 otherwise. */
+static inline int phoned_pb_open(PhonedPB *pb, const char *path) {
+    pb->header = NULL;
+    pb->size = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return -1;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(PhonedPBHeader)) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the file */
+    if(data == MAP_FAILED)
+        return -1;
+
+    const PhonedPBHeader *h = (const PhonedPBHeader*)data;
+    const char *strings = (const char*)data + h->stringsOffset;
+    if(memcmp(h->magic, PHONED_PB_MAGIC, sizeof(h->magic)) || h->version != PHONED_PB_VERSION || h->size != size ||
+       h->contactsOffset > size || h->contactCount > (size - h->contactsOffset) / sizeof(PhonedPBContact) ||
+       h->numbersOffset > size || h->numberCount > (size - h->numbersOffset) / sizeof(uint32_t) ||
+       h->stringsOffset > size || h->stringsSize == 0 || h->stringsSize > size - h->stringsOffset ||
+       strings[0] || strings[h->stringsSize - 1]) {
+        munmap(data, size);
+        return -1;
+    }
+
+    pb->header = h;
+    pb->size = size;
+    return 0;
+}
+
+/* Unmaps the file. */
+static inline void phoned_pb_close(PhonedPB *pb) {
+    if(pb->header)
+        munmap((void*)pb->header, pb->size);
+    pb->header = NULL;
+    pb->size = 0;
+}
+
+/* Checks whether the file has been replaced by a newer one. */
+static inline int phoned_pb_is_stale(const PhonedPB *pb) {
+    return !pb->header || __atomic_load_n(&pb->header->stale, __ATOMIC_ACQUIRE) != 0;
+}
+
+/* Maps the newer file, if the file has been replaced. Returns 1, if the newer file is mapped, 0, if the file has not changed,
+ * -1, if the newer file can't be mapped, the previous one stays mapped then. */
+static inline int phoned_pb_refresh(PhonedPB *pb, const char *path) {
+    if(!phoned_pb_is_stale(pb))
+        return 0;
+    PhonedPB newer;
+    if(phoned_pb_open(&newer, path) < 0)
+        return -1;
+    phoned_pb_close(pb);
+    *pb = newer;
+    return 1;
+}
+
+/* Gets the number of the contacts. */
+static inline uint32_t phoned_pb_count(const PhonedPB *pb) {
+    return pb->header ? pb->header->contactCount : 0;
+}
+
+/* Gets the contact at the index, lower than phoned_pb_count(), in the order of synchronization. */
+static inline const PhonedPBContact *phoned_pb_contact(const PhonedPB *pb, uint32_t index) {
+    return (const PhonedPBContact*)((const char*)pb->header + pb->header->contactsOffset) + index;
+}
+
+/* Gets the string at the offset, eg. PhonedPBContact::displayName. Invalid offset gives an empty string. */
+static inline const char *phoned_pb_string(const PhonedPB *pb, uint32_t offset) {
+    const char *strings = (const char*)pb->header + pb->header->stringsOffset;
+    return offset < pb->header->stringsSize ? strings + offset : strings;
+}
+
+/* Gets the phone number of the contact, the index is lower than PhonedPBContact::numberCount. */
+static inline const char *phoned_pb_number(const PhonedPB *pb, const PhonedPBContact *contact, uint32_t index) {
+    uint32_t number = contact->firstNumber + index;
+    if(index >= contact->numberCount || number >= pb->header->numberCount)
+        return phoned_pb_string(pb, 0);
+    const uint32_t *numbers = (const uint32_t*)((const char*)pb->header + pb->header->numbersOffset);
+    return phoned_pb_string(pb, numbers[number]);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBEXPORT_H_ */
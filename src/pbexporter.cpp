@@ -0,0 +1,185 @@
+
+#include "pbexporter.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "Logger.h"
+
+namespace PhoneD {
+
+#define PB_EXPORT_FILE_NAME   "phoned-contacts.pb"
+
+struct ExportTask {
+    PBExporter *exporter;
+    PBSnapshotPtr snapshot;
+    guint64 generation;
+};
+
+// appends zero terminated string to the strings of the file, empty string is at the offset 0
+static guint32 addString(std::string &strings, const char *value) {
+    if(!value || !value[0])
+        return 0;
+    guint32 offset = strings.size();
+    strings.append(value);
+    strings += '\0';
+    return offset;
+}
+
+PBExporter::PBExporter() :
+    mGeneration(0),
+    mEnabled(false),
+    mPool(NULL),
+    mHeader(NULL)
+{
+    mPath = std::string(g_get_user_runtime_dir()) + "/" PB_EXPORT_FILE_NAME;
+}
+
+PBExporter::~PBExporter() {
+    // let the queued snapshots be written, so that the thread doesn't race with the removal of the file
+    if(mPool)
+        g_thread_pool_free(mPool, FALSE, TRUE);
+    if(mHeader) {
+        markStale(mHeader);
+        munmap(mHeader, sizeof(PhonedPBHeader));
+        g_unlink(mPath.c_str());
+    }
+}
+
+bool PBExporter::enable(const PBSnapshotPtr &snapshot) {
+    if(mEnabled)
+        return true;
+
+    // the first snapshot is written immediately, so that the client finds the file, the pool is not running yet
+    if(!write(*snapshot, ++mGeneration))
+        return false;
+
+    mPool = g_thread_pool_new(PBExporter::exportSnapshot, NULL, 1, FALSE, NULL);
+    mEnabled = true;
+    LoggerD("Contacts are exported into " << mPath);
+    return true;
+}
+
+void PBExporter::publish(const PBSnapshotPtr &snapshot) {
+    if(!mEnabled)
+        return;
+
+    ExportTask *task = new ExportTask;
+    task->exporter = this;
+    task->snapshot = snapshot;
+    task->generation = ++mGeneration;
+    g_thread_pool_push(mPool, task, NULL);
+}
+
+// runs on the thread of the pool
+void PBExporter::exportSnapshot(gpointer data, gpointer user_data) {
+    ExportTask *task = static_cast<ExportTask*>(data);
+    if(!task)
+        return;
+
+    task->exporter->write(*task->snapshot, task->generation);
+    delete task;
+}
+
+bool PBExporter::write(const PBSnapshot &snapshot, guint64 generation) {
+    std::vector<PhonedPBContact> contacts;
+    std::vector<guint32> numbers;
+    std::string strings(1, '\0');
+    contacts.reserve(snapshot.entries.size());
+
+    for(size_t i=0; i<snapshot.entries.size(); i++) {
+        const PBEntry &entry = *snapshot.entries.at(i);
+
+        PhonedPBContact contact;
+        memset(&contact, 0, sizeof(contact));
+        contact.uid = addString(strings, entry.uid.c_str());
+        contact.displayName = addString(strings, entry.record.get(ContactRecord::FULL_NAME));
+        contact.firstName = addString(strings, entry.record.get(ContactRecord::GIVEN_NAME));
+        contact.lastName = addString(strings, entry.record.get(ContactRecord::FAMILY_NAME));
+        contact.photo = addString(strings, entry.photo.c_str());
+        contact.json = addString(strings, entry.json.c_str());
+
+        contact.firstNumber = numbers.size();
+        for(unsigned int n=0; n<entry.record.numberCount(); n++)
+            numbers.push_back(addString(strings, entry.record.number(n)));
+        contact.numberCount = numbers.size() - contact.firstNumber;
+
+        contacts.push_back(contact);
+    }
+
+    PhonedPBHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PHONED_PB_MAGIC, sizeof(header.magic));
+    header.version = PHONED_PB_VERSION;
+    header.generation = generation;
+    header.contactCount = contacts.size();
+    header.contactsOffset = sizeof(header);
+    header.numberCount = numbers.size();
+    header.numbersOffset = header.contactsOffset + contacts.size() * sizeof(PhonedPBContact);
+    header.stringsSize = strings.size();
+    header.stringsOffset = header.numbersOffset + numbers.size() * sizeof(guint32);
+    header.size = header.stringsOffset + strings.size();
+
+    std::string image;
+    image.reserve(header.size);
+    image.append((const char*)&header, sizeof(header));
+    if(!contacts.empty())
+        image.append((const char*)&contacts[0], contacts.size() * sizeof(PhonedPBContact));
+    if(!numbers.empty())
+        image.append((const char*)&numbers[0], numbers.size() * sizeof(guint32));
+    image += strings;
+
+    // the file left by previous run of the daemon is replaced too
+    if(!mHeader)
+        mHeader = mapHeader(mPath.c_str());
+
+    // the file is written into a temporary file, which is renamed, so that the clients never map partially written file
+    GError *err = NULL;
+    if(!g_file_set_contents(mPath.c_str(), image.data(), image.size(), &err)) {
+        LoggerE("Failed to export contacts into " << mPath << ": " << (err?err->message:"unknown error"));
+        if(err)
+            g_error_free(err);
+        return false;
+    }
+
+    // the clients, which map the previous file, map the new one
+    if(mHeader) {
+        markStale(mHeader);
+        munmap(mHeader, sizeof(PhonedPBHeader));
+    }
+    mHeader = mapHeader(mPath.c_str());
+
+    LoggerD("Exported " << contacts.size() << " contacts, generation " << generation);
+    return true;
+}
+
+PhonedPBHeader *PBExporter::mapHeader(const char *path) {
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if(fd < 0)
+        return NULL;
+
+    PhonedPBHeader *header = NULL;
+    struct stat st;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(PhonedPBHeader)) {
+        void *data = mmap(NULL, sizeof(PhonedPBHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(data != MAP_FAILED)
+            header = static_cast<PhonedPBHeader*>(data);
+        else
+            LoggerE("Failed to map " << path << ": " << strerror(errno));
+    }
+    close(fd);
+
+    if(header && memcmp(header->magic, PHONED_PB_MAGIC, sizeof(header->magic))) {
+        munmap(header, sizeof(PhonedPBHeader));
+        header = NULL;
+    }
+    return header;
+}
+
+void PBExporter::markStale(PhonedPBHeader *header) {
+    __atomic_store_n(&header->stale, 1, __ATOMIC_RELEASE);
+}
+
+} // PhoneD
+
@@ -0,0 +1,84 @@
+#ifndef PBEXPORTER_H_
+#define PBEXPORTER_H_
+
+#include <glib.h>
+#include <string>
+
+#include "pbexport.h"
+#include "pbsnapshot.h"
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::PBExporter
+ *  \brief Exports snapshots of the contacts into a memory-mapped file, so that more clients share one read-only copy of the contacts.
+ *
+ * The file is \b $XDG_RUNTIME_DIR/phoned-contacts.pb and its layout is described in pbexport.h, which the clients include to read it.
+ * Each snapshot is written into a new file, which atomically replaces the previous one, and the previous file is marked as stale
+ * afterwards, so that the clients mapping it check a flag in the memory to know, that they should map the file again. The export is
+ * enabled by the first client asking for it, the following snapshots are written on a background thread, one at a time.
+ * The photos are exported by their keys in PhotoStore, they are written only once a client asks for them, see Obex::getContactPhoto().
+ */
+class PBExporter {
+    public:
+        /**
+         * A default constructor. The export is disabled, until enable() is called.
+         */
+        PBExporter();
+
+        /**
+         * A destructor. Waits for the export in progress, marks the file as stale and removes it.
+         */
+        ~PBExporter();
+
+        /**
+         * Enables the export, if it's not enabled yet, and writes the snapshot immediately.
+         * @param[in] snapshot The current snapshot of the contacts.
+         * @return \b True, if the export is enabled.
+         */
+        bool enable(const PBSnapshotPtr &snapshot);
+
+        /**
+         * Queues the snapshot to be exported, if the export is enabled. It must be called from the main thread.
+         * @param[in] snapshot The snapshot of the contacts, which has been published.
+         */
+        void publish(const PBSnapshotPtr &snapshot);
+
+        /**
+         * Gets the path of the exported file.
+         * @return The path.
+         */
+        const std::string &getPath() const { return mPath; }
+
+        /**
+         * Gets the number of the last snapshot queued to be exported, see PhonedPBHeader::generation.
+         * @return The number of the snapshot.
+         */
+        guint64 getGeneration() const { return mGeneration; }
+
+    private:
+        // writes the snapshot into the file and marks the previous file as stale
+        bool write(const PBSnapshot &snapshot, guint64 generation);
+        // maps the header of the exported file to mark it as stale later, NULL if it's not valid
+        static PhonedPBHeader *mapHeader(const char *path);
+        static void markStale(PhonedPBHeader *header);
+        static void exportSnapshot(gpointer data, gpointer user_data);
+
+    private:
+        std::string mPath;
+        guint64 mGeneration;     // the last queued snapshot
+        bool mEnabled;
+        GThreadPool *mPool;      // a single thread writing the queued snapshots
+        PhonedPBHeader *mHeader; // header of the current file, mapped writable, it's accessed only by the thread writing the file
+};
+
+} // PhoneD
+
+#endif /* PBEXPORTER_H_ */
+
+/** @} */
+
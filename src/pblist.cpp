@@ -0,0 +1,35 @@
+
+#include "pblist.h"
+
+namespace PhoneD {
+
+const PBEntry *PBList::find(const std::string &uid) const {
+    auto it = mItems.find(&uid);
+    return (it != mItems.end()) ? (*it).second : NULL;
+}
+
+bool PBList::insert(size_t index, const PBEntryPtr &entry) {
+    if(!entry)
+        return false;
+
+    // the key points to UID of the entry, which lives as long as the list references the entry
+    auto result = mItems.insert(std::make_pair(&entry->uid, entry.get()));
+    if(!result.second) // the entry with the same UID already exists
+        return false;
+
+    if(index > mOrder.size())
+        index = mOrder.size();
+    mOrder.insert(mOrder.begin() + index, entry);
+
+    return true;
+}
+
+void PBList::truncate(size_t size) {
+    while(mOrder.size() > size) {
+        mItems.erase(&mOrder.back()->uid); // the key is removed before the entry, which owns it
+        mOrder.pop_back();
+    }
+}
+
+} // PhoneD
+
@@ -0,0 +1,128 @@
+#ifndef PBLIST_H_
+#define PBLIST_H_
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+#include "contactrecord.h"
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::PBEntry
+ * A Class to store synchronized phonebook entry (contact, or call history entry) together with its JSON representation.
+ * The entry is filled in once, when it is ingested, and it is not modified after it is inserted into PBList, so that it can be shared by more lists.
+ */
+class PBEntry {
+    public:
+        /**
+         * A default constructor. Constructs an empty entry.
+         */
+        PBEntry() {}
+    private:
+        PBEntry(const PBEntry&);
+        PBEntry &operator=(const PBEntry&);
+    public:
+        std::string uid;        /*!< UID of the entry, the key of the entry in PBList. */
+        ContactRecord record;   /*!< The fields of the entry, the EContact it's made of is not kept. */
+        std::string json;       /*!< The entry serialized as \b tizen.Contact, or \b tizen.CallHistoryEntry JSON, made once the entry is ingested. */
+        std::string photo;      /*!< Key of the contact photo in PhotoStore, or empty if the contact doesn't have a photo. */
+};
+
+/**
+ * A shared reference to the immutable entry.
+ */
+typedef std::shared_ptr<const PBEntry> PBEntryPtr;
+
+/*! \class PhoneD::PBList
+ *  \brief Ordered list of phonebook entries with look-up by UID.
+ *
+ * The entries are kept in the order they are synchronized, which is the order they are returned to the clients. Inserting near the front
+ * of the list (new calls in the call history) and at the back (first synchronization) is cheap, and the entries can be accessed by the index
+ * for paging. UID of each entry is stored only once, in the entry, and the hash map is keyed by the pointer to it. The entries are shared,
+ * ie. a copy of the list references the same entries.
+ */
+class PBList {
+    public:
+        /**
+         * A default constructor. Constructs an empty list.
+         */
+        PBList() {}
+
+        /**
+         * Looks-up the entry by its UID.
+         * @param[in] uid UID of the entry.
+         * @return The entry, or \b NULL if there isn't an entry with given UID in the list. The entry is valid as long as the list references it.
+         */
+        const PBEntry *find(const std::string &uid) const;
+
+        /**
+         * Inserts the entry at given position.
+         * @param[in] index Position of the entry in the list, it is clamped to the size of the list.
+         * @param[in] entry The entry to be inserted, it has to have the UID set.
+         * @return \b False, if there already is an entry with the same UID in the list.
+         */
+        bool insert(size_t index, const PBEntryPtr &entry);
+
+        /**
+         * Appends the entry at the end of the list.
+         * @param[in] entry The entry to be appended, it has to have the UID set.
+         * @return \b False, if there already is an entry with the same UID in the list.
+         */
+        bool pushBack(const PBEntryPtr &entry) { return insert(mOrder.size(), entry); }
+
+        /**
+         * Gets the entry at given position.
+         * @param[in] index Position of the entry, it has to be lower than size().
+         * @return The entry.
+         */
+        const PBEntryPtr &at(size_t index) const { return mOrder[index]; }
+
+        /**
+         * Gets the number of entries in the list.
+         * @return The number of entries.
+         */
+        size_t size() const { return mOrder.size(); }
+
+        /**
+         * Removes the entries at the end of the list, so that it has at most given number of entries.
+         * @param[in] size The number of entries to be kept.
+         */
+        void truncate(size_t size);
+        /**
+         * Removes all entries from the list.
+         */
+        void clear() { mItems.clear(); mOrder.clear(); }
+
+        /**
+         * Exchanges the entries with other list.
+         * @param[in,out] other The list to exchange the entries with.
+         */
+        void swap(PBList &other) { mItems.swap(other.mItems); mOrder.swap(other.mOrder); }
+
+    private:
+        // hashes/compares the UIDs the keys point to
+        struct UidHash {
+            size_t operator()(const std::string *uid) const { return std::hash<std::string>()(*uid); }
+        };
+        struct UidEqual {
+            bool operator()(const std::string *a, const std::string *b) const { return *a == *b; }
+        };
+
+    private:
+        std::unordered_map<const std::string*, const PBEntry*, UidHash, UidEqual> mItems; // uid (owned by the entry) -> entry
+        std::deque<PBEntryPtr> mOrder;
+};
+
+} // PhoneD
+
+#endif /* PBLIST_H_ */
+
+/** @} */
+
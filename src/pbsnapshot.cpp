@@ -0,0 +1,120 @@
+
+#include "pbsnapshot.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace PhoneD {
+
+PBSnapshot::PBSnapshot() :
+    mJsonValid(false)
+{
+    g_mutex_init(&mCacheLock);
+}
+
+PBSnapshot::~PBSnapshot() {
+    g_mutex_clear(&mCacheLock);
+}
+
+void PBSnapshot::indexContact(const PBEntry &entry) {
+    for(unsigned int i = 0; i<entry.record.numberCount(); ++i)
+        numbers.addNormalized(entry.record.normalizedNumber(i), entry.uid);
+
+    search.add(&entry);
+}
+
+void PBSnapshot::getEntries(unsigned long offset, unsigned long limit, std::vector<const PBEntry*> &result) const {
+    result.clear();
+    if(offset >= entries.size())
+        return;
+
+    // limit == 0, ie. all entries from the offset
+    unsigned long count = (limit>0 && limit<entries.size()-offset)?limit:entries.size()-offset;
+    result.reserve(count);
+    for(unsigned long i = offset; i<offset+count; ++i)
+        result.push_back(entries.at(i).get());
+}
+
+const std::string &PBSnapshot::getJson() const {
+    g_mutex_lock(&mCacheLock);
+    if(!mJsonValid) {
+        std::vector<const PBEntry*> all;
+        getEntries(0, 0, all);
+        makeJsonArray(all, mJson);
+        mJsonValid = true;
+    }
+    g_mutex_unlock(&mCacheLock);
+    return mJson;
+}
+
+const std::vector<const PBEntry*> *PBSnapshot::getSorted(const char *sortKey) const {
+    ContactRecord::Field field;
+    if(!strcmp(sortKey, "firstName"))
+        field = ContactRecord::GIVEN_NAME;
+    else if(!strcmp(sortKey, "lastName"))
+        field = ContactRecord::FAMILY_NAME;
+    else if(!strcmp(sortKey, "displayName"))
+        field = ContactRecord::FULL_NAME;
+    else
+        return NULL;
+
+    // sorted order is made on first request and kept for the lifetime of the snapshot
+    g_mutex_lock(&mCacheLock);
+    auto cached = mSorted.find(sortKey);
+    if(cached != mSorted.end()) {
+        g_mutex_unlock(&mCacheLock);
+        return &(*cached).second;
+    }
+
+    // collation keys are made only once per contact, not per comparison
+    std::vector<std::pair<std::string, const PBEntry*> > keys;
+    keys.reserve(entries.size());
+    for(unsigned int i = 0; i<entries.size(); ++i) {
+        const PBEntry *entry = entries.at(i).get();
+        const char *name = entry->record.get(field);
+        std::string key;
+        if(name) {
+            gchar *collationKey = g_utf8_collate_key(name, -1);
+            key = "1"; // contacts with the name go first
+            key += collationKey;
+            g_free(collationKey);
+        }
+        else {
+            key = "2"; // contacts without the name go last, in the order of synchronization
+        }
+        keys.push_back(std::make_pair(key, entry));
+    }
+    std::stable_sort(keys.begin(), keys.end(),
+                     [](const std::pair<std::string, const PBEntry*> &a, const std::pair<std::string, const PBEntry*> &b) {
+                         return a.first < b.first;
+                     });
+
+    // references to the elements of std::map are stable
+    std::vector<const PBEntry*> &sorted = mSorted[sortKey];
+    sorted.reserve(keys.size());
+    for(unsigned int i = 0; i<keys.size(); ++i)
+        sorted.push_back(keys[i].second);
+    g_mutex_unlock(&mCacheLock);
+
+    return &sorted;
+}
+
+void PBSnapshot::makeJsonArray(const std::vector<const PBEntry*> &entries, std::string &array) {
+    // pre-size the buffer, so that appending the entries doesn't re-allocate it
+    size_t length = 2;
+    for(unsigned int i = 0; i<entries.size(); ++i)
+        length += entries[i]->json.length() + 1;
+
+    array.clear();
+    array.reserve(length);
+    array += "[";
+    for(unsigned int i = 0; i<entries.size(); ++i) {
+        if(i != 0) // exclude ',' for the first entry
+            array += ",";
+        array += entries[i]->json;
+    }
+    array += "]";
+}
+
+} // PhoneD
+
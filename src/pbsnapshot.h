@@ -0,0 +1,107 @@
+#ifndef PBSNAPSHOT_H_
+#define PBSNAPSHOT_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "pblist.h"
+#include "phonenumberindex.h"
+#include "contactsearchindex.h"
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::PBSnapshot
+ *  \brief Immutable snapshot of synchronized contacts, or call history.
+ *
+ * A snapshot is built off to the side, eg. when received VCards are merged with the synchronized entries, and published once it is
+ * complete, by replacing the reference to the current snapshot. The readers take a reference to the current snapshot and use it for the
+ * whole request, so that they never see partially built entries and they are not blocked by the synchronization. The entries are shared
+ * with the snapshots built from this one. JSON array of all entries and sorted orders of the entries are made on first request and kept
+ * for the lifetime of the snapshot, they are the only state, which changes once the snapshot is published, and it's guarded by a lock.
+ */
+class PBSnapshot {
+    public:
+        /**
+         * A default constructor. Constructs an empty snapshot.
+         */
+        PBSnapshot();
+
+        /**
+         * A destructor.
+         */
+        ~PBSnapshot();
+
+        /**
+         * Adds the contact to PBSnapshot::numbers and PBSnapshot::search. It must be called only before the snapshot is published.
+         * @param[in] entry The contact, which is in PBSnapshot::entries.
+         */
+        void indexContact(const PBEntry &entry);
+
+        /**
+         * Completes the indexes, once all entries are added. It must be called before the snapshot is published.
+         */
+        void prepare() { search.prepare(); }
+
+        /**
+         * Gets up to \b limit entries starting at \b offset, in the order of synchronization.
+         * @param[in] offset Index of the first entry.
+         * @param[in] limit Maximum number of entries, \b 0 means all entries from the \b offset.
+         * @param[out] entries A container for the entries. They are valid as long as the snapshot.
+         */
+        void getEntries(unsigned long offset, unsigned long limit, std::vector<const PBEntry*> &entries) const;
+
+        /**
+         * Gets JSON array of all entries.
+         * @return The JSON array, it's valid as long as the snapshot.
+         */
+        const std::string &getJson() const;
+
+        /**
+         * Gets the contacts sorted by given key.
+         * @param[in] sortKey Sort key: \b "firstName", \b "lastName", or \b "displayName". Contacts without the name go last, in the order of synchronization.
+         * @return The sorted contacts valid as long as the snapshot, or \b NULL if the sort key is not valid.
+         */
+        const std::vector<const PBEntry*> *getSorted(const char *sortKey) const;
+
+        /**
+         * Makes JSON array from already serialized entries.
+         * @param[in] entries The entries.
+         * @param[out] array A container for the JSON array.
+         */
+        static void makeJsonArray(const std::vector<const PBEntry*> &entries, std::string &array);
+
+    public:
+        PBList entries;           /*!< The entries in the order of synchronization, ie. the latest call first. */
+        PhoneNumberIndex numbers; /*!< Phone numbers of the contacts, for caller look-up. It's empty for the call history. */
+        ContactSearchIndex search; /*!< Names and phone numbers of the contacts, for type-ahead search. It's empty for the call history. */
+
+    private:
+        PBSnapshot(const PBSnapshot&);
+        PBSnapshot &operator=(const PBSnapshot&);
+
+    private:
+        mutable GMutex mCacheLock; // guards the caches below
+        mutable bool mJsonValid;
+        mutable std::string mJson;
+        mutable std::map<std::string, std::vector<const PBEntry*> > mSorted; // sort key -> sorted contacts
+};
+
+/**
+ * A shared reference to the immutable snapshot.
+ */
+typedef std::shared_ptr<const PBSnapshot> PBSnapshotPtr;
+
+} // PhoneD
+
+#endif /* PBSNAPSHOT_H_ */
+
+/** @} */
+
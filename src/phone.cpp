@@ -1,9 +1,17 @@
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <glib/gstdio.h>
+#include <gio/gunixfdlist.h>
 #include <fstream>
 #include <algorithm>
 
 #include "phone.h"
 #include "utils.h"
+#include "jsonwriter.h"
 
 #include "Logger.h"
 
@@ -21,6 +29,21 @@ namespace PhoneD {
 
 #define CALLHISTORY_UPDATED_SYNC_COUNT     10   // number of latest CallHistory entries to be requested from the phone
 
+#define LATENCY_PROBE_INTERVAL             100  // interval of the timer measuring delay of the main loop (in ms)
+
+// older C library headers don't define memfd_create() flags and file seals
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC                        0x0001U
+#define MFD_ALLOW_SEALING                  0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS                        1033
+#define F_SEAL_SEAL                        0x0001
+#define F_SEAL_SHRINK                      0x0002
+#define F_SEAL_GROW                        0x0004
+#define F_SEAL_WRITE                       0x0008
+#endif
+
 #define PHONE_INTERFACE_XML                                     \
     "<node>"                                                    \
     "  <interface name='" PHONE_IFACE "'>"                      \
@@ -45,6 +68,17 @@ namespace PhoneD {
     "    <method name='ActiveCall'>"                            \
     "      <arg type='a{sv}' name='call' direction='out'/>"     \
     "    </method>"                                             \
+    "    <method name='GetCalls'>"                              \
+    "      <arg type='aa{sv}' name='calls' direction='out'/>"   \
+    "    </method>"                                             \
+    "    <method name='SwapCalls'>"                             \
+    "    </method>"                                             \
+    "    <method name='HoldAndAnswer'>"                         \
+    "    </method>"                                             \
+    "    <method name='ReleaseAndAnswer'>"                      \
+    "    </method>"                                             \
+    "    <method name='MergeCalls'>"                            \
+    "    </method>"                                             \
     "    <method name='Synchronize'>"                           \
     "    </method>"                                             \
     "    <method name='GetContacts'>"                           \
@@ -55,6 +89,52 @@ namespace PhoneD {
     "      <arg type='u' name='count' direction='in'/>"         \
     "      <arg type='s' name='calls' direction='out'/>"        \
     "    </method>"                                             \
+    "    <method name='GetContactsRange'>"                      \
+    "      <arg type='u' name='offset' direction='in'/>"        \
+    "      <arg type='u' name='limit' direction='in'/>"         \
+    "      <arg type='s' name='sortKey' direction='in'/>"       \
+    "      <arg type='s' name='contacts' direction='out'/>"     \
+    "    </method>"                                             \
+    "    <method name='GetContactsVariant'>"                    \
+    "      <arg type='u' name='offset' direction='in'/>"        \
+    "      <arg type='u' name='limit' direction='in'/>"         \
+    "      <arg type='s' name='sortKey' direction='in'/>"       \
+    "      <arg type='aa{sv}' name='contacts' direction='out'/>"\
+    "    </method>"                                             \
+    "    <method name='GetContactsFd'>"                         \
+    "      <arg type='u' name='offset' direction='in'/>"        \
+    "      <arg type='u' name='limit' direction='in'/>"         \
+    "      <arg type='s' name='sortKey' direction='in'/>"       \
+    "      <arg type='h' name='fd' direction='out'/>"           \
+    "      <arg type='t' name='size' direction='out'/>"         \
+    "    </method>"                                             \
+    "    <method name='GetContactsExport'>"                     \
+    "      <arg type='s' name='path' direction='out'/>"         \
+    "      <arg type='t' name='generation' direction='out'/>"   \
+    "    </method>"                                             \
+    "    <method name='GetContactPhoto'>"                       \
+    "      <arg type='s' name='key' direction='in'/>"           \
+    "      <arg type='s' name='photoURI' direction='out'/>"     \
+    "      <arg type='s' name='thumbnailURI' direction='out'/>" \
+    "    </method>"                                             \
+    "    <method name='GetCallHistoryRange'>"                   \
+    "      <arg type='u' name='offset' direction='in'/>"        \
+    "      <arg type='u' name='limit' direction='in'/>"         \
+    "      <arg type='s' name='calls' direction='out'/>"        \
+    "    </method>"                                             \
+    "    <method name='SearchContacts'>"                        \
+    "      <arg type='s' name='query' direction='in'/>"         \
+    "      <arg type='u' name='limit' direction='in'/>"         \
+    "      <arg type='s' name='contacts' direction='out'/>"     \
+    "    </method>"                                             \
+    "    <method name='PredictContacts'>"                       \
+    "      <arg type='s' name='digits' direction='in'/>"        \
+    "      <arg type='u' name='limit' direction='in'/>"         \
+    "      <arg type='s' name='contacts' direction='out'/>"     \
+    "    </method>"                                             \
+    "    <method name='GetStatistics'>"                         \
+    "      <arg type='s' name='statistics' direction='out'/>"   \
+    "    </method>"                                             \
     "  </interface>"                                            \
     "</node>"
 
@@ -65,7 +145,7 @@ Signals:
        "ContactsChanged"       : ""
        "CallHistoryChanged"    : ""
        "CallHistoryEntryAdded" : "(s)" ... tizen.CallHistoryEntry
-       "CallChanged"           : "(a{sv})" ... "state", "line_id", "contact"
+       "CallChanged"           : "(a{sv})" ... "path", "state", "line_id", "multiparty", "contact"
 */
 
 Phone::Phone() :
@@ -79,7 +159,9 @@ Phone::Phone() :
     mPBSynchronized(false),
     mNameRequestId(0),
     mRegistrationId(0),
-    mIntrospectionData(NULL)
+    mIntrospectionData(NULL),
+    mLatencyProbeTimer(0),
+    mLatencyProbeTime(0)
 {
     LoggerD("entered");
 
@@ -113,8 +195,12 @@ Phone::Phone() :
 
 Phone::~Phone() {
     LoggerD("entered");
+    if(mLatencyProbeTimer > 0) {
+        g_source_remove(mLatencyProbeTimer);
+        mLatencyProbeTimer = 0;
+    }
     if(mRegistrationId > 0) {
-        g_dbus_connection_unregister_object(g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL), mRegistrationId);
+        g_dbus_connection_unregister_object(BusConnection::get(G_BUS_TYPE_SESSION), mRegistrationId);
         LoggerD("Unregistered object with id: " << mRegistrationId);
         mRegistrationId = 0;
     }
@@ -179,9 +265,10 @@ void Phone::setup() {
         LoggerE("Failed to create introspection data from XML");
         return;
     }
+    makeMethods();
 
     GError *error = NULL;
-    mRegistrationId = g_dbus_connection_register_object( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    mRegistrationId = g_dbus_connection_register_object( BusConnection::get(G_BUS_TYPE_SESSION),
                                                          PHONE_OBJ_PATH,
                                                          mIntrospectionData->interfaces[0],
                                                          &mIfaceVTable,
@@ -195,6 +282,10 @@ void Phone::setup() {
         return;
     }
 
+    // measure how long the main loop is blocked, see GetStatistics method
+    mLatencyProbeTime = g_get_monotonic_time() + LATENCY_PROBE_INTERVAL*1000;
+    mLatencyProbeTimer = g_timeout_add(LATENCY_PROBE_INTERVAL, Phone::latencyProbe, this);
+
     // Obex/OFono needs an agent to be registered on DBus
     // TODO: implement a check whether agent is registered and running
     // NOTE: if the device is not yet paired, you need to pair it first
@@ -236,6 +327,9 @@ void Phone::defaultAdapterRemoved() {
 void Phone::startServices() {
     std::string device = "";
     setSelectedRemoteDevice(device);
+    // serve the contacts/call history stored on previous synchronization, until the device is synchronized again
+    if(!mWantedRemoteDevice.empty())
+        loadPhonebookCache(mWantedRemoteDevice.c_str());
     // select the modem for the 'wanted' device - once the modem is found, it is
     // set 'Powered' ON, which will call 'modemPowered', from where 'createSession' is called
     selectModem(mWantedRemoteDevice);
@@ -304,13 +398,20 @@ void Phone::modemPowered(bool powered) {
     }
 }
 
+// makes the result of selecting the remote device, ie. {"value":"..."}, or {"error":"..."}
+static void makeResult(const char *name, const char *value, std::string &result) {
+    result.clear();
+    JsonWriter json(result);
+    json.beginObject();
+    json.string(name, value);
+    json.endObject();
+}
+
 void Phone::setModemPoweredFailed(const char *error) {
     LoggerD("SelectModem failed: " << error);
-    std::string result("");
-    result += "{\"error\":\"";
-    result += (error?error:"Unknown error");
-    result += "\"}";
-    g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    std::string result;
+    makeResult("error", error?error:"Unknown error", result);
+    g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                    NULL,
                                    PHONE_OBJ_PATH,
                                    PHONE_IFACE,
@@ -321,11 +422,9 @@ void Phone::setModemPoweredFailed(const char *error) {
 
 void Phone::createSessionFailed(const char *error) {
     LoggerD("CreateSession failed: " << error);
-    std::string result("");
-    result += "{\"error\":\"";
-    result += (error?error:"Unknown error");
-    result += "\"}";
-    g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    std::string result;
+    makeResult("error", error?error:"Unknown error", result);
+    g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                    NULL,
                                    PHONE_OBJ_PATH,
                                    PHONE_IFACE,
@@ -342,11 +441,9 @@ void Phone::createSessionDone(const char *session) {
     setSelectedRemoteDevice(mWantedRemoteDevice);
 
     // emit signal that the remote device has been selected
-    std::string result("");
-    result += "{\"value\":\"";
-    result += mSelectedRemoteDevice;
-    result += "\"}";
-    g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    std::string result;
+    makeResult("value", mSelectedRemoteDevice.c_str(), result);
+    g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                    NULL,
                                    PHONE_OBJ_PATH,
                                    PHONE_IFACE,
@@ -355,14 +452,15 @@ void Phone::createSessionDone(const char *session) {
                                    NULL);
 
     LoggerD("starting synchronization process: contacts/call history");
-    /*Obex::Error err = */syncContacts();
-    /*Obex::Error err = */syncCallHistory();
+    // pull only what has changed since the last synchronization, eg. the entries loaded from the cache
+    /*Obex::Error err = */syncContacts(0, true);
+    /*Obex::Error err = */syncCallHistory(0, true);
 }
 
 void Phone::removeSessionDone() {
     LoggerD("entered");
 
-    g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                    NULL,
                                    PHONE_OBJ_PATH,
                                    PHONE_IFACE,
@@ -371,7 +469,7 @@ void Phone::removeSessionDone() {
                                    NULL);
 
     // cleared list of contacts
-    g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                    NULL,
                                    PHONE_OBJ_PATH,
                                    PHONE_IFACE,
@@ -380,7 +478,7 @@ void Phone::removeSessionDone() {
                                    NULL);
 
     // cleared call history
-    g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                    NULL,
                                    PHONE_OBJ_PATH,
                                    PHONE_IFACE,
@@ -416,7 +514,7 @@ void Phone::callHistoryEntryAdded(std::string &entry) {
     // per entry in the call history list
     // only newly placed/received calls will be emited
     if(mPBSynchronized) {
-        g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+        g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                        NULL,
                                        PHONE_OBJ_PATH,
                                        PHONE_IFACE,
@@ -434,7 +532,7 @@ void Phone::contactsChanged() {
     // this signal is to notify client app that contacts list has chaned, eg. as
     // a result of selecting other remote device via 'selectRemoteDevice' method
     if(!mPBSynchronized) {
-        g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+        g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                        NULL,
                                        PHONE_OBJ_PATH,
                                        PHONE_IFACE,
@@ -453,7 +551,7 @@ void Phone::callHistoryChanged() {
     // this signal is to notify client app that contacts list has chaned, eg. as
     // a result of selecting other remote device via 'selectRemoteDevice' method
     if(!mPBSynchronized) {
-        g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+        g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                        NULL,
                                        PHONE_OBJ_PATH,
                                        PHONE_IFACE,
@@ -466,6 +564,44 @@ void Phone::callHistoryChanged() {
 void Phone::pbSynchronizationDone() {
     LoggerD("PB synchronization DONE");
     mPBSynchronized = true;
+    storePhonebookCache(mSelectedRemoteDevice.c_str());
+}
+
+// writes the data to an anonymous memory file, which is passed to the client by D-Bus fd-passing;
+// the file is sealed, if the kernel supports it, so that the client can map it safely
+static int makeMemoryFile(gconstpointer data, gsize size) {
+    int fd = -1;
+#ifdef __NR_memfd_create
+    fd = syscall(__NR_memfd_create, "phoned-contacts", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+    if(fd < 0) { // the kernel doesn't support memfd, use unlinked temporary file instead
+        gchar *path = NULL;
+        fd = g_file_open_tmp("phoned-contacts-XXXXXX", &path, NULL);
+        if(fd < 0) {
+            LoggerE("Failed to create the memory file");
+            return -1;
+        }
+        g_unlink(path);
+        g_free(path);
+    }
+
+    const char *buffer = static_cast<const char*>(data);
+    gsize written = 0;
+    while(written < size) {
+        ssize_t ret = write(fd, buffer + written, size - written);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0) {
+            LoggerE("Failed to write the memory file: " << strerror(errno));
+            close(fd);
+            return -1;
+        }
+        written += ret;
+    }
+
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL); // fails on the temporary file
+    lseek(fd, 0, SEEK_SET);
+    return fd;
 }
 
 void Phone::handleMethodCall( GDBusConnection       *connection,
@@ -485,245 +621,568 @@ void Phone::handleMethodCall( GDBusConnection       *connection,
         return;
     }
 
-    if(!strcmp(method_name, "SelectRemoteDevice")) {
-        char *btAddress = NULL;
-        g_variant_get(parameters, "(&s)", &btAddress);
-        if(!btAddress || !isValidMAC(std::string(btAddress))) {
-            LoggerE("Won't select remote device: given MAC address \"" << btAddress << "\" is not valid");
-            g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
-                                           NULL,
-                                           PHONE_OBJ_PATH,
-                                           PHONE_IFACE,
-                                           "RemoteDeviceSelected",
-                                           g_variant_new("(s)", "{\"error\":\"Invalid MAC address\"}"),
-                                           NULL);
+    // GDBus has already checked the arguments against the introspection data
+    auto it = phone->mMethods.find(method_name);
+    if(it == phone->mMethods.end()) {
+        LoggerE("Unknown method: " << method_name);
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD, "Unknown method: %s", method_name);
+        return;
+    }
+    Method &method = (*it).second;
+
+    gint64 started = g_get_monotonic_time();
+    method.handler(phone, parameters, invocation);
+    gint64 duration = g_get_monotonic_time() - started;
+    method.latency.add(duration);
+    phone->mMethodLatency[phone->isSynchronizing() ? LATENCY_SYNC : LATENCY_IDLE].add(duration);
+}
+
+void Phone::makeMethods() {
+    static const struct {
+        const char *name;
+        MethodHandler handler;
+    } handlers[] = {
+        { "SelectRemoteDevice",       Phone::handleSelectRemoteDevice },
+        { "GetSelectedRemoteDevice",  Phone::handleGetSelectedRemoteDevice },
+        { "UnselectRemoteDevice",     Phone::handleUnselectRemoteDevice },
+        { "Dial",                     Phone::handleDial },
+        { "Answer",                   Phone::handleAnswer },
+        { "Hangup",                   Phone::handleHangup },
+        { "Mute",                     Phone::handleMute },
+        { "ActiveCall",               Phone::handleActiveCall },
+        { "GetCalls",                 Phone::handleGetCalls },
+        { "SwapCalls",                Phone::handleSwapCalls },
+        { "HoldAndAnswer",            Phone::handleHoldAndAnswer },
+        { "ReleaseAndAnswer",         Phone::handleReleaseAndAnswer },
+        { "MergeCalls",               Phone::handleMergeCalls },
+        { "Synchronize",              Phone::handleSynchronize },
+        { "GetContacts",              Phone::handleGetContacts },
+        { "GetCallHistory",           Phone::handleGetCallHistory },
+        { "GetContactsRange",         Phone::handleGetContactsRange },
+        { "GetContactsVariant",       Phone::handleGetContactsVariant },
+        { "GetContactsFd",            Phone::handleGetContactsFd },
+        { "GetContactsExport",        Phone::handleGetContactsExport },
+        { "GetContactPhoto",          Phone::handleGetContactPhoto },
+        { "GetCallHistoryRange",      Phone::handleGetCallHistoryRange },
+        { "SearchContacts",           Phone::handleSearchContacts },
+        { "PredictContacts",          Phone::handlePredictContacts },
+        { "GetStatistics",            Phone::handleGetStatistics },
+    };
+
+    mMethods.clear();
+    GDBusInterfaceInfo *iface = mIntrospectionData->interfaces[0];
+    for(unsigned int i=0; i<sizeof(handlers)/sizeof(handlers[0]); i++) {
+        GDBusMethodInfo *info = g_dbus_interface_info_lookup_method(iface, handlers[i].name);
+        if(!info) {
+            LoggerE("Method " << handlers[i].name << " is not declared in the interface");
+            continue;
         }
-        else {
-            LoggerD("Selecting remote device: " << btAddress);
-
-            // check whether requested device is not yet selected
-            // if so, just check if PB is already synchronized and call callback, if it is
-            if(!strcmp(phone->mSelectedRemoteDevice.c_str(), btAddress)) {
-                if(phone->mPBSynchronized) {
-                    std::string result("");
-                    result += "{\"value\":\"";
-                    result += phone->mSelectedRemoteDevice;
-                    result += "\"}";
-                    g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
-                                                   NULL,
-                                                   PHONE_OBJ_PATH,
-                                                   PHONE_IFACE,
-                                                   "RemoteDeviceSelected",
-                                                   g_variant_new("(s)", result.c_str()), // already synchronized/selected
-                                                   NULL);
-                }
-                else {
-                    // the synchronization may be already on-going, but request it anyway
-                    /*Obex::Error err = */phone->syncContacts();
-                    /*Obex::Error err = */phone->syncCallHistory();
-                }
+        Method &method = mMethods[info->name];
+        method.handler = handlers[i].handler;
+        for(GDBusArgInfo **arg = info->in_args; arg && *arg; arg++)
+            method.inSignature += (*arg)->signature;
+        for(GDBusArgInfo **arg = info->out_args; arg && *arg; arg++)
+            method.outSignature += (*arg)->signature;
+    }
+
+    for(GDBusMethodInfo **info = iface->methods; info && *info; info++) {
+        if(mMethods.find((*info)->name) == mMethods.end())
+            LoggerE("Method " << (*info)->name << " doesn't have a handler");
+    }
+}
+
+void Phone::handleSelectRemoteDevice(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    char *btAddress = NULL;
+    g_variant_get(parameters, "(&s)", &btAddress);
+    if(!btAddress || !isValidMAC(std::string(btAddress))) {
+        LoggerE("Won't select remote device: given MAC address \"" << btAddress << "\" is not valid");
+        g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
+                                       NULL,
+                                       PHONE_OBJ_PATH,
+                                       PHONE_IFACE,
+                                       "RemoteDeviceSelected",
+                                       g_variant_new("(s)", "{\"error\":\"Invalid MAC address\"}"),
+                                       NULL);
+    }
+    else {
+        LoggerD("Selecting remote device: " << btAddress);
+
+        // check whether requested device is not yet selected
+        // if so, just check if PB is already synchronized and call callback, if it is
+        if(!strcmp(phone->mSelectedRemoteDevice.c_str(), btAddress)) {
+            if(phone->mPBSynchronized) {
+                std::string result;
+                makeResult("value", phone->mSelectedRemoteDevice.c_str(), result);
+                g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
+                                               NULL,
+                                               PHONE_OBJ_PATH,
+                                               PHONE_IFACE,
+                                               "RemoteDeviceSelected",
+                                               g_variant_new("(s)", result.c_str()), // already synchronized/selected
+                                               NULL);
             }
             else {
-                //TODO: stop all services and start everything from begining
-                phone->mWantedRemoteDevice = btAddress;
-                phone->storeSelectedRemoteDeviceMAC(btAddress);
-                phone->startServices();
+                // the synchronization may be already on-going, but request it anyway
+                /*Obex::Error err = */phone->syncContacts();
+                /*Obex::Error err = */phone->syncCallHistory();
             }
         }
-        g_dbus_method_invocation_return_value(invocation, NULL); // just finish the method call - don't return any status (The status is returned via "RemoteDeviceSelected" signal
-    }
-    else if(!strcmp(method_name, "GetSelectedRemoteDevice")) {
-        g_dbus_method_invocation_return_value( invocation,
-                                               g_variant_new("(s)", phone->mSelectedRemoteDevice.c_str()));
+        else {
+            //TODO: stop all services and start everything from begining
+            phone->mWantedRemoteDevice = btAddress;
+            phone->storeSelectedRemoteDeviceMAC(btAddress);
+            phone->startServices();
+        }
     }
-    if(!strcmp(method_name, "UnselectRemoteDevice")) {
-        phone->mWantedRemoteDevice = "";
-        phone->stopServices();
+    g_dbus_method_invocation_return_value(invocation, NULL); // just finish the method call - don't return any status (The status is returned via "RemoteDeviceSelected" signal
+}
+
+void Phone::handleGetSelectedRemoteDevice(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    g_dbus_method_invocation_return_value( invocation,
+                                           g_variant_new("(s)", phone->mSelectedRemoteDevice.c_str()));
+}
+
+void Phone::handleUnselectRemoteDevice(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    phone->mWantedRemoteDevice = "";
+    phone->stopServices();
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+void Phone::handleDial(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    char *number = NULL;
+    char *error = NULL;
+    g_variant_get(parameters, "(&s)", &number);
+    if(phone->invokeCall(number, &error)) {
+        LoggerD("Dialing number: " << number);
         g_dbus_method_invocation_return_value(invocation, NULL);
     }
-    else if(!strcmp(method_name, "Dial")) {
-        char *number = NULL;
-        char *error = NULL;
-        g_variant_get(parameters, "(&s)", &number);
-        if(phone->invokeCall(number, &error)) {
-            LoggerD("Dialing number: " << number);
-            g_dbus_method_invocation_return_value(invocation, NULL);
-        }
-        else {
-            if(error) { // sanity check
-                LoggerD("Failed to dial number: " << error);
-                GError *err = g_error_new(G_PHONE_ERROR, 1, error);
-                g_dbus_method_invocation_return_gerror(invocation, err);
-                free(error);
-            }
+    else {
+        if(error) { // sanity check
+            LoggerD("Failed to dial number: " << error);
+            GError *err = g_error_new_literal(G_PHONE_ERROR, 1, error);
+            g_dbus_method_invocation_return_gerror(invocation, err);
+            free(error);
         }
     }
-    else if(!strcmp(method_name, "Answer")) {
-        char *error = NULL;
-        if(phone->answerCall(&error)) {
-            LoggerD("Answering incoming call");
-            g_dbus_method_invocation_return_value(invocation, NULL);
-        }
-        else {
-            if(error) { // sanity check
-                LoggerD("Failed to answer the call: " << error);
-                GError *err = g_error_new(G_PHONE_ERROR, 2, error);
-                g_dbus_method_invocation_return_gerror(invocation, err);
-                free(error);
-            }
-        }
+}
+
+void Phone::handleAnswer(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    char *error = NULL;
+    if(phone->answerCall(&error)) {
+        LoggerD("Answering incoming call");
+        g_dbus_method_invocation_return_value(invocation, NULL);
     }
-    else if(!strcmp(method_name, "Hangup")) {
-        char *error = NULL;
-        if(phone->hangupCall(&error)) {
-            LoggerD("Hanging-up active/incoming call");
-            g_dbus_method_invocation_return_value(invocation, NULL);
-        }
-        else {
-            if(error) { // sanity check
-                LoggerD("Failed to hang-up the call: " << error);
-                GError *err = g_error_new(G_PHONE_ERROR, 2, error);
-                g_dbus_method_invocation_return_gerror(invocation, err);
-                free(error);
-            }
+    else {
+        if(error) { // sanity check
+            LoggerD("Failed to answer the call: " << error);
+            GError *err = g_error_new_literal(G_PHONE_ERROR, 2, error);
+            g_dbus_method_invocation_return_gerror(invocation, err);
+            free(error);
         }
     }
-    else if(!strcmp(method_name, "Mute")) {
-        bool mute;
-        char *error = NULL;
-        g_variant_get(parameters, "(b)", &mute);
-        if(phone->muteCall(mute, &error)) {
-            LoggerD("Muting MIC: " << mute);
-            g_dbus_method_invocation_return_value(invocation, NULL);
-        }
-        else {
-            if(error) { // sanity check
-                LoggerD("Failed to mute the call: " << error);
-                GError *err = g_error_new(G_PHONE_ERROR, 2, error);
-                g_dbus_method_invocation_return_gerror(invocation, err);
-                free(error);
-            }
+}
+
+void Phone::handleHangup(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    char *error = NULL;
+    if(phone->hangupCall(&error)) {
+        LoggerD("Hanging-up active/incoming call");
+        g_dbus_method_invocation_return_value(invocation, NULL);
+    }
+    else {
+        if(error) { // sanity check
+            LoggerD("Failed to hang-up the call: " << error);
+            GError *err = g_error_new_literal(G_PHONE_ERROR, 2, error);
+            g_dbus_method_invocation_return_gerror(invocation, err);
+            free(error);
         }
     }
-    else if(!strcmp(method_name, "ActiveCall")) {
-        LoggerD("constructing ActiveCall response");
-
-        OFono::Call *call = phone->activeCall();
-
-        GVariant *props[8];
-        int nprops = 0;
-
-        GVariant *key, *str, *var;
-        // add state
-        key = g_variant_new_string("state");
-        str = g_variant_new_string((call && call->state)?call->state:"disconnected");
-        var = g_variant_new_variant(str);
-        props[nprops++] = g_variant_new_dict_entry(key, var);
-        // add line_id
-        key = g_variant_new_string("line_id");
-        str = g_variant_new_string((call && call->line_id)?call->line_id:"");
-        var = g_variant_new_variant(str);
-        props[nprops++] = g_variant_new_dict_entry(key, var);
-        // get contact by phone number
-        std::string contact;
-        phone->getContactByPhoneNumber(call?call->line_id:NULL, contact);
-        key = g_variant_new_string("contact");
-        str = g_variant_new_string(contact.c_str());
-        var = g_variant_new_variant(str);
-        props[nprops++] = g_variant_new_dict_entry(key, var);
-
-        GVariant *array = g_variant_new_array(G_VARIANT_TYPE("{sv}"), props, nprops);
-
-        GVariantBuilder *builder = g_variant_builder_new(G_VARIANT_TYPE("(a{sv})"));
-        g_variant_builder_add_value(builder, array);
-        GVariant *args = g_variant_builder_end(builder);
-        g_variant_builder_unref(builder);
-        g_dbus_method_invocation_return_value(invocation, args);
-
-        if(call)
-            delete call;
-    }
-    else if(!strcmp(method_name, "Synchronize")) {
-        LoggerD("Synchronizing data with the phone");
-        /*Obex::Error err = */phone->syncContacts();
-        /*Obex::Error err = */phone->syncCallHistory();
+}
+
+void Phone::handleMute(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    bool mute;
+    char *error = NULL;
+    g_variant_get(parameters, "(b)", &mute);
+    if(phone->muteCall(mute, &error)) {
+        LoggerD("Muting MIC: " << mute);
         g_dbus_method_invocation_return_value(invocation, NULL);
     }
-    else if(!strcmp(method_name, "GetContacts")) {
-        unsigned long count;
-        g_variant_get(parameters, "(u)", &count);
-        std::string contacts;
-        phone->getJsonContacts(contacts, count);
-        g_dbus_method_invocation_return_value( invocation,
-                                               g_variant_new("(s)", contacts.c_str()));
+    else {
+        if(error) { // sanity check
+            LoggerD("Failed to mute the call: " << error);
+            GError *err = g_error_new_literal(G_PHONE_ERROR, 2, error);
+            g_dbus_method_invocation_return_gerror(invocation, err);
+            free(error);
+        }
     }
-    else if(!strcmp(method_name, "GetCallHistory")) {
-        unsigned long count;
-        g_variant_get(parameters, "(u)", &count);
-        std::string calls;
-        phone->getJsonCallHistory(calls, count);
-        g_dbus_method_invocation_return_value( invocation,
-                                               g_variant_new("(s)", calls.c_str()));
+}
+
+void Phone::handleActiveCall(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    LoggerD("constructing ActiveCall response");
+
+    OFono::Call *call = phone->activeCall();
+    GVariant *array = phone->makeCallVariant(call);
+    g_dbus_method_invocation_return_value(invocation, g_variant_new_tuple(&array, 1));
+
+    if(call)
+        delete call;
+}
+
+void Phone::handleGetCalls(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    LoggerD("constructing GetCalls response");
+
+    std::vector<OFono::Call*> calls;
+    phone->listCalls(calls);
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("aa{sv}"));
+    for(unsigned int i=0; i<calls.size(); i++) {
+        g_variant_builder_add_value(&builder, phone->makeCallVariant(calls[i]));
+        delete calls[i];
     }
+    GVariant *array = g_variant_builder_end(&builder);
+    g_dbus_method_invocation_return_value(invocation, g_variant_new_tuple(&array, 1));
 }
 
-gboolean Phone::delayedSyncCallHistory(gpointer user_data) {
-    Phone *ctx = static_cast<Phone*>(user_data);
-    if(!ctx) {
-        LoggerE("Failed to cast to Phone");
-        return G_SOURCE_REMOVE; // single shot timeout
+// the methods of the calls, which don't have arguments, nor a result
+static void returnCallMethod(bool success, char *error, const char *what, GDBusMethodInvocation *invocation) {
+    if(success) {
+        LoggerD(what);
+        g_dbus_method_invocation_return_value(invocation, NULL);
     }
-    // synchronize given number of latest entries in the list
-    if(Obex::OBEX_ERR_INVALID_SESSION == ctx->syncCallHistory(CALLHISTORY_UPDATED_SYNC_COUNT)) {
-        // if the session is not created, try to create it
-        ctx->createSession(ctx->mWantedRemoteDevice.c_str());
+    else {
+        if(error) { // sanity check
+            LoggerD("Failed to " << what << ": " << error);
+            GError *err = g_error_new_literal(G_PHONE_ERROR, 2, error);
+            g_dbus_method_invocation_return_gerror(invocation, err);
+            free(error);
+        }
     }
-    return G_SOURCE_REMOVE; // single shot timeout
 }
 
-void Phone::callChanged(const char* state, const char* phoneNumber) {
-    LoggerD("CallChanged: " << state << "\t" << phoneNumber);
+void Phone::handleSwapCalls(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    char *error = NULL;
+    bool success = phone->swapCalls(&error);
+    returnCallMethod(success, error, "swap the calls", invocation);
+}
 
-    if(state && !strcmp(state, "disconnected")) {
-        // a call has been made => update call history
-        // use a delayed sync, since the list may not be updated on the phone yet
-        g_timeout_add(DELAYED_SYNC_CALLHISTORY_INTERVAL, delayedSyncCallHistory, this);
-    }
+void Phone::handleHoldAndAnswer(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    char *error = NULL;
+    bool success = phone->holdAndAnswer(&error);
+    returnCallMethod(success, error, "hold the active call and answer the waiting one", invocation);
+}
+
+void Phone::handleReleaseAndAnswer(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    char *error = NULL;
+    bool success = phone->releaseAndAnswer(&error);
+    returnCallMethod(success, error, "hang-up the active call and answer the waiting one", invocation);
+}
 
+void Phone::handleMergeCalls(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    char *error = NULL;
+    bool success = phone->mergeCalls(&error);
+    returnCallMethod(success, error, "merge the calls", invocation);
+}
+
+GVariant *Phone::makeCallVariant(const OFono::Call *call) {
     GVariant *props[8];
     int nprops = 0;
+
     GVariant *key, *str, *var;
+    // add path
+    key = g_variant_new_string("path");
+    str = g_variant_new_string((call && call->path)?call->path:"");
+    var = g_variant_new_variant(str);
+    props[nprops++] = g_variant_new_dict_entry(key, var);
     // add state
     key = g_variant_new_string("state");
-    str = g_variant_new_string(state?state:"disconnected");
+    str = g_variant_new_string((call && call->state)?call->state:"disconnected");
     var = g_variant_new_variant(str);
     props[nprops++] = g_variant_new_dict_entry(key, var);
     // add line_id
     key = g_variant_new_string("line_id");
-    str = g_variant_new_string(phoneNumber?phoneNumber:"");
+    str = g_variant_new_string((call && call->line_id)?call->line_id:"");
     var = g_variant_new_variant(str);
     props[nprops++] = g_variant_new_dict_entry(key, var);
+    // add multiparty
+    key = g_variant_new_string("multiparty");
+    var = g_variant_new_variant(g_variant_new_boolean(call && call->multiparty));
+    props[nprops++] = g_variant_new_dict_entry(key, var);
     // get contact by phone number
     std::string contact;
-    getContactByPhoneNumber(phoneNumber, contact);
+    getContactByPhoneNumber(call?call->line_id:NULL, contact);
     key = g_variant_new_string("contact");
     str = g_variant_new_string(contact.c_str());
     var = g_variant_new_variant(str);
     props[nprops++] = g_variant_new_dict_entry(key, var);
 
-    GVariant *array = g_variant_new_array(G_VARIANT_TYPE("{sv}"), props, nprops);
+    return g_variant_new_array(G_VARIANT_TYPE("{sv}"), props, nprops);
+}
+
+void Phone::handleSynchronize(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    LoggerD("Synchronizing data with the phone");
+    /*Obex::Error err = */phone->syncContacts();
+    /*Obex::Error err = */phone->syncCallHistory();
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+void Phone::handleGetContacts(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    unsigned long count;
+    g_variant_get(parameters, "(u)", &count);
+    std::string contacts;
+    phone->getJsonContacts(contacts, count);
+    g_dbus_method_invocation_return_value( invocation,
+                                           g_variant_new("(s)", contacts.c_str()));
+}
+
+void Phone::handleGetCallHistory(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    unsigned long count;
+    g_variant_get(parameters, "(u)", &count);
+    std::string calls;
+    phone->getJsonCallHistory(calls, count);
+    g_dbus_method_invocation_return_value( invocation,
+                                           g_variant_new("(s)", calls.c_str()));
+}
+
+void Phone::handleGetContactsRange(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    guint32 offset, limit;
+    const char *sortKey = NULL;
+    g_variant_get(parameters, "(uu&s)", &offset, &limit, &sortKey);
+    std::string contacts;
+    if(Obex::OBEX_ERR_NONE == phone->getJsonContactsRange(contacts, offset, limit, sortKey)) {
+        g_dbus_method_invocation_return_value( invocation,
+                                               g_variant_new("(s)", contacts.c_str()));
+    }
+    else {
+        GError *err = g_error_new(G_PHONE_ERROR, 3, "Invalid sort key: %s", sortKey);
+        g_dbus_method_invocation_return_gerror(invocation, err);
+        g_error_free(err);
+    }
+}
+
+void Phone::handleGetContactsVariant(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    guint32 offset, limit;
+    const char *sortKey = NULL;
+    g_variant_get(parameters, "(uu&s)", &offset, &limit, &sortKey);
+    GVariant *contacts = NULL;
+    if(Obex::OBEX_ERR_NONE == phone->getContactsVariant(&contacts, offset, limit, sortKey)) {
+        g_dbus_method_invocation_return_value( invocation,
+                                               g_variant_new_tuple(&contacts, 1));
+    }
+    else {
+        GError *err = g_error_new(G_PHONE_ERROR, 3, "Invalid sort key: %s", sortKey);
+        g_dbus_method_invocation_return_gerror(invocation, err);
+        g_error_free(err);
+    }
+}
+
+void Phone::handleGetContactsFd(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    guint32 offset, limit;
+    const char *sortKey = NULL;
+    g_variant_get(parameters, "(uu&s)", &offset, &limit, &sortKey);
+    GVariant *contacts = NULL;
+    if(Obex::OBEX_ERR_NONE != phone->getContactsVariant(&contacts, offset, limit, sortKey)) {
+        GError *err = g_error_new(G_PHONE_ERROR, 3, "Invalid sort key: %s", sortKey);
+        g_dbus_method_invocation_return_gerror(invocation, err);
+        g_error_free(err);
+        return;
+    }
+
+    g_variant_ref_sink(contacts);
+    gsize size = g_variant_get_size(contacts);
+    if(size == 0) {
+        // empty page, zero-length file couldn't be mapped by the client
+        g_variant_unref(contacts);
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(ht)", -1, (guint64)0));
+        return;
+    }
+    int fd = makeMemoryFile(g_variant_get_data(contacts), size);
+    g_variant_unref(contacts);
+    GUnixFDList *fds = g_unix_fd_list_new();
+    if(fd >= 0 && g_unix_fd_list_append(fds, fd, NULL) >= 0) {
+        g_dbus_method_invocation_return_value_with_unix_fd_list( invocation,
+                                                                 g_variant_new("(ht)", 0, (guint64)size),
+                                                                 fds);
+    }
+    else {
+        GError *err = g_error_new(G_PHONE_ERROR, 4, "Failed to create the memory file");
+        g_dbus_method_invocation_return_gerror(invocation, err);
+        g_error_free(err);
+    }
+    g_object_unref(fds);
+    if(fd >= 0)
+        close(fd); // the list holds own duplicate
+}
+
+void Phone::handleGetContactsExport(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    std::string path;
+    guint64 generation = 0;
+    if(phone->getContactsExport(path, generation)) {
+        g_dbus_method_invocation_return_value( invocation,
+                                               g_variant_new("(st)", path.c_str(), generation));
+    }
+    else {
+        GError *err = g_error_new(G_PHONE_ERROR, 4, "Failed to export contacts");
+        g_dbus_method_invocation_return_gerror(invocation, err);
+        g_error_free(err);
+    }
+}
+
+void Phone::handleGetContactPhoto(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    const char *key = NULL;
+    g_variant_get(parameters, "(&s)", &key);
+
+    std::string photoURI, thumbnailURI;
+    if(phone->getContactPhoto(key, photoURI, thumbnailURI)) {
+        g_dbus_method_invocation_return_value( invocation,
+                                               g_variant_new("(ss)", photoURI.c_str(), thumbnailURI.c_str()));
+    }
+    else {
+        GError *err = g_error_new(G_PHONE_ERROR, 5, "Contact photo not found");
+        g_dbus_method_invocation_return_gerror(invocation, err);
+        g_error_free(err);
+    }
+}
+
+void Phone::handleGetCallHistoryRange(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    guint32 offset, limit;
+    g_variant_get(parameters, "(uu)", &offset, &limit);
+    std::string calls;
+    phone->getJsonCallHistoryRange(calls, offset, limit);
+    g_dbus_method_invocation_return_value( invocation,
+                                           g_variant_new("(s)", calls.c_str()));
+}
+
+void Phone::handleSearchContacts(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    const char *query = NULL;
+    guint32 limit;
+    g_variant_get(parameters, "(&su)", &query, &limit);
+    std::string contacts;
+    phone->searchContacts(query, limit, contacts);
+    g_dbus_method_invocation_return_value( invocation,
+                                           g_variant_new("(s)", contacts.c_str()));
+}
+
+void Phone::handlePredictContacts(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    const char *digits = NULL;
+    guint32 limit;
+    g_variant_get(parameters, "(&su)", &digits, &limit);
+    std::string contacts;
+    gint64 lookup = 0;
+    phone->predictContacts(digits, limit, contacts, &lookup);
+    phone->mPredictLatency.add(lookup);
+    g_dbus_method_invocation_return_value( invocation,
+                                           g_variant_new("(s)", contacts.c_str()));
+}
+
+void Phone::handleGetStatistics(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation) {
+    std::string statistics;
+    phone->getStatistics(statistics);
+    g_dbus_method_invocation_return_value( invocation,
+                                           g_variant_new("(s)", statistics.c_str()));
+}
+
+gboolean Phone::latencyProbe(gpointer user_data) {
+    Phone *ctx = static_cast<Phone*>(user_data);
+    if(!ctx) {
+        LoggerE("Failed to cast to Phone");
+        return G_SOURCE_REMOVE;
+    }
+
+    // the timer fires late by the time the main loop has been blocked
+    gint64 now = g_get_monotonic_time();
+    gint64 lag = now - ctx->mLatencyProbeTime;
+    ctx->mMainLoopLag[ctx->isSynchronizing() ? LATENCY_SYNC : LATENCY_IDLE].add(lag > 0 ? lag : 0);
+    ctx->mLatencyProbeTime = now + LATENCY_PROBE_INTERVAL*1000;
+
+    return G_SOURCE_CONTINUE;
+}
+
+void Phone::getStatistics(std::string &statistics) {
+    std::string stats;
+    statistics.clear();
+    JsonWriter json(statistics, 1024);
+    json.beginObject();
+
+    const char *states[] = { "idle", "sync" };
+    json.beginObject("methodCalls");
+    for(unsigned int i=0; i<LATENCY_STATES; i++) {
+        mMethodLatency[i].toJson(stats);
+        json.raw(states[i], stats);
+    }
+    json.endObject();
+    json.beginObject("mainLoopLag");
+    for(unsigned int i=0; i<LATENCY_STATES; i++) {
+        mMainLoopLag[i].toJson(stats);
+        json.raw(states[i], stats);
+    }
+    json.endObject();
+    mPredictLatency.toJson(stats);
+    json.raw("predictContacts", stats);
+
+    // in the order of the introspection data
+    json.beginObject("methods");
+    for(GDBusMethodInfo **info = mIntrospectionData ? mIntrospectionData->interfaces[0]->methods : NULL; info && *info; info++) {
+        auto it = mMethods.find((*info)->name);
+        if(it == mMethods.end())
+            continue;
+        json.beginObject((*info)->name);
+        json.string("in", (*it).second.inSignature.c_str());
+        json.string("out", (*it).second.outSignature.c_str());
+        (*it).second.latency.toJson(stats);
+        json.raw("latency", stats);
+        json.endObject();
+    }
+    json.endObject();
+    SignalStats::toJson(stats);
+    json.raw("signals", stats);
+    Utils::dumpSignalListeners(stats);
+    json.raw("subscriptions", stats);
+
+    GBusType types[] = { G_BUS_TYPE_SYSTEM, G_BUS_TYPE_SESSION };
+    const char *names[] = { "system", "session" };
+    json.beginObject("buses");
+    for(unsigned int i=0; i<sizeof(types)/sizeof(types[0]); i++) {
+        json.beginObject(names[i]);
+        json.number("requests", BusConnection::getRequests(types[i]));
+        json.number("connects", BusConnection::getConnects(types[i]));
+        json.number("disconnects", BusConnection::getDisconnects(types[i]));
+        json.endObject();
+    }
+    json.endObject();
+
+    json.endObject();
+}
+
+gboolean Phone::delayedSyncCallHistory(gpointer user_data) {
+    Phone *ctx = static_cast<Phone*>(user_data);
+    if(!ctx) {
+        LoggerE("Failed to cast to Phone");
+        return G_SOURCE_REMOVE; // single shot timeout
+    }
+    // synchronize given number of latest entries in the list
+    if(Obex::OBEX_ERR_INVALID_SESSION == ctx->syncCallHistory(CALLHISTORY_UPDATED_SYNC_COUNT)) {
+        // if the session is not created, try to create it
+        ctx->createSession(ctx->mWantedRemoteDevice.c_str());
+    }
+    return G_SOURCE_REMOVE; // single shot timeout
+}
+
+void Phone::callChanged(const OFono::Call &call) {
+    LoggerD("CallChanged: " << call.path << "\t" << call.state << "\t" << call.line_id);
 
-    GVariantBuilder *builder = g_variant_builder_new(G_VARIANT_TYPE("(a{sv})"));
-    g_variant_builder_add_value(builder, array);
-    GVariant *args = g_variant_builder_end(builder);
-    g_variant_builder_unref(builder);
+    if(call.state && !strcmp(call.state, "disconnected")) {
+        // a call has been made => update call history
+        // use a delayed sync, since the list may not be updated on the phone yet
+        g_timeout_add(DELAYED_SYNC_CALLHISTORY_INTERVAL, delayedSyncCallHistory, this);
+    }
 
-    g_dbus_connection_emit_signal( g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL),
+    GVariant *array = makeCallVariant(&call);
+    g_dbus_connection_emit_signal( BusConnection::get(G_BUS_TYPE_SESSION),
                                    NULL,
                                    PHONE_OBJ_PATH,
                                    PHONE_IFACE,
                                    "CallChanged",
-                                   args,
+                                   g_variant_new_tuple(&array, 1),
                                    NULL);
 }
 
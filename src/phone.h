@@ -2,6 +2,8 @@
 #define PHONE_H_
 
 #include <gio/gio.h>
+#include <string>
+#include <unordered_map>
 
 #include "connman.h"
 #include "bluez.h"
@@ -51,7 +53,7 @@ namespace PhoneD {
  *     <li> \a \b number [in] \b 's' A phone number to dial. </li>
  *     </ul>
  *
- * <li> \b Answer () Answers an incoming phone call. </li>
+ * <li> \b Answer () Answers an incoming phone call. A waiting call is answered by \b HoldAndAnswer, or \b ReleaseAndAnswer. </li>
  *
  * <li> \b Mute ( \a \b muted ) Mutes/unmutes the active phone call. </li>
  *     <ul>
@@ -65,6 +67,19 @@ namespace PhoneD {
  *     <li> \a \b call [out] \b 'a{sv}' An active call in JSON format. </li>
  *     </ul>
  *
+ * <li> \b GetCalls ( \a \b calls ) Gets all phone calls, eg. the active call together with the waiting, or the held one. </li>
+ *     <ul>
+ *     <li> \a \b calls [out] \b 'aa{sv}' The calls, ordered by \a \b path, each in the format of \b CallChanged signal. </li>
+ *     </ul>
+ *
+ * <li> \b SwapCalls () Puts the active call on hold and resumes the held one. </li>
+ *
+ * <li> \b HoldAndAnswer () Puts the active call on hold and answers the waiting one. </li>
+ *
+ * <li> \b ReleaseAndAnswer () Hangs-up the active call and answers the waiting, or the held one. </li>
+ *
+ * <li> \b MergeCalls () Merges the active and the held calls into multiparty call. </li>
+ *
  * <li> \b Synchronize () Synchronizes PB data from the phone (Contacts, CallHistory).
  *
  * <li> \b GetContacts ( \a \b count, \a \b contacts ) Gets \a \b count first contacts in \b tizen.Contact JSON format, or \b [] when the data are not synchronized, or there are no contacts on the remote device. </li>
@@ -79,6 +94,70 @@ namespace PhoneD {
  *     <li> \a \b calls [out] \b 's' Returned latest \a \b count call entries in \b tizen.CallHistoryEntry JSON format. </li>
  *     </ul>
  *
+ * <li> \b GetContactsRange ( \a \b offset, \a \b limit, \a \b sortKey, \a \b contacts ) Gets a page of contacts in \b tizen.Contact JSON format, or \b [] when there are no contacts in the requested range. </li>
+ *     <ul>
+ *     <li> \a \b offset [in] \b 'u' An index of the first contact to be returned. </li>
+ *     <li> \a \b limit [in] \b 'u' Maximum number of contacts to be returned. \a \b 0 means to return all contacts from the \a \b offset. </li>
+ *     <li> \a \b sortKey [in] \b 's' Order of the contacts: \b "firstName", \b "lastName", \b "displayName", or \b "" for the order in which the contacts were synchronized. </li>
+ *     <li> \a \b contacts [out] \b 's' Returned contacts in \b tizen.Contact JSON format. </li>
+ *     </ul>
+ *
+ * <li> \b GetContactsVariant ( \a \b offset, \a \b limit, \a \b sortKey, \a \b contacts ) Gets a page of contacts as typed dictionaries, which don't need to be parsed by the client, or an empty array when there are no contacts in the requested range. See Obex::getContactsVariant() for the keys of the dictionaries. </li>
+ *     <ul>
+ *     <li> \a \b offset [in] \b 'u' An index of the first contact to be returned. </li>
+ *     <li> \a \b limit [in] \b 'u' Maximum number of contacts to be returned. \a \b 0 means to return all contacts from the \a \b offset. </li>
+ *     <li> \a \b sortKey [in] \b 's' Order of the contacts, see \b GetContactsRange. </li>
+ *     <li> \a \b contacts [out] \b 'aa{sv}' Returned contacts. </li>
+ *     </ul>
+ *
+ * <li> \b GetContactsFd ( \a \b offset, \a \b limit, \a \b sortKey, \a \b fd, \a \b size ) Gets a page of contacts as \b GetContactsVariant does, but the contacts are written to a sealed memory file, which is passed to the client, so that big phonebooks are not copied through the D-Bus daemon. The client maps the file and reads the contacts by \b g_variant_new_from_data() with \b aa{sv} type, the data are in the normal form of GVariant serialization in the byte order of the host. The client closes the file descriptor. </li>
+ *     <ul>
+ *     <li> \a \b offset [in] \b 'u' An index of the first contact to be returned. </li>
+ *     <li> \a \b limit [in] \b 'u' Maximum number of contacts to be returned. \a \b 0 means to return all contacts from the \a \b offset. </li>
+ *     <li> \a \b sortKey [in] \b 's' Order of the contacts, see \b GetContactsRange. </li>
+ *     <li> \a \b fd [out] \b 'h' The file descriptor of the memory file. There isn't any, ie. the index is \b -1, when there are no contacts in the requested range, since empty array is serialized to zero bytes, which can't be mapped. </li>
+ *     <li> \a \b size [out] \b 't' Size of the serialized contacts in the file, \b 0 when there are no contacts in the requested range. </li>
+ *     </ul>
+ *
+ * <li> \b GetContactsExport ( \a \b path, \a \b generation ) Gets the file, which the contacts are exported into, so that more clients share one read-only copy of the contacts mapped into their memory. The export is enabled by the first call, the contacts are then exported each time they change: the file is replaced by a new one and the previous file is marked as stale. The layout of the file and inline functions to read it are in \b pbexport.h header. </li>
+ *     <ul>
+ *     <li> \a \b path [out] \b 's' The path of the file, ie. \b $XDG_RUNTIME_DIR/phoned-contacts.pb. </li>
+ *     <li> \a \b generation [out] \b 't' The number of the latest exported snapshot of the contacts, it's in the header of the file too. </li>
+ *     </ul>
+ *
+ * <li> \b GetContactPhoto ( \a \b key, \a \b photoURI, \a \b thumbnailURI ) Gets the photo of the contact exported by \b GetContactsExport, the photo is written into its file, once it's asked for. It fails, if there isn't such photo. </li>
+ *     <ul>
+ *     <li> \a \b key [in] \b 's' The key of the photo, see \b photo of \b PhonedPBContact in \b pbexport.h. </li>
+ *     <li> \a \b photoURI [out] \b 's' The URI of the photo. </li>
+ *     <li> \a \b thumbnailURI [out] \b 's' The URI of the downscaled photo, or an empty string, if it has not been made yet. </li>
+ *     </ul>
+ *
+ * <li> \b GetCallHistoryRange ( \a \b offset, \a \b limit, \a \b calls ) Gets a page of call entries from the history, the latest first, in \b tizen.CallHistoryEntry JSON format, or \b [] when there are no calls in the requested range. </li>
+ *     <ul>
+ *     <li> \a \b offset [in] \b 'u' An index of the first call entry to be returned. </li>
+ *     <li> \a \b limit [in] \b 'u' Maximum number of call entries to be returned. \a \b 0 means to return all call entries from the \a \b offset. </li>
+ *     <li> \a \b calls [out] \b 's' Returned call entries in \b tizen.CallHistoryEntry JSON format. </li>
+ *     </ul>
+ *
+ * <li> \b SearchContacts ( \a \b query, \a \b limit, \a \b contacts ) Searches contacts by the name, or the phone number, eg. for type-ahead in the dialer, and returns them in \b tizen.Contact JSON format, or \b [] when there is no matching contact. Each word of the query matches the beginning of a word of the name, regardless of the case and diacritics. The query made of digits matches also the phone numbers, anywhere in the number, and the names typed on the dial pad, eg. \b "526" matches \b "Jan". </li>
+ *     <ul>
+ *     <li> \a \b query [in] \b 's' The query, eg. \b "jo sm", or \b "0905". </li>
+ *     <li> \a \b limit [in] \b 'u' Maximum number of contacts to be returned. \a \b 0 means to return all matching contacts. </li>
+ *     <li> \a \b contacts [out] \b 's' Returned matching contacts in \b tizen.Contact JSON format, in the order of synchronization. </li>
+ *     </ul>
+ *
+ * <li> \b PredictContacts ( \a \b digits, \a \b limit, \a \b contacts ) Predicts contacts for the digits typed on the dial pad and returns them in \b tizen.Contact JSON format, the best match first, or \b [] when there is no matching contact. The digits match the beginning of a word of the name typed on the dial pad, eg. \b "526" matches \b "Jan", or the beginning of a phone number, also without its international, or trunk prefix. The first names rank first, then other words of the names, then the phone numbers, and complete matches rank before partial ones. </li>
+ *     <ul>
+ *     <li> \a \b digits [in] \b 's' The digits, eg. \b "5264", other characters are ignored. </li>
+ *     <li> \a \b limit [in] \b 'u' Maximum number of contacts to be returned. \a \b 0 means to return all matching contacts. </li>
+ *     <li> \a \b contacts [out] \b 's' Returned matching contacts in \b tizen.Contact JSON format, ranked. </li>
+ *     </ul>
+ *
+ * <li> \b GetStatistics ( \a \b statistics ) Gets the latency of the daemon in JSON format: percentiles of duration of the method calls and of the delay of the main loop, each split into samples taken while idle and while the phonebook is being synchronized, the duration of the look-up of \b PredictContacts, the signatures, the number and the duration of the calls of each method, the number of the routed and of the un-handled D-Bus signals, the subscriptions to D-Bus signals, and the usage of D-Bus connections. The latencies are in microseconds. </li>
+ *     <ul>
+ *     <li> \a \b statistics [out] \b 's' The statistics, eg. \b {"methodCalls":{"idle":{"count":N,"p50":N,"p90":N,"p99":N,"max":N},"sync":{...}},"mainLoopLag":{...},"predictContacts":{...},"buses":{"system":{"requests":N,"connects":N,"disconnects":N},"session":{...}}}. </li>
+ *     </ul>
+ *
  * </ul>
 
  * And emits the following signals:
@@ -97,9 +176,9 @@ namespace PhoneD {
  *     <li> \a \b call \b 's' A call in \b tizen.CallHistoryEntry fromat that has been added to the call history.
  *     </ul>
  *
- * <li> \b CallChanged ( \a \b call ) A signal which is emitted when there is a change in the active call. It indicates incoming, as well as the individual states that the call may go through, like "alerting", "active", "disconnected".
+ * <li> \b CallChanged ( \a \b call ) A signal which is emitted when there is a change in any of the calls. It indicates incoming, as well as the individual states that the call may go through, like "alerting", "active", "waiting", "held", "disconnected".
  *     <ul>
- *     <li> \a \b call \b '(a{sv})' A call object which specifies \a \b state of the call, \a \b line \a \b identifier (the phone number) and the \a \b contact if there is a match with the \a \b line_id.
+ *     <li> \a \b call \b '(a{sv})' A call object which specifies \a \b path of the call, which tells the calls apart, \a \b state of the call, \a \b line \a \b identifier (the phone number), whether the call is \a \b multiparty and the \a \b contact if there is a match with the \a \b line_id.
  *     </ul>
  * </ul>
  */
@@ -131,6 +210,36 @@ class Phone : public ConnMan, public Bluez, public OFono, public Obex {
                                       GVariant              *parameters,
                                       GDBusMethodInvocation *invocation,
                                       gpointer               user_data);
+        // handler of a method of PHONE_IFACE, it's called by handleMethodCall() with already checked arguments
+        typedef void (*MethodHandler)(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        // fills mMethods in from the introspection data, each method of the interface has to have a handler
+        void makeMethods();
+        static void handleSelectRemoteDevice(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetSelectedRemoteDevice(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleUnselectRemoteDevice(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleDial(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleAnswer(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleHangup(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleMute(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleActiveCall(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetCalls(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleSwapCalls(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleHoldAndAnswer(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleReleaseAndAnswer(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleMergeCalls(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        GVariant *makeCallVariant(const OFono::Call *call); // 'a{sv}' of the call, as in CallChanged, the call may be NULL
+        static void handleSynchronize(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetContacts(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetCallHistory(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetContactsRange(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetContactsVariant(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetContactsFd(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetContactsExport(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetContactPhoto(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetCallHistoryRange(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleSearchContacts(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handlePredictContacts(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
+        static void handleGetStatistics(Phone *phone, GVariant *parameters, GDBusMethodInvocation *invocation);
 
         // Bluez stuff
         virtual void adapterPowered(bool value); // to handle "Powered" property changed on ADAPTER, due to eg. RF-kill
@@ -139,7 +248,7 @@ class Phone : public ConnMan, public Bluez, public OFono, public Obex {
         virtual void deviceCreated(const char *device);
         virtual void deviceRemoved(const char *device);
         // OFono stuff
-        virtual void callChanged(const char* state, const char* phoneNumber);
+        virtual void callChanged(const OFono::Call &call);
         virtual void modemAdded(std::string &modem); // MAC address of modem ... from ModemAdded DBUS
         virtual void modemPowered(bool powered);
         virtual void setModemPoweredFailed(const char *err);
@@ -155,6 +264,10 @@ class Phone : public ConnMan, public Bluez, public OFono, public Obex {
         // active transfer is stalled - ??? session is down ???
         virtual void transferStalled();
         static gboolean delayedSyncCallHistory(gpointer user_data);
+        // periodic timer measuring the delay of the main loop
+        static gboolean latencyProbe(gpointer user_data);
+        // makes JSON object reported by GetStatistics method
+        void getStatistics(std::string &statistics);
 
         // function to store MAC address of selected remote device in persistent storage/file
         // returns bool indicating result of the operation: false = failed, true = OK
@@ -177,6 +290,21 @@ class Phone : public ConnMan, public Bluez, public OFono, public Obex {
         guint mRegistrationId;
         GDBusNodeInfo *mIntrospectionData;
         GDBusInterfaceVTable mIfaceVTable;
+        // a method of PHONE_IFACE, its signatures are taken from the introspection data
+        struct Method {
+            MethodHandler handler;
+            std::string inSignature;
+            std::string outSignature;
+            LatencyStats latency; // duration of handling of the calls, it holds the number of the calls as well
+        };
+        std::unordered_map<std::string, Method> mMethods; // method name -> method, see makeMethods()
+        // latency samples are split by whether the phonebook is being synchronized
+        enum { LATENCY_IDLE = 0, LATENCY_SYNC, LATENCY_STATES };
+        LatencyStats mMethodLatency[LATENCY_STATES]; // duration of handling of D-Bus method calls
+        LatencyStats mMainLoopLag[LATENCY_STATES];   // delay of the main loop, measured by latencyProbe()
+        LatencyStats mPredictLatency; // duration of the look-up in DialPadTrie of PredictContacts method, without the photos, JSON and D-Bus overhead
+        guint mLatencyProbeTimer;
+        gint64 mLatencyProbeTime; // the time the probe is expected to fire at
 };
 
 } // PhoneD
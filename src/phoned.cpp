@@ -27,6 +27,9 @@ int main (int argc, char *argv[])
 
     delete phone;
 
+    // release shared D-Bus connections
+    PhoneD::BusConnection::release();
+
     return 0;
 }
 
@@ -0,0 +1,103 @@
+
+#include "phonenumberindex.h"
+#include "utils.h"
+
+namespace PhoneD {
+
+#define PHONE_NUMBER_SUFFIX_DIGITS      9 // maximum number of trailing digits compared to match numbers with different prefix
+#define PHONE_NUMBER_SUFFIX_MIN_DIGITS  7 // the key of the suffix, shorter numbers (eg. service numbers) are matched only exactly
+
+void PhoneNumberIndex::normalize(const char *phoneNumber, std::string &number) {
+    number = phoneNumber;
+    formatPhoneNumber(number);
+
+    // "00" international prefix is the same as "+"
+    if(number.compare(0, 2, "00") == 0)
+        number.replace(0, 2, "+");
+
+    if(number == "+") // no digits
+        number.clear();
+}
+
+void PhoneNumberIndex::makeKeys(const char *phoneNumber, std::string &number, std::string &suffix) {
+    normalize(phoneNumber, number);
+    makeSuffix(number, suffix);
+}
+
+void PhoneNumberIndex::makeSuffix(const std::string &number, std::string &suffix) {
+    if(number.empty()) {
+        suffix.clear();
+        return;
+    }
+
+    // all numbers are keyed by the same number of digits, so that a local number without the area code finds the full number
+    size_t digits = number.length() - ((number[0] == '+') ? 1 : 0);
+    if(digits >= PHONE_NUMBER_SUFFIX_MIN_DIGITS)
+        suffix.assign(number, number.length() - PHONE_NUMBER_SUFFIX_MIN_DIGITS, PHONE_NUMBER_SUFFIX_MIN_DIGITS);
+    else
+        suffix.clear();
+}
+
+bool PhoneNumberIndex::matchSuffix(const std::string &a, const std::string &b) {
+    size_t digitsA = a.length() - ((a[0] == '+') ? 1 : 0);
+    size_t digitsB = b.length() - ((b[0] == '+') ? 1 : 0);
+    size_t len = digitsA < digitsB ? digitsA : digitsB;
+    if(len > PHONE_NUMBER_SUFFIX_DIGITS)
+        len = PHONE_NUMBER_SUFFIX_DIGITS;
+    return a.compare(a.length() - len, len, b, b.length() - len, len) == 0;
+}
+
+void PhoneNumberIndex::add(const char *phoneNumber, const std::string &uid) {
+    if(!phoneNumber || !phoneNumber[0])
+        return;
+
+    std::string number;
+    normalize(phoneNumber, number);
+    addNormalized(number.c_str(), uid);
+}
+
+void PhoneNumberIndex::addNormalized(const char *number, const std::string &uid) {
+    if(!number || !number[0])
+        return;
+
+    std::string suffix;
+    makeSuffix(number, suffix);
+
+    // 'insert' doesn't overwrite existing mapping - the first entry wins
+    auto inserted = mNumbers.insert(std::make_pair(number, uid));
+    if(inserted.second && !suffix.empty())
+        mSuffixes[suffix].push_back(number);
+}
+
+const std::string *PhoneNumberIndex::find(const char *phoneNumber) const {
+    if(!phoneNumber || !phoneNumber[0])
+        return NULL;
+
+    std::string number, suffix;
+    makeKeys(phoneNumber, number, suffix);
+
+    auto it = mNumbers.find(number);
+    if(it != mNumbers.end())
+        return &(*it).second;
+
+    if(!suffix.empty()) {
+        auto candidates = mSuffixes.find(suffix);
+        if(candidates != mSuffixes.end()) {
+            const std::vector<std::string> &numbers = (*candidates).second;
+            for(unsigned int i = 0; i<numbers.size(); ++i) {
+                if(matchSuffix(number, numbers[i]))
+                    return &(*mNumbers.find(numbers[i])).second;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void PhoneNumberIndex::clear() {
+    mNumbers.clear();
+    mSuffixes.clear();
+}
+
+} // PhoneD
+
@@ -0,0 +1,88 @@
+#ifndef PHONENUMBERINDEX_H_
+#define PHONENUMBERINDEX_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::PhoneNumberIndex
+ *  \brief Hash index mapping phone numbers to the UIDs of the entries that own them.
+ *
+ * Phone numbers are normalized with formatPhoneNumber() before they are indexed, or looked-up. Besides the full normalized number, the
+ * index stores also the trailing digits of the number, to match the numbers that differ only in national/international prefix,
+ * eg. \b 0912345678 and \b +421912345678, or a local number without the area code, eg. \b 2345678 and \b +421212345678. The numbers are
+ * keyed by the shortest suffix, which is matched, and the candidates are compared on the trailing digits the shorter of the numbers has.
+ * When more entries share the same number, the first indexed entry wins.
+ */
+class PhoneNumberIndex {
+    public:
+        /**
+         * A default constructor. Constructs an empty index.
+         */
+        PhoneNumberIndex() {}
+
+        /**
+         * Adds a phone number of the entry to the index.
+         * @param[in] phoneNumber A phone number in any format, eg. \b "+421 123-456".
+         * @param[in] uid UID of the entry that owns the phone number.
+         */
+        void add(const char *phoneNumber, const std::string &uid);
+
+        /**
+         * Looks-up the entry owning given phone number. Exact match of normalized number is preferred, the match on trailing digits is used otherwise.
+         * @param[in] phoneNumber A phone number in any format.
+         * @return A pointer to UID of the matching entry, or \b NULL if there isn't any. The pointer is valid until the index is modified.
+         */
+        const std::string *find(const char *phoneNumber) const;
+
+        /**
+         * Removes all phone numbers from the index.
+         */
+        void clear();
+
+        /**
+         * Gets the number of indexed phone numbers.
+         * @return The number of indexed phone numbers.
+         */
+        size_t size() const { return mNumbers.size(); }
+
+        /**
+         * Normalizes the phone number, ie. keeps only its digits and the leading \b "+", and replaces \b "00" international prefix by \b "+".
+         * @param[in] phoneNumber A phone number in any format.
+         * @param[out] number The normalized phone number, it's empty, if the number doesn't have any digits.
+         */
+        static void normalize(const char *phoneNumber, std::string &number);
+
+        /**
+         * Adds a phone number of the entry to the index, the number has already been normalized, eg. by ContactRecord.
+         * @param[in] number The normalized phone number, see normalize().
+         * @param[in] uid UID of the entry that owns the phone number.
+         */
+        void addNormalized(const char *number, const std::string &uid);
+
+    private:
+        // fills normalized number and its suffix (empty, if the number is too short to be matched on suffix)
+        static void makeKeys(const char *phoneNumber, std::string &number, std::string &suffix);
+        // fills the suffix of the normalized number
+        static void makeSuffix(const std::string &number, std::string &suffix);
+        // checks whether the numbers match on the trailing digits of the shorter one, up to PHONE_NUMBER_SUFFIX_DIGITS
+        static bool matchSuffix(const std::string &a, const std::string &b);
+
+    private:
+        std::unordered_map<std::string, std::string> mNumbers;  // normalized number -> uid
+        std::unordered_map<std::string, std::vector<std::string> > mSuffixes; // the shortest suffix -> normalized numbers in the order of indexing
+};
+
+} // PhoneD
+
+#endif /* PHONENUMBERINDEX_H_ */
+
+/** @} */
+
@@ -0,0 +1,419 @@
+
+#include "photostore.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "Logger.h"
+
+namespace PhoneD {
+
+#define PHOTO_STORE_DIR                    "/.phoned-photos"
+#define PHOTO_FILE_SUFFIX                  ".jif"
+#define THUMBNAIL_FILE_SUFFIX              ".thumb.png"
+#define THUMBNAIL_SIZE                     96                // the longer side of the thumbnail (in pixels), 48px avatars at 2x scale
+#define PHOTO_KEY_LENGTH                   40                // SHA-1 in hex
+#define PHOTO_STORE_MAX_SIZE               (32*1024*1024)    // size of written photos, the least recently used are removed above it
+#define PHOTO_PENDING_MAX_SIZE             (8*1024*1024)     // size of pending photos in memory, new photos are written immediately above it
+
+PhotoStore::PhotoStore() :
+    mFilesSize(0),
+    mPendingSize(0),
+    mThumbnailer(NULL),
+    mStopping(0)
+{
+    g_mutex_init(&mLock);
+
+    const char *home = ::getenv("HOME");
+    if(!home) {
+        LoggerE("HOME is not set, contact photos won't be stored");
+        return;
+    }
+    mDir = std::string(home) + PHOTO_STORE_DIR;
+    if(g_mkdir_with_parents(mDir.c_str(), 0700) != 0) {
+        LoggerE("Failed to create directory for contact photos: " << mDir);
+        mDir.clear();
+        return;
+    }
+    // the thumbnails are made one at a time, not to compete with parsing of VCards
+    mThumbnailer = g_thread_pool_new(PhotoStore::makeThumbnail, NULL, 1, FALSE, NULL);
+
+    // the photos stored by previous runs are used first, once the size of the store is exceeded
+    GDir *dir = g_dir_open(mDir.c_str(), 0, NULL);
+    if(!dir)
+        return;
+    std::vector<std::pair<std::string, size_t> > thumbnails;
+    const char *name;
+    while((name = g_dir_read_name(dir))) {
+        bool photo = strlen(name) == PHOTO_KEY_LENGTH + strlen(PHOTO_FILE_SUFFIX) && g_str_has_suffix(name, PHOTO_FILE_SUFFIX);
+        bool thumbnail = strlen(name) == PHOTO_KEY_LENGTH + strlen(THUMBNAIL_FILE_SUFFIX) && g_str_has_suffix(name, THUMBNAIL_FILE_SUFFIX);
+        if(!photo && !thumbnail)
+            continue;
+        std::string key(name, PHOTO_KEY_LENGTH);
+        std::string fileName = mDir + "/" + name;
+        struct stat st;
+        if(stat(fileName.c_str(), &st) != 0)
+            continue;
+        if(thumbnail) {
+            thumbnails.push_back(std::make_pair(key, (size_t)st.st_size));
+            continue;
+        }
+        File &file = mFiles[key];
+        file.size = st.st_size;
+        file.lru = mLru.insert(mLru.end(), key);
+        mFilesSize += file.size;
+    }
+    g_dir_close(dir);
+
+    // the thumbnails of the photos, which are only in the persistent cache of the phonebook, are kept too, the ones, which are not
+    // referenced, are removed by prune()
+    for(size_t i=0; i<thumbnails.size(); i++) {
+        mThumbnails[thumbnails[i].first] = thumbnails[i].second;
+        mFilesSize += thumbnails[i].second;
+    }
+    LoggerD("Contact photos in " << mDir << ": " << mFiles.size() << " (" << mFilesSize << " bytes)");
+
+    evict();
+}
+
+PhotoStore::~PhotoStore() {
+    // the thumbnails, which have not been started yet, are only freed
+    g_atomic_int_set(&mStopping, 1);
+    if(mThumbnailer)
+        g_thread_pool_free(mThumbnailer, FALSE, TRUE);
+    g_mutex_clear(&mLock);
+}
+
+bool PhotoStore::add(const guchar *data, gsize length, std::string &key) {
+    if(!data || length == 0)
+        return false;
+
+    gchar *checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA1, data, length);
+    key = checksum;
+    g_free(checksum);
+
+    g_mutex_lock(&mLock);
+    if(mFiles.find(key) == mFiles.end() && mPending.find(key) == mPending.end()) {
+        std::string photo((const char*)data, length);
+        // the thumbnail is made, while the photo is ingested, so that it's available for the first response
+        if(mThumbnails.find(key) == mThumbnails.end())
+            requestThumbnail(key, photo);
+        if(mPendingSize + length > PHOTO_PENDING_MAX_SIZE) {
+            // don't keep too much in memory, the photo is written on the thread, which parses the VCards
+            write(key, photo);
+        }
+        else {
+            Pending &pending = mPending[key];
+            pending.photo.swap(photo);
+            pending.stale = false;
+            mPendingSize += length;
+        }
+    }
+    g_mutex_unlock(&mLock);
+
+    return true;
+}
+
+bool PhotoStore::materialize(const std::string &key, bool pin) {
+    bool exists = false;
+
+    g_mutex_lock(&mLock);
+    // pinned before it's written, so that writing the photo doesn't remove it
+    if(pin)
+        mPinned[key]++;
+    auto file = mFiles.find(key);
+    if(file != mFiles.end()) {
+        mLru.splice(mLru.begin(), mLru, (*file).second.lru); // the most recently used
+        exists = true;
+    }
+    else {
+        auto pending = mPending.find(key);
+        if(pending != mPending.end()) {
+            std::string photo;
+            photo.swap((*pending).second.photo);
+            mPendingSize -= photo.size();
+            mPending.erase(pending);
+            exists = write(key, photo);
+            if(!exists) { // keep it, the write may succeed later
+                Pending &kept = mPending[key];
+                kept.photo.swap(photo);
+                kept.stale = false;
+                mPendingSize += kept.photo.size();
+            }
+        }
+    }
+    if(pin && !exists)
+        unpinLocked(key);
+    g_mutex_unlock(&mLock);
+
+    return exists;
+}
+
+void PhotoStore::unpin(const std::string &key) {
+    g_mutex_lock(&mLock);
+    unpinLocked(key);
+    g_mutex_unlock(&mLock);
+}
+
+void PhotoStore::getUri(const std::string &key, std::string &uri) const {
+    std::string fileName;
+    makeFileName(key, fileName);
+    uri = "file://" + fileName;
+}
+
+void PhotoStore::getThumbnailUri(const std::string &key, std::string &uri) const {
+    std::string fileName;
+    makeThumbnailFileName(key, fileName);
+    uri = "file://" + fileName;
+}
+
+bool PhotoStore::getKey(const char *uri, std::string &key) const {
+    std::string prefix = "file://" + mDir + "/";
+    if(!uri || mDir.empty() || strncmp(uri, prefix.c_str(), prefix.length()))
+        return false;
+    const char *name = uri + prefix.length();
+    if(strlen(name) != PHOTO_KEY_LENGTH + strlen(PHOTO_FILE_SUFFIX) || !g_str_has_suffix(name, PHOTO_FILE_SUFFIX))
+        return false;
+    key.assign(name, PHOTO_KEY_LENGTH);
+    return true;
+}
+
+void PhotoStore::getPending(std::vector<std::pair<std::string, std::string> > &photos) const {
+    g_mutex_lock(&mLock);
+    photos.reserve(mPending.size());
+    for(auto it = mPending.begin(); it != mPending.end(); ++it)
+        photos.push_back(std::make_pair((*it).first, (*it).second.photo));
+    g_mutex_unlock(&mLock);
+}
+
+void PhotoStore::addPending(const std::string &key, const std::string &photo) {
+    g_mutex_lock(&mLock);
+    if(mFiles.find(key) == mFiles.end() && mPending.find(key) == mPending.end()) {
+        Pending &pending = mPending[key];
+        pending.photo = photo;
+        pending.stale = false;
+        mPendingSize += photo.size();
+        if(mThumbnails.find(key) == mThumbnails.end())
+            requestThumbnail(key, photo);
+    }
+    g_mutex_unlock(&mLock);
+}
+
+void PhotoStore::prune(const std::unordered_set<std::string> &keys) {
+    g_mutex_lock(&mLock);
+    mReferenced = keys;
+    for(auto it = mPending.begin(); it != mPending.end(); ) {
+        if(keys.find((*it).first) != keys.end()) {
+            (*it).second.stale = false;
+            ++it;
+        }
+        else if(!(*it).second.stale) {
+            // it may belong to the entries, which are being synchronized, it's dropped at the next prune
+            (*it).second.stale = true;
+            ++it;
+        }
+        else {
+            mPendingSize -= (*it).second.photo.size();
+            it = mPending.erase(it);
+        }
+    }
+    // the thumbnails of the photos, which are neither referenced, nor stored, are removed
+    for(auto it = mThumbnails.begin(); it != mThumbnails.end(); ) {
+        if(isKept((*it).first)) {
+            ++it;
+            continue;
+        }
+        std::string fileName;
+        makeThumbnailFileName((*it).first, fileName);
+        LoggerD("Removing unreferenced thumbnail of contact photo: " << fileName);
+        g_unlink(fileName.c_str());
+        mFilesSize -= (*it).second;
+        it = mThumbnails.erase(it);
+    }
+    g_mutex_unlock(&mLock);
+}
+
+void PhotoStore::makeFileName(const std::string &key, std::string &fileName) const {
+    fileName = mDir + "/" + key + PHOTO_FILE_SUFFIX;
+}
+
+void PhotoStore::makeThumbnailFileName(const std::string &key, std::string &fileName) const {
+    fileName = mDir + "/" + key + THUMBNAIL_FILE_SUFFIX;
+}
+
+bool PhotoStore::write(const std::string &key, const std::string &photo) {
+    if(mDir.empty())
+        return false;
+
+    std::string fileName;
+    makeFileName(key, fileName);
+    GError *err = NULL;
+    if(!g_file_set_contents(fileName.c_str(), photo.data(), photo.size(), &err)) {
+        LoggerE("Unable to store contact photo " << fileName << ": " << (err?err->message:"unknown error"));
+        if(err)
+            g_error_free(err);
+        return false;
+    }
+    LoggerD("Saved contact photo: " << fileName);
+
+    File &file = mFiles[key];
+    file.size = photo.size();
+    file.lru = mLru.insert(mLru.begin(), key);
+    mFilesSize += file.size;
+
+    evict();
+    return true;
+}
+
+void PhotoStore::unpinLocked(const std::string &key) {
+    auto pinned = mPinned.find(key);
+    if(pinned != mPinned.end() && --(*pinned).second == 0)
+        mPinned.erase(pinned);
+}
+
+void PhotoStore::evict() {
+    // keep at least the most recently used photo, and the pinned ones
+    auto it = mLru.end();
+    while(mFilesSize > PHOTO_STORE_MAX_SIZE && it != mLru.begin()) {
+        --it;
+        if(it == mLru.begin())
+            break;
+        if(mPinned.find(*it) != mPinned.end())
+            continue;
+        std::string key = *it;
+        it = mLru.erase(it);
+        auto file = mFiles.find(key);
+        mFilesSize -= (*file).second.size;
+        mFiles.erase(file);
+
+        std::string fileName;
+        makeFileName(key, fileName);
+        // the photo is still referenced by the entries, it's written again, once requested
+        gchar *contents = NULL;
+        gsize length = 0;
+        if(mReferenced.find(key) != mReferenced.end() && g_file_get_contents(fileName.c_str(), &contents, &length, NULL)) {
+            Pending &pending = mPending[key];
+            pending.photo.assign(contents, length);
+            pending.stale = false;
+            mPendingSize += length;
+            g_free(contents);
+        }
+        LoggerD("Removing least recently used contact photo: " << fileName);
+        g_unlink(fileName.c_str());
+        // the thumbnail of the referenced photo is kept, it's listed in the responses
+        auto thumbnail = mThumbnails.find(key);
+        if(thumbnail != mThumbnails.end() && !isKept(key)) {
+            makeThumbnailFileName(key, fileName);
+            g_unlink(fileName.c_str());
+            mFilesSize -= (*thumbnail).second;
+            mThumbnails.erase(thumbnail);
+        }
+    }
+}
+
+bool PhotoStore::isKept(const std::string &key) const {
+    return mReferenced.find(key) != mReferenced.end() || mPending.find(key) != mPending.end() || mFiles.find(key) != mFiles.end();
+}
+
+void PhotoStore::requestThumbnail(const std::string &key, const std::string &photo) {
+    if(!mThumbnailer)
+        return;
+
+    ThumbnailTask *task = new ThumbnailTask;
+    task->store = this;
+    task->key = key;
+    task->photo = photo;
+    g_thread_pool_push(mThumbnailer, task, NULL);
+}
+
+void PhotoStore::addThumbnail(const std::string &key, size_t size) {
+    g_mutex_lock(&mLock);
+    if(isKept(key)) {
+        size_t &thumbnailSize = mThumbnails[key];
+        mFilesSize += size - thumbnailSize;
+        thumbnailSize = size;
+        evict();
+    }
+    else {
+        // the photo has been dropped, while the thumbnail was being made
+        std::string fileName;
+        makeThumbnailFileName(key, fileName);
+        g_unlink(fileName.c_str());
+    }
+    g_mutex_unlock(&mLock);
+}
+
+bool PhotoStore::hasThumbnail(const std::string &key) const {
+    g_mutex_lock(&mLock);
+    bool exists = mThumbnails.find(key) != mThumbnails.end();
+    g_mutex_unlock(&mLock);
+    return exists;
+}
+
+// scales the image down, while it's decoded, eg. JPEG decoder decodes the image directly in lower resolution
+void PhotoStore::thumbnailSizePrepared(GdkPixbufLoader *loader, gint width, gint height, gpointer user_data) {
+    if(width <= THUMBNAIL_SIZE && height <= THUMBNAIL_SIZE)
+        return;
+    if(width >= height)
+        gdk_pixbuf_loader_set_size(loader, THUMBNAIL_SIZE, MAX(1, height * THUMBNAIL_SIZE / width));
+    else
+        gdk_pixbuf_loader_set_size(loader, MAX(1, width * THUMBNAIL_SIZE / height), THUMBNAIL_SIZE);
+}
+
+// runs on the thumbnailer thread
+void PhotoStore::makeThumbnail(gpointer data, gpointer user_data) {
+    ThumbnailTask *task = static_cast<ThumbnailTask*>(data);
+    if(!task)
+        return;
+    if(g_atomic_int_get(&task->store->mStopping)) {
+        delete task;
+        return;
+    }
+
+    GError *err = NULL;
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(PhotoStore::thumbnailSizePrepared), NULL);
+    bool decoded = gdk_pixbuf_loader_write(loader, (const guchar*)task->photo.data(), task->photo.size(), &err);
+    // the loader has to be closed, even if writing has failed
+    decoded = gdk_pixbuf_loader_close(loader, decoded ? &err : NULL) && decoded;
+    GdkPixbuf *pixbuf = decoded ? gdk_pixbuf_loader_get_pixbuf(loader) : NULL;
+
+    gchar *buffer = NULL;
+    gsize length = 0;
+    if(pixbuf && gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &length, "png", &err, NULL)) {
+        std::string fileName;
+        task->store->makeThumbnailFileName(task->key, fileName);
+        if(g_file_set_contents(fileName.c_str(), buffer, length, &err)) {
+            LoggerD("Saved thumbnail of contact photo: " << fileName);
+            task->store->addThumbnail(task->key, length);
+        }
+        g_free(buffer);
+    }
+    if(err) {
+        LoggerE("Unable to make thumbnail of contact photo " << task->key << ": " << err->message);
+        g_error_free(err);
+    }
+
+    g_object_unref(loader);
+    delete task;
+}
+
+PhotoPins::~PhotoPins() {
+    for(auto it = mKeys.begin(); it != mKeys.end(); ++it)
+        mStore->unpin(*it);
+}
+
+bool PhotoPins::materialize(const std::string &key) {
+    // the photo of more entries is pinned once
+    if(contains(key))
+        return true;
+    if(!mStore->materialize(key, true))
+        return false;
+    mKeys.insert(key);
+    return true;
+}
+
+} // PhoneD
+
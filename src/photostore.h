@@ -0,0 +1,220 @@
+#ifndef PHOTOSTORE_H_
+#define PHOTOSTORE_H_
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::PhotoStore
+ *  \brief Store of contact photos, addressed by the hash of their content.
+ *
+ * The photos are stored in \b $HOME/.phoned-photos directory, in a file named by SHA-1 of the photo, so that the same photo is
+ * stored only once, regardless of how many contacts, or synchronizations, it comes from. A photo received in the VCard is only
+ * hashed and kept in memory (pending), the file is written once a client asks for the contact, ie. for its \b photoURI, see
+ * materialize(). The size of the directory is bounded, the least recently requested photos are removed, once it is exceeded,
+ * and pending photos are written immediately, once their size in memory exceeds its limit. A removed photo, which is still
+ * referenced by the synchronized entries, see prune(), is read back as pending, so that it's written again, once requested.
+ * The photos pinned by a response being serialized are not removed, see PhotoPins. All methods are thread-safe.
+ *
+ * For each added photo, a downscaled thumbnail, eg. for the avatars in the lists of contacts, is made on a background thread and
+ * stored as PNG file next to the photo, so that it's available before the photo is written. The thumbnail is counted in the size
+ * of the store and it's removed, once the photo is neither referenced, nor stored.
+ */
+class PhotoStore {
+    public:
+        /**
+         * A default constructor. Reads the photos already stored in the directory.
+         */
+        PhotoStore();
+
+        /**
+         * A destructor. Pending photos, which have not been written, and the thumbnails, which have not been made yet, are dropped.
+         */
+        ~PhotoStore();
+
+        /**
+         * Adds the photo to the store and queues making of its thumbnail. Nothing is written, if the same photo is already stored,
+         * or pending.
+         * @param[in] data The photo.
+         * @param[in] length Length of the photo.
+         * @param[out] key The key of the photo, ie. hash of its content.
+         * @return \b False, if the photo is empty.
+         */
+        bool add(const guchar *data, gsize length, std::string &key);
+
+        /**
+         * Writes the pending photo into its file, if it has not been written yet, and marks the photo as recently used.
+         * @param[in] key The key of the photo.
+         * @param[in] pin Whether to pin the photo, ie. not to remove it, until unpin() is called. The photo is pinned only if its file exists.
+         * @return \b True, if the file of the photo exists.
+         */
+        bool materialize(const std::string &key, bool pin = false);
+
+        /**
+         * Releases the photo pinned by materialize().
+         * @param[in] key The key of the photo.
+         */
+        void unpin(const std::string &key);
+
+        /**
+         * Makes URI of the file of the photo, regardless whether the file has been written.
+         * @param[in] key The key of the photo.
+         * @param[out] uri A container for the URI, eg. \b file:///home/app/.phoned-photos/0123456789abcdef0123456789abcdef01234567.jif
+         */
+        void getUri(const std::string &key, std::string &uri) const;
+
+        /**
+         * Makes URI of the file of the thumbnail of the photo, regardless whether the file has been written.
+         * @param[in] key The key of the photo.
+         * @param[out] uri A container for the URI, eg. \b file:///home/app/.phoned-photos/0123456789abcdef0123456789abcdef01234567.thumb.png
+         */
+        void getThumbnailUri(const std::string &key, std::string &uri) const;
+
+        /**
+         * Checks whether the thumbnail of the photo has been made.
+         * @param[in] key The key of the photo.
+         * @return \b True, if the file of the thumbnail exists.
+         */
+        bool hasThumbnail(const std::string &key) const;
+
+        /**
+         * Extracts the key of the photo from the URI made by getUri().
+         * @param[in] uri The URI of the photo.
+         * @param[out] key A container for the key.
+         * @return \b False, if the URI doesn't reference a photo in the store.
+         */
+        bool getKey(const char *uri, std::string &key) const;
+
+        /**
+         * Gets the photos, which have not been written yet, eg. to store them into the persistent cache of the phonebook.
+         * @param[out] photos Pairs of the key and the photo.
+         */
+        void getPending(std::vector<std::pair<std::string, std::string> > &photos) const;
+
+        /**
+         * Adds the photo, which has been read from the persistent cache of the phonebook, as pending.
+         * @param[in] key The key of the photo.
+         * @param[in] photo The photo.
+         */
+        void addPending(const std::string &key, const std::string &photo);
+
+        /**
+         * Sets the photos referenced by the synchronized entries. Pending photos, which are not referenced, are dropped, unless they have
+         * been added since the previous call, ie. they may belong to the entries being synchronized. The referenced photos are read back
+         * as pending, once their files are removed.
+         * @param[in] keys The keys of the referenced photos.
+         */
+        void prune(const std::unordered_set<std::string> &keys);
+
+    private:
+        struct File {
+            size_t size;
+            std::list<std::string>::iterator lru; // position in mLru
+        };
+
+        struct Pending {
+            std::string photo;
+            bool stale; // it was not referenced by the entries at the last prune()
+        };
+
+        struct ThumbnailTask {
+            PhotoStore *store;
+            std::string key;
+            std::string photo;
+        };
+
+        // all methods below, except the thumbnail ones, expect the lock to be held
+        void makeFileName(const std::string &key, std::string &fileName) const;
+        void makeThumbnailFileName(const std::string &key, std::string &fileName) const;
+        bool write(const std::string &key, const std::string &photo);
+        void unpinLocked(const std::string &key);
+        // removes the least recently used photos, which are not pinned, once the size of the store is exceeded
+        void evict();
+        // checks whether the photo is referenced, pending or written, ie. its thumbnail is kept
+        bool isKept(const std::string &key) const;
+        // queues making of the thumbnail
+        void requestThumbnail(const std::string &key, const std::string &photo);
+        // accounts the thumbnail made by the thumbnailer thread, it takes the lock
+        void addThumbnail(const std::string &key, size_t size);
+        // makes the thumbnail on the thumbnailer thread
+        static void makeThumbnail(gpointer data, gpointer user_data);
+        static void thumbnailSizePrepared(GdkPixbufLoader *loader, gint width, gint height, gpointer user_data);
+
+    private:
+        PhotoStore(const PhotoStore&);
+        PhotoStore &operator=(const PhotoStore&);
+
+    private:
+        mutable GMutex mLock;
+        std::string mDir;
+        std::unordered_map<std::string, File> mFiles;          // key -> written photo
+        std::list<std::string> mLru;                           // keys of written photos, the most recently used first
+        size_t mFilesSize;
+        std::unordered_map<std::string, Pending> mPending;     // key -> photo, which has not been written yet
+        size_t mPendingSize;
+        std::unordered_map<std::string, unsigned int> mPinned; // key -> number of responses, which pinned the photo
+        std::unordered_set<std::string> mReferenced;           // keys of the photos referenced by the synchronized entries
+        std::unordered_map<std::string, size_t> mThumbnails;   // key -> size of the written thumbnail, accounted to mFilesSize
+        GThreadPool *mThumbnailer; // a single thread making the thumbnails
+        volatile gint mStopping;   // the queued thumbnails are dropped, once it's set
+};
+
+/*! \class PhoneD::PhotoPins
+ *  \brief Photos materialized for a response to the client.
+ *
+ * The photos are pinned in PhotoStore while the response referencing them is serialized, so that a large response doesn't remove
+ * the photos it has materialized itself. The photos are unpinned, once the object is destroyed.
+ */
+class PhotoPins {
+    public:
+        /**
+         * A constructor.
+         * @param[in] store The store of the photos.
+         */
+        PhotoPins(PhotoStore *store) : mStore(store) {}
+
+        /**
+         * A destructor. Unpins the photos.
+         */
+        ~PhotoPins();
+
+        /**
+         * Materializes and pins the photo, see PhotoStore::materialize().
+         * @param[in] key The key of the photo.
+         * @return \b True, if the file of the photo exists.
+         */
+        bool materialize(const std::string &key);
+
+        /**
+         * Checks whether the photo has been materialized by this object.
+         * @param[in] key The key of the photo.
+         * @return \b True, if the file of the photo exists and it's pinned.
+         */
+        bool contains(const std::string &key) const { return mKeys.find(key) != mKeys.end(); }
+
+    private:
+        PhotoPins(const PhotoPins&);
+        PhotoPins &operator=(const PhotoPins&);
+
+    private:
+        PhotoStore *mStore;
+        std::unordered_set<std::string> mKeys; // pinned photos
+};
+
+} // PhoneD
+
+#endif /* PHOTOSTORE_H_ */
+
+/** @} */
+
@@ -5,6 +5,7 @@
 #include <algorithm>
 
 #include "utils.h"
+#include "jsonwriter.h"
 
 #include "Logger.h"
 
@@ -15,66 +16,333 @@ GQuark g_phone_error_quark(void)
     return g_quark_from_static_string("g-phone-error-quark");
 }
 
-std::map<std::string, guint> Utils::mSubsIdsMap;
+std::unordered_map<Utils::SignalKey, Utils::Subscription, Utils::SignalKeyHash> Utils::mSubscriptions;
+std::unordered_map<std::string, Utils::SignalKeys> Utils::mSubscriptionsByPath;
+std::unordered_map<void*, Utils::SignalKeys> Utils::mSubscriptionsByData;
+// the signals are subscribed from the main loop and from the ingest thread of Obex
+G_LOCK_DEFINE_STATIC(subscriptions);
 
+void Utils::makeSignalKey(GBusType type, const char *service, const char *iface, const char *path, const char *name, SignalKey &key) {
+    key.type = type;
+    key.service = g_quark_from_string(service);
+    key.iface = g_quark_from_string(iface);
+    key.name = g_quark_from_string(name);
+    key.path = path ? path : "";
+}
+
+void Utils::formatSignalKey(const SignalKey &key, std::string &str) {
+    // BUS_TYPE:SERVICE:IFACE:OBJ_PATH:SIGNAL
+    str = (key.type == G_BUS_TYPE_SYSTEM) ? "SYSTEM" : (key.type == G_BUS_TYPE_SESSION) ? "SESSION" : "";
+    str += std::string(":") + g_quark_to_string(key.service) + ":" + g_quark_to_string(key.iface) + ":" + key.path + ":" + g_quark_to_string(key.name);
+}
 
 bool Utils::setSignalListener(GBusType type, const char *service,
                               const char *iface, const char *path,
                               const char *name, GDBusSignalCallback cb,
                               void *data)
 {
-    // key is of form: BUS_TYPE:SERVICE:IFACE:OBJ_PATH:SIGNAL
-    const char *bus_type = (type == G_BUS_TYPE_SYSTEM) ? "SYSTEM" : (type == G_BUS_TYPE_SESSION) ? "SESSION" : "";
-    std::string key = std::string(bus_type) + ":" + service + ":" + iface + ":" + path + ":" + name;
-    LoggerD("subscribing for DBUS signal: " << key);
+    SignalKey key;
+    makeSignalKey(type, service, iface, path, name, key);
+    LoggerD("subscribing for DBUS signal: " << service << ":" << iface << ":" << (path?path:"") << ":" << name);
 
     // only one listener (subscription on DBUS signal) allowed for specific signal
-    if(mSubsIdsMap[key] <= 0) { // not yet subscribed for DBUS signal
-        guint id = 0;
-        id = g_dbus_connection_signal_subscribe(g_bus_get_sync(type, NULL, NULL),
-                                                service,
-                                                iface,
-                                                name,
-                                                path,
-                                                NULL,
-                                                G_DBUS_SIGNAL_FLAGS_NONE,
-                                                cb,
-                                                data,
-                                                NULL);
-
-        if(id == 0) {
-            LoggerE("Failed to subscribe to: " << key);
-            return false;
-        }
-
-        mSubsIdsMap[key] = id;
+    G_LOCK(subscriptions);
+    if(mSubscriptions.find(key) != mSubscriptions.end()) {
+        G_UNLOCK(subscriptions);
+        // already subscribed for DBUS signal
+        return false;
+    }
 
-        return true; // success
+    guint id = g_dbus_connection_signal_subscribe(BusConnection::get(type),
+                                                  service,
+                                                  iface,
+                                                  name,
+                                                  path,
+                                                  NULL,
+                                                  G_DBUS_SIGNAL_FLAGS_NONE,
+                                                  cb,
+                                                  data,
+                                                  NULL);
+    if(id == 0) {
+        G_UNLOCK(subscriptions);
+        LoggerE("Failed to subscribe to: " << service << ":" << iface << ":" << (path?path:"") << ":" << name);
+        return false;
     }
 
-    // already subscribed for DBUS signal
-    return false;
+    Subscription subscription = { id, data };
+    mSubscriptions.insert(std::make_pair(key, subscription));
+    mSubscriptionsByPath[key.path].insert(key);
+    mSubscriptionsByData[data].insert(key);
+    G_UNLOCK(subscriptions);
+
+    return true; // success
 }
 
 void Utils::removeSignalListener(GBusType type, const char *service,
                                  const char* iface, const char* path,
                                  const char* name)
 {
+    SignalKey key;
+    makeSignalKey(type, service, iface, path, name, key);
+    LoggerD("unsubscribing from DBUS signal: " << service << ":" << iface << ":" << (path?path:"") << ":" << name);
+
+    G_LOCK(subscriptions);
+    removeSubscription(key);
+    G_UNLOCK(subscriptions);
+}
+
+void Utils::removeSubscription(const SignalKey &key) {
+    auto it = mSubscriptions.find(key);
+    if(it == mSubscriptions.end())
+        return;
+
+    g_dbus_connection_signal_unsubscribe(BusConnection::get(key.type), (*it).second.id);
+
+    auto path = mSubscriptionsByPath.find(key.path);
+    if(path != mSubscriptionsByPath.end()) {
+        (*path).second.erase(key);
+        if((*path).second.empty())
+            mSubscriptionsByPath.erase(path);
+    }
+    auto data = mSubscriptionsByData.find((*it).second.data);
+    if(data != mSubscriptionsByData.end()) {
+        (*data).second.erase(key);
+        if((*data).second.empty())
+            mSubscriptionsByData.erase(data);
+    }
+
+    mSubscriptions.erase(it);
+}
 
-    // key is of form: BUS_TYPE:SERVICE:IFACE:OBJ_PATH:SIGNAL
-    const char *bus_type = (type == G_BUS_TYPE_SYSTEM) ? "SYSTEM" : (type == G_BUS_TYPE_SESSION) ? "SESSION" : "";
-    std::string key = std::string(bus_type) + ":" + service + ":" + iface + ":" + path + ":" + name;
-    LoggerD("unsubscribing from DBUS signal: " << key);
-
-    std::map<std::string, guint>::iterator iter = mSubsIdsMap.begin();
-    while(iter != mSubsIdsMap.end()) {
-        if(!strcmp(key.c_str(), (*iter).first.c_str())) {
-            g_dbus_connection_signal_unsubscribe(g_bus_get_sync(type, NULL, NULL), (*iter).second);
-            mSubsIdsMap.erase(iter);
-            break;
+void Utils::removeSignalListeners(GBusType type, const char *path) {
+    if(!path)
+        return;
+
+    G_LOCK(subscriptions);
+    auto it = mSubscriptionsByPath.find(path);
+    if(it != mSubscriptionsByPath.end()) {
+        // the keys are copied, since the set is modified, or even removed, by removeSubscription()
+        SignalKeys keys = (*it).second;
+        for(auto key = keys.begin(); key != keys.end(); ++key) {
+            if((*key).type != type)
+                continue;
+            LoggerD("unsubscribing from DBUS signal: " << g_quark_to_string((*key).name) << " of removed object: " << path);
+            removeSubscription(*key);
         }
-        iter++;
     }
+    G_UNLOCK(subscriptions);
+}
+
+void Utils::removeSignalListeners(void *data) {
+    G_LOCK(subscriptions);
+    auto it = mSubscriptionsByData.find(data);
+    if(it != mSubscriptionsByData.end()) {
+        // the keys are copied, since the set is removed by removeSubscription() with the last key
+        SignalKeys keys = (*it).second;
+        for(auto key = keys.begin(); key != keys.end(); ++key)
+            removeSubscription(*key);
+    }
+    G_UNLOCK(subscriptions);
+}
+
+size_t Utils::getSignalListenerCount() {
+    G_LOCK(subscriptions);
+    size_t count = mSubscriptions.size();
+    G_UNLOCK(subscriptions);
+    return count;
+}
+
+void Utils::dumpSignalListeners(std::string &json) {
+    json.clear();
+    JsonWriter writer(json);
+    writer.beginObject();
+    G_LOCK(subscriptions);
+    writer.number("count", mSubscriptions.size());
+    writer.beginArray("listeners");
+    std::string key;
+    for(auto it = mSubscriptions.begin(); it != mSubscriptions.end(); ++it) {
+        formatSignalKey((*it).first, key);
+        writer.string(NULL, key.c_str());
+    }
+    G_UNLOCK(subscriptions);
+    writer.endArray();
+    writer.endObject();
+}
+
+unsigned long SignalStats::mRouted = 0;
+std::map<std::string, unsigned long> SignalStats::mUnhandled;
+// the signals are dispatched on the main loop and on the ingest thread of Obex
+G_LOCK_DEFINE_STATIC(signal_stats);
+
+void SignalStats::routed() {
+    G_LOCK(signal_stats);
+    mRouted++;
+    G_UNLOCK(signal_stats);
+}
+
+void SignalStats::unhandled(const char *iface, const char *name) {
+    std::string key = std::string(iface?iface:"") + "." + (name?name:"");
+    LoggerD("un-handled signal: " << key);
+
+    G_LOCK(signal_stats);
+    mUnhandled[key]++;
+    G_UNLOCK(signal_stats);
+}
+
+void SignalStats::toJson(std::string &json) {
+    json.clear();
+    JsonWriter writer(json);
+    writer.beginObject();
+    G_LOCK(signal_stats);
+    writer.number("routed", mRouted);
+    writer.beginObject("unhandled");
+    for(auto it = mUnhandled.begin(); it != mUnhandled.end(); ++it)
+        writer.number((*it).first.c_str(), (*it).second);
+    G_UNLOCK(signal_stats);
+    writer.endObject();
+    writer.endObject();
+}
+
+G_LOCK_DEFINE_STATIC(bus_connection);
+
+BusConnection::Bus BusConnection::mSystemBus = { NULL, 0, 0, 0, 0 };
+BusConnection::Bus BusConnection::mSessionBus = { NULL, 0, 0, 0, 0 };
+
+BusConnection::Bus *BusConnection::getBus(GBusType type) {
+    if(type == G_BUS_TYPE_SYSTEM)
+        return &mSystemBus;
+    if(type == G_BUS_TYPE_SESSION)
+        return &mSessionBus;
+    return NULL;
+}
+
+GDBusConnection *BusConnection::connect(GBusType type) {
+    GError *err = NULL;
+    GDBusConnection *connection = g_bus_get_sync(type, NULL, &err);
+    if(!connection) {
+        LoggerE("Failed to connect to " << (type == G_BUS_TYPE_SYSTEM ? "SYSTEM" : "SESSION") << " bus: " << (err?err->message:"unknown error"));
+        if(err)
+            g_error_free(err);
+        return NULL;
+    }
+    // the process exits, when the bus connection is closed, the signal subscriptions, the registered objects and the owned names
+    // are lost with the connection, and they are made again, when the service is restarted
+    g_dbus_connection_set_exit_on_close(connection, TRUE);
+    return connection;
+}
+
+GDBusConnection *BusConnection::get(GBusType type) {
+    Bus *bus = getBus(type);
+    if(!bus) {
+        LoggerE("Invalid bus type: " << type);
+        return NULL;
+    }
+
+    G_LOCK(bus_connection);
+    bus->requests++;
+    if(!bus->connection) {
+        bus->connection = connect(type);
+        if(bus->connection) {
+            bus->connects++;
+            bus->closedHandlerId = g_signal_connect(bus->connection, "closed", G_CALLBACK(BusConnection::closedCb), bus);
+            LoggerD("Connected to " << (type == G_BUS_TYPE_SYSTEM ? "SYSTEM" : "SESSION") << " bus (connections: " << bus->connects << ")");
+        }
+    }
+    GDBusConnection *connection = bus->connection;
+    G_UNLOCK(bus_connection);
+
+    return connection;
+}
+
+void BusConnection::closedCb(GDBusConnection *connection, gboolean remotePeerVanished, GError *error, gpointer user_data) {
+    Bus *bus = static_cast<Bus*>(user_data);
+    if(!bus)
+        return;
+
+    LoggerE("Bus connection closed: " << (error?error->message:"unknown reason"));
+
+    // the connection is not dropped, the threads may still use it, the process is going to exit, see connect()
+    G_LOCK(bus_connection);
+    if(bus->connection == connection)
+        bus->disconnects++;
+    G_UNLOCK(bus_connection);
+}
+
+void BusConnection::release() {
+    Bus *buses[] = { &mSystemBus, &mSessionBus };
+    G_LOCK(bus_connection);
+    for(unsigned int i=0; i<sizeof(buses)/sizeof(buses[0]); i++) {
+        if(buses[i]->connection) {
+            g_signal_handler_disconnect(buses[i]->connection, buses[i]->closedHandlerId);
+            g_object_unref(buses[i]->connection);
+            buses[i]->connection = NULL;
+            buses[i]->closedHandlerId = 0;
+        }
+    }
+    G_UNLOCK(bus_connection);
+}
+
+unsigned long BusConnection::getRequests(GBusType type) {
+    Bus *bus = getBus(type);
+    return bus ? bus->requests : 0;
+}
+
+unsigned long BusConnection::getConnects(GBusType type) {
+    Bus *bus = getBus(type);
+    return bus ? bus->connects : 0;
+}
+
+unsigned long BusConnection::getDisconnects(GBusType type) {
+    Bus *bus = getBus(type);
+    return bus ? bus->disconnects : 0;
+}
+
+// number of the latest samples kept to compute percentiles of the latency
+#define LATENCY_STATS_CAPACITY             1024
+
+LatencyStats::LatencyStats() :
+    mNext(0),
+    mCount(0),
+    mMax(0)
+{
+    mSamples.reserve(LATENCY_STATS_CAPACITY);
+}
+
+void LatencyStats::add(gint64 usec) {
+    if(mSamples.size() < LATENCY_STATS_CAPACITY)
+        mSamples.push_back(usec);
+    else
+        mSamples[mNext] = usec;
+    mNext = (mNext + 1) % LATENCY_STATS_CAPACITY;
+    mCount++;
+    if(usec > mMax)
+        mMax = usec;
+}
+
+gint64 LatencyStats::percentile(unsigned int percent) const {
+    if(mSamples.empty())
+        return 0;
+    if(percent > 100)
+        percent = 100;
+
+    // nearest-rank percentile
+    std::vector<gint64> samples(mSamples);
+    size_t rank = (samples.size() * percent + 99) / 100;
+    size_t index = rank > 0 ? rank - 1 : 0;
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+void LatencyStats::toJson(std::string &json) const {
+    json.clear();
+    JsonWriter writer(json, 96);
+    writer.beginObject();
+    writer.number("count", mCount);
+    writer.number("p50", percentile(50));
+    writer.number("p90", percentile(90));
+    writer.number("p99", percentile(99));
+    writer.number("max", mMax);
+    writer.endObject();
 }
 
 // makes AABBCCDDEEFF from AA:BB:CC:DD:EE:FF
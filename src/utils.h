@@ -7,6 +7,9 @@
 #include <gio/gio.h>
 #include <string>
 #include <map>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace PhoneD {
 
@@ -86,6 +89,12 @@ GQuark g_phone_error_quark(void);
 
 /*! \class PhoneD::Utils
  *  \brief Utility class providing helper functions for operating with Phone.
+ *
+ * The subscriptions to D-Bus signals are kept in a registry keyed by the bus, the service, the interface, the object path and
+ * the signal name, the names (but the object paths, which come and go) are interned as quarks. Only one subscription is allowed for each key.
+ * The subscriptions are removed either one by one, or all subscriptions of an object, which has gone away, or all subscriptions made
+ * with given user data, once the data is destroyed, see SignalRouter. The keys are indexed also by the object path and by the user data,
+ * so that the removal takes only the subscriptions, which are removed.
  */
 class Utils {
     public:
@@ -104,10 +113,10 @@ class Utils {
          * @param[in] type A type of the bus that the signal should be subscribed on. See <a href="https://developer.gnome.org/gio/2.35/GDBusConnection.html#GBusType">GBusType</a> documentation.
          * @param[in] service Service name to match on (unique or well-known name).
          * @param[in] iface D-Bus interface name to match on.
-         * @param[in] path Object path to match on.
+         * @param[in] path Object path to match on, or \b NULL to match on all objects of the service.
          * @param[in] name D-Bus signal name to match on.
          * @param[in] cb Callback to invoke when there is a signal matching the requested data. See <a href="https://developer.gnome.org/gio/2.35/GDBusConnection.html#GDBusSignalCallback">GDBusSignalCallback</a> documentation.
-         * @param[in] data User data to pass to \b cb.
+         * @param[in] data User data to pass to \b cb, the subscription can be removed by the data, see removeSignalListeners(gpointer).
          * @return a bool indicating success of setting listener
          */
         static bool setSignalListener(GBusType type, const char *service, const char *iface,
@@ -124,8 +133,301 @@ class Utils {
         static void removeSignalListener(GBusType type, const char *service, const char *iface,
                                          const char *path,   const char *name);
 
+        /**
+         * Unsubscribes from all signals of the object, eg. when the object has been removed.
+         * @param[in] type A type of the bus that the signals are subscribed to.
+         * @param[in] path Object path of the object.
+         */
+        static void removeSignalListeners(GBusType type, const char *path);
+
+        /**
+         * Unsubscribes from all signals subscribed with given user data, eg. when the data is destroyed.
+         * @param[in] data User data passed to setSignalListener().
+         */
+        static void removeSignalListeners(void *data);
+
+        /**
+         * Gets the number of the subscriptions to D-Bus signals.
+         * @return The number of the subscriptions.
+         */
+        static size_t getSignalListenerCount();
+
+        /**
+         * Formats the subscriptions as JSON object: \b {"count":N,"listeners":["BUS_TYPE:SERVICE:IFACE:OBJ_PATH:SIGNAL",...]}, eg. to find out leaked subscriptions.
+         * @param[out] json A container for the JSON object, its previous content is replaced.
+         */
+        static void dumpSignalListeners(std::string &json);
+
+    private:
+        // structured key of the subscription, the names are interned, the object path is not,
+        // since the objects (eg. the transfers) come and go
+        struct SignalKey {
+            GBusType type;
+            GQuark service;
+            GQuark iface;
+            GQuark name;
+            std::string path;
+            bool operator==(const SignalKey &other) const {
+                return type == other.type && service == other.service && iface == other.iface && name == other.name && path == other.path;
+            }
+        };
+        struct SignalKeyHash {
+            size_t operator()(const SignalKey &key) const {
+                size_t hash = std::hash<std::string>()(key.path);
+                hash = hash * 31 + key.type;
+                hash = hash * 31 + key.service;
+                hash = hash * 31 + key.iface;
+                return hash * 31 + key.name;
+            }
+        };
+        struct Subscription {
+            guint id;
+            void *data;
+        };
+        typedef std::unordered_set<SignalKey, SignalKeyHash> SignalKeys;
+        static void makeSignalKey(GBusType type, const char *service, const char *iface, const char *path, const char *name, SignalKey &key);
+        static void formatSignalKey(const SignalKey &key, std::string &str);
+        // unsubscribes and removes the subscription from the registry and from the indexes, the lock is held by the caller
+        static void removeSubscription(const SignalKey &key);
+
     private: // viriables
-        static std::map<std::string, guint> mSubsIdsMap; /*! A map that holds ids of subscriptions to DBUS signals */
+        static std::unordered_map<SignalKey, Subscription, SignalKeyHash> mSubscriptions; /*! A registry of subscriptions to DBUS signals */
+        static std::unordered_map<std::string, SignalKeys> mSubscriptionsByPath;       /*! Keys of the subscriptions by the object path */
+        static std::unordered_map<void*, SignalKeys> mSubscriptionsByData;             /*! Keys of the subscriptions by the user data */
+};
+
+/*! \class PhoneD::SignalStats
+ *  \brief Counters of D-Bus signals dispatched by SignalRouter-s, shared by all routers.
+ */
+class SignalStats {
+    public:
+        /**
+         * Counts the signal, which has been routed to its target.
+         */
+        static void routed();
+
+        /**
+         * Counts the signal, which doesn't have a route, or which has parameters of unexpected type.
+         * @param[in] iface D-Bus interface name of the signal.
+         * @param[in] name D-Bus signal name.
+         */
+        static void unhandled(const char *iface, const char *name);
+
+        /**
+         * Formats the counters as JSON object: \b {"routed":N,"unhandled":{"IFACE.SIGNAL":N,...}}.
+         * @param[out] json A container for the JSON object, its previous content is replaced.
+         */
+        static void toJson(std::string &json);
+
+    private: // variables
+        static unsigned long mRouted;                            /*! Number of the routed signals */
+        static std::map<std::string, unsigned long> mUnhandled;  /*! IFACE.SIGNAL -> number of the unhandled signals */
+};
+
+/*! \class PhoneD::SignalRouter
+ *  \brief Routes D-Bus signals to the member functions of the object, which subscribes for them.
+ *
+ * A route is added once for each interface and signal name, together with the type of the signal parameters, which is parsed from
+ * the signature only once. The object subscribes for the signals by subscribe(), which uses Utils::setSignalListener() with the router
+ * as the user data, so that the subscriptions are removed, once the router is destroyed. A received signal is looked-up by the quarks of its interface and name, ie. without comparing the strings, and its
+ * parameters are checked against the type of the route, so that the target can read them without further checks. The signals, which
+ * don't have a route, or which have unexpected parameters, are not dispatched, they are counted by SignalStats instead.
+ */
+template<class T>
+class SignalRouter {
+    public:
+        /**
+         * A target of the route, the member function of the object.
+         * @param[in] objectPath The object path the signal was emitted on.
+         * @param[in] parameters The parameters of the signal, they have the type given by add().
+         */
+        typedef void (T::*Target)(const gchar *objectPath, GVariant *parameters);
+
+        /**
+         * A constructor.
+         * @param[in] object The object, which the signals are routed to, the router is usually its member.
+         */
+        SignalRouter(T *object) : mObject(object) {}
+
+        /**
+         * A destructor. Unsubscribes from the signals subscribed by subscribe().
+         */
+        ~SignalRouter() {
+            Utils::removeSignalListeners(this);
+            for(auto it = mRoutes.begin(); it != mRoutes.end(); ++it)
+                g_variant_type_free((*it).second.type);
+        }
+
+        /**
+         * Adds the route, it replaces the route of the same signal. The routes have to be added before the signals are subscribed.
+         * @param[in] iface D-Bus interface name of the signal.
+         * @param[in] name D-Bus signal name.
+         * @param[in] signature GVariant type of the signal parameters, eg. \b "(sv)".
+         * @param[in] target The member function, which handles the signal.
+         */
+        void add(const char *iface, const char *name, const char *signature, Target target) {
+            Route &route = mRoutes[key(g_quark_from_string(iface), g_quark_from_string(name))];
+            if(route.type)
+                g_variant_type_free(route.type);
+            route.type = g_variant_type_new(signature);
+            route.target = target;
+        }
+
+        /**
+         * Subscribes for the signal, see Utils::setSignalListener().
+         * @param[in] type A type of the bus that the signal should be subscribed on.
+         * @param[in] service Service name to match on.
+         * @param[in] iface D-Bus interface name to match on.
+         * @param[in] path Object path to match on.
+         * @param[in] name D-Bus signal name to match on.
+         * @return a bool indicating success of setting listener
+         */
+        bool subscribe(GBusType type, const char *service, const char *iface, const char *path, const char *name) {
+            return Utils::setSignalListener(type, service, iface, path, name, SignalRouter<T>::handleSignal, this);
+        }
+
+    private:
+        SignalRouter(const SignalRouter&);
+        SignalRouter &operator=(const SignalRouter&);
+
+        struct Route {
+            Route() : type(NULL), target(NULL) {}
+            GVariantType *type;
+            Target target;
+        };
+
+        static guint64 key(GQuark iface, GQuark name) { return ((guint64)iface << 32) | name; }
+
+        static void handleSignal(GDBusConnection *connection,  const gchar     *sender,
+                                 const gchar     *object_path, const gchar     *interface_name,
+                                 const gchar     *signal_name, GVariant        *parameters,
+                                 gpointer         user_data)
+        {
+            SignalRouter<T> *router = static_cast<SignalRouter<T>*>(user_data);
+            // the quarks of the routed signals exist already, a signal without a route doesn't make new ones
+            auto it = router->mRoutes.find(key(g_quark_try_string(interface_name), g_quark_try_string(signal_name)));
+            if(it == router->mRoutes.end() || !parameters || !g_variant_is_of_type(parameters, (*it).second.type)) {
+                SignalStats::unhandled(interface_name, signal_name);
+                return;
+            }
+            SignalStats::routed();
+            (router->mObject->*(*it).second.target)(object_path, parameters);
+        }
+
+    private: // variables
+        T *mObject;
+        std::unordered_map<guint64, Route> mRoutes; // quarks of the interface and the signal name -> route
+};
+
+/*! \class PhoneD::BusConnection
+ *  \brief A class owning connections to the system and the session D-Bus, shared by all classes.
+ *
+ * The connections are made on the first request and kept for the lifetime of the process, so that the connection returned
+ * by get() can be used by any thread without taking a reference. When a connection is closed, eg. the bus daemon is restarted,
+ * the process exits, to be restarted by the service manager, since the signal subscriptions, the registered objects and the owned
+ * names are lost with the connection. The number of requests, connections made and connections lost is counted for each bus.
+ */
+class BusConnection {
+    public:
+        /**
+         * Returns the connection to the bus, connecting to the bus if it is not connected.
+         * @param[in] type A type of the bus: \b G_BUS_TYPE_SYSTEM, or \b G_BUS_TYPE_SESSION. See <a href="https://developer.gnome.org/gio/2.35/GDBusConnection.html#GBusType">GBusType</a> documentation.
+         * @return The connection, or \b NULL if it is not possible to connect to the bus. The connection is owned by the BusConnection and must not be unref-ed.
+         */
+        static GDBusConnection *get(GBusType type);
+
+        /**
+         * Releases the connections to both buses, eg. when the process is exiting.
+         */
+        static void release();
+
+        /**
+         * Returns the number of requests for the connection to the bus, see BusConnection::get().
+         * @param[in] type A type of the bus: \b G_BUS_TYPE_SYSTEM, or \b G_BUS_TYPE_SESSION.
+         * @return The number of requests.
+         */
+        static unsigned long getRequests(GBusType type);
+
+        /**
+         * Returns the number of connections made to the bus.
+         * @param[in] type A type of the bus: \b G_BUS_TYPE_SYSTEM, or \b G_BUS_TYPE_SESSION.
+         * @return The number of connections.
+         */
+        static unsigned long getConnects(GBusType type);
+
+        /**
+         * Returns the number of connections to the bus, which have been closed.
+         * @param[in] type A type of the bus: \b G_BUS_TYPE_SYSTEM, or \b G_BUS_TYPE_SESSION.
+         * @return The number of closed connections.
+         */
+        static unsigned long getDisconnects(GBusType type);
+
+    private:
+        struct Bus {
+            GDBusConnection *connection;
+            gulong closedHandlerId;
+            unsigned long requests;
+            unsigned long connects;
+            unsigned long disconnects;
+        };
+
+        static Bus *getBus(GBusType type);
+        static GDBusConnection *connect(GBusType type);
+        static void closedCb(GDBusConnection *connection, gboolean remotePeerVanished, GError *error, gpointer user_data);
+
+    private: // variables
+        static Bus mSystemBus;  /*! The system bus connection */
+        static Bus mSessionBus; /*! The session bus connection */
+};
+
+/*! \class PhoneD::LatencyStats
+ *  \brief A class collecting samples of latency, eg. duration of D-Bus method calls, to report their percentiles.
+ *
+ * Only the latest samples are kept to compute the percentiles, while the number of samples and the maximum cover all samples.
+ */
+class LatencyStats {
+    public:
+        /**
+         * A default constructor. Constructs empty statistics.
+         */
+        LatencyStats();
+
+        /**
+         * Adds a sample. The oldest sample is dropped, once the capacity is reached.
+         * @param[in] usec The latency in microseconds.
+         */
+        void add(gint64 usec);
+
+        /**
+         * Computes a percentile of the latest samples.
+         * @param[in] percent The percentile to compute, in range 0 - 100, eg. \b 99 for p99.
+         * @return The latency in microseconds, or \b 0 if there aren't any samples.
+         */
+        gint64 percentile(unsigned int percent) const;
+
+        /**
+         * Formats the statistics as JSON object: \b {"count":N,"p50":N,"p90":N,"p99":N,"max":N}, the latencies are in microseconds.
+         * @param[out] json A container for the JSON object.
+         */
+        void toJson(std::string &json) const;
+
+        /**
+         * Gets the number of all added samples.
+         * @return The number of samples.
+         */
+        unsigned long count() const { return mCount; }
+
+        /**
+         * Gets the maximal latency of all added samples.
+         * @return The latency in microseconds.
+         */
+        gint64 max() const { return mMax; }
+
+    private:
+        std::vector<gint64> mSamples; // ring of the latest samples
+        size_t mNext;                 // position of the next sample in the ring
+        unsigned long mCount;
+        gint64 mMax;
 };
 
 /*! \class PhoneD::CtxCbData
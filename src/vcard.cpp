@@ -0,0 +1,210 @@
+
+#include "vcard.h"
+
+#include <string.h>
+
+#include "Logger.h"
+
+namespace PhoneD {
+
+#define VCARD_BEGIN                "BEGIN:VCARD"
+#define VCARD_END                  "END:VCARD"
+#define VCARD_CALL_DATETIME        "X-IRMC-CALL-DATETIME"
+
+// checks whether the line holds property 'name', ie. the line starts
+// with the 'name' followed by parameters (';'), or by the value (':')
+static bool isProperty(const char *begin, const char *end, const char *name) {
+    size_t len = strlen(name);
+    if((size_t)(end - begin) <= len)
+        return false;
+    if(g_ascii_strncasecmp(begin, name, len))
+        return false;
+    return begin[len] == ':' || begin[len] == ';';
+}
+
+static bool isLine(const char *begin, const char *end, const char *line) {
+    size_t len = strlen(line);
+    return ((size_t)(end - begin) == len) && !g_ascii_strncasecmp(begin, line, len);
+}
+
+VCardReader::VCardReader() :
+    mFile(NULL),
+    mData(NULL),
+    mLength(0),
+    mOffset(0)
+{
+}
+
+VCardReader::~VCardReader() {
+    close();
+}
+
+bool VCardReader::open(const char *filePath) {
+    close();
+
+    if(!filePath)
+        return false;
+
+    GError *err = NULL;
+    mFile = g_mapped_file_new(filePath, FALSE, &err);
+    if(!mFile) {
+        LoggerE("Failed to map file " << filePath << ": " << (err?err->message:"unknown error"));
+        if(err)
+            g_error_free(err);
+        return false;
+    }
+
+    mData = g_mapped_file_get_contents(mFile); // NULL for empty file
+    mLength = mData ? g_mapped_file_get_length(mFile) : 0;
+    mOffset = 0;
+
+    return true;
+}
+
+void VCardReader::open(const char *data, size_t length) {
+    close();
+
+    mData = data;
+    mLength = data ? length : 0;
+    mOffset = 0;
+}
+
+void VCardReader::close() {
+    if(mFile) {
+        g_mapped_file_unref(mFile);
+        mFile = NULL;
+    }
+    mData = NULL;
+    mLength = 0;
+    mOffset = 0;
+}
+
+bool VCardReader::nextLine(const char **begin, const char **end) {
+    if(mOffset >= mLength)
+        return false;
+
+    const char *limit = mData + mLength;
+    const char *line = mData + mOffset;
+    const char *eol = static_cast<const char*>(memchr(line, '\n', limit - line));
+    if(!eol)
+        eol = limit;
+    const char *lineEnd = (eol > line && eol[-1] == '\r') ? eol - 1 : eol;
+    size_t next = (eol - mData) + (eol < limit ? 1 : 0);
+
+    // the line is folded when the following one starts with a white space
+    if(next < mLength && (mData[next] == ' ' || mData[next] == '\t')) {
+        mLine.assign(line, lineEnd - line);
+        while(next < mLength && (mData[next] == ' ' || mData[next] == '\t')) {
+            const char *cont = mData + next + 1; // skip the folding white space
+            eol = static_cast<const char*>(memchr(cont, '\n', limit - cont));
+            if(!eol)
+                eol = limit;
+            lineEnd = (eol > cont && eol[-1] == '\r') ? eol - 1 : eol;
+            mLine.append(cont, lineEnd - cont);
+            next = (eol - mData) + (eol < limit ? 1 : 0);
+        }
+        *begin = mLine.data();
+        *end = mLine.data() + mLine.size();
+    }
+    else {
+        *begin = line;
+        *end = lineEnd;
+    }
+
+    mOffset = next;
+    return true;
+}
+
+void VCardReader::appendLine(const char *begin, const char *end, std::string &vcard) {
+    // the current implementation of EContact doesn't support
+    // X-IRMC-CALL-DATETIME field, so as a workaround we use
+    // two separate fields instead: E_CONTACT_NOTE
+    //                              E_CONTACT_REV
+    if(isProperty(begin, end, "NOTE") || isProperty(begin, end, "REV")) {
+        // exclude NOTE and REV as we are using it to store
+        // X-IRMC-CALL-DATETIME attribute
+    }
+    else if(isProperty(begin, end, "UID")) {
+        // exclude UID as we are creating own UID
+    }
+    else if(isProperty(begin, end, VCARD_CALL_DATETIME)) {
+        // X-IRMC-CALL-DATETIME;TYPE=MISSED:20140101T101010
+        // X-IRMC-CALL-DATETIME;MISSED:20140101T101010
+        const char *value = static_cast<const char*>(memchr(begin, ':', end - begin));
+        if(!value)
+            return;
+        const char *param = begin + strlen(VCARD_CALL_DATETIME);
+        const char *type = NULL, *typeEnd = NULL;
+        while(param < value && *param == ';') {
+            const char *paramEnd = param + 1;
+            while(paramEnd < value && *paramEnd != ';')
+                paramEnd++;
+            if(paramEnd - param > 5 && !g_ascii_strncasecmp(param + 1, "TYPE=", 5)) {
+                type = param + 6;
+                typeEnd = paramEnd;
+                break;
+            }
+            if(!type) { // bare parameter, eg. vCard 2.1 style
+                type = param + 1;
+                typeEnd = paramEnd;
+            }
+            param = paramEnd;
+        }
+        if(type && typeEnd > type) {
+            vcard.append("NOTE:", 5);
+            vcard.append(type, typeEnd - type);
+            vcard += '\n';
+        }
+        vcard.append("REV:", 4);
+        vcard.append(value + 1, end - value - 1);
+        vcard += '\n';
+    }
+    else {
+        vcard.append(begin, end - begin);
+        vcard += '\n';
+    }
+}
+
+bool VCardReader::next(std::string &vcard) {
+    bool inCard = false;
+    const char *begin = NULL, *end = NULL;
+    while(nextLine(&begin, &end)) {
+        if(isLine(begin, end, VCARD_BEGIN)) {
+            vcard.clear(); // start collecting new VCard
+            vcard.append(begin, end - begin);
+            vcard += '\n';
+            inCard = true;
+        }
+        else if(!inCard) {
+            // garbage between the VCards - ignore it
+        }
+        else if(isLine(begin, end, VCARD_END)) {
+            vcard.append(begin, end - begin);
+            vcard += '\n';
+            return true;
+        }
+        else {
+            appendLine(begin, end, vcard);
+        }
+    }
+    return false;
+}
+
+size_t VCardReader::findVCard(const char *data, size_t length, size_t offset) {
+    while(offset < length) {
+        const char *line = data + offset;
+        const char *eol = static_cast<const char*>(memchr(line, '\n', length - offset));
+        const char *end = eol ? eol : data + length;
+        if(end > line && end[-1] == '\r')
+            end--;
+        if(isLine(line, end, VCARD_BEGIN))
+            return offset;
+        if(!eol)
+            break;
+        offset = (eol - data) + 1;
+    }
+    return length;
+}
+
+} // PhoneD
+
@@ -0,0 +1,87 @@
+#ifndef VCARD_H_
+#define VCARD_H_
+
+#include <glib.h>
+#include <string>
+
+namespace PhoneD {
+
+/**
+ * @addtogroup phoned
+ * @{
+ */
+
+/*! \class PhoneD::VCardReader
+ *  \brief Streaming tokenizer for files containing VCards pulled over PBAP.
+ *
+ * The file is memory-mapped and scanned on raw bytes: card boundaries are detected on \b BEGIN:VCARD / \b END:VCARD lines, folded lines are
+ * un-folded, and the properties which phoned does not take over from the phone (\b UID, \b NOTE, \b REV) are dropped. \b X-IRMC-CALL-DATETIME
+ * property, which is not supported by EContact, is rewritten into \b NOTE (call direction) and \b REV (call date/time) properties. The card is
+ * written into a buffer provided by the caller, so that reading the cards one-by-one with the same buffer doesn't allocate memory per line.
+ */
+class VCardReader {
+    public:
+        /**
+         * A default constructor. Constructs the object, no file is opened.
+         */
+        VCardReader();
+
+        /**
+         * A destructor. Unmaps the file, if it is opened.
+         */
+        ~VCardReader();
+
+        /**
+         * Memory-maps the file containing the VCards. Already opened file is closed first.
+         * @param[in] filePath A path to the file containing the VCards.
+         * @return \b True if the file has been opened successfully, otherwise returns \b false.
+         */
+        bool open(const char *filePath);
+
+        /**
+         * Opens VCards in memory, eg. a part of already mapped file. The data are not copied, they have to be valid until the reader is closed.
+         * @param[in] data The VCards.
+         * @param[in] length Length of the data.
+         */
+        void open(const char *data, size_t length);
+
+        /**
+         * Unmaps the file opened via open() method.
+         */
+        void close();
+
+        /**
+         * Reads the next VCard from the file. The lines of the VCard are terminated by \b '\\n'.
+         * @param[out] vcard A buffer for the VCard. The content of the buffer is replaced, but its capacity is reused.
+         * @return \b True if the VCard has been read, or \b false if there are no more VCards in the file.
+         */
+        bool next(std::string &vcard);
+
+        /**
+         * Finds the beginning of the VCard, ie. \b BEGIN:VCARD line, at, or after given offset. It is used to split the VCards into parts, which can be read independently.
+         * @param[in] data The VCards.
+         * @param[in] length Length of the data.
+         * @param[in] offset Offset in the data to start the search at. It has to be at the beginning of a line.
+         * @return Offset of the beginning of the VCard, or \b length, if there is no VCard after the offset.
+         */
+        static size_t findVCard(const char *data, size_t length, size_t offset);
+
+    private:
+        // reads next logical (un-folded) line; 'begin'/'end' point either to the mapped data, or to mLine
+        bool nextLine(const char **begin, const char **end);
+        void appendLine(const char *begin, const char *end, std::string &vcard);
+
+    private:
+        GMappedFile *mFile;
+        const char *mData;
+        size_t mLength;
+        size_t mOffset;
+        std::string mLine; // scratch buffer for un-folding lines
+};
+
+} // PhoneD
+
+#endif /* VCARD_H_ */
+
+/** @} */
+
@@ -1,9 +1,21 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <string>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <json-glib/json-glib.h>
 
 #include "../src/Logger.h"
+#include "../src/vcard.h"
+#include "../src/pblist.h"
+#include "../src/jsonwriter.h"
 
 #define TIZEN_PREFIX            "org.tizen"
 #define PHONE_SERVICE           TIZEN_PREFIX ".phone"
@@ -29,6 +41,11 @@ static void hangupCall();
 static void activeCall();
 static void synchronize();
 static void getContacts();
+static void benchContacts();
+static void benchPredict();
+static void benchVCards();
+static void benchHistory();
+static void benchJson();
 static void getCallHistory();
 static void restart();
 static void pairDevice(const char* bt_address);
@@ -199,6 +216,16 @@ void * command_handler(void *data) {
                 synchronize();
             else if(!strncmp(command, "contacts", 8))
                 getContacts();
+            else if(!strncmp(command, "benchpredict", 12))
+                benchPredict();
+            else if(!strncmp(command, "benchvcard", 10))
+                benchVCards();
+            else if(!strncmp(command, "benchhistory", 12))
+                benchHistory();
+            else if(!strncmp(command, "benchjson", 9))
+                benchJson();
+            else if(!strncmp(command, "bench", 5))
+                benchContacts();
             else if(!strncmp(command, "history", 7))
                 getCallHistory();
             else if(!strncmp(command, "restart", 7))
@@ -216,6 +243,11 @@ void * command_handler(void *data) {
                 LoggerD("\tstate");
                 LoggerD("\tsynchronize");
                 LoggerD("\tcontacts");
+                LoggerD("\tbench");
+                LoggerD("\tbenchpredict");
+                LoggerD("\tbenchvcard");
+                LoggerD("\tbenchhistory");
+                LoggerD("\tbenchjson");
                 LoggerD("\thistory");
                 LoggerD("\trestart");
             }
@@ -620,6 +652,562 @@ void getContacts() {
     g_variant_unref(reply);
 }
 
+// reads the names of the contacts, as a client displaying the list would do
+static unsigned int readContactsVariant(GVariant *contacts) {
+    unsigned int count = 0;
+    GVariantIter iter;
+    GVariant *contact;
+    g_variant_iter_init(&iter, contacts);
+    while((contact = g_variant_iter_next_value(&iter))) {
+        const char *name = NULL;
+        if(g_variant_lookup(contact, "displayName", "&s", &name) && name)
+            count++;
+        g_variant_unref(contact);
+    }
+    return count;
+}
+
+static unsigned int readContactsJson(const char *contacts) {
+    unsigned int count = 0;
+    JsonParser *parser = json_parser_new();
+    if(json_parser_load_from_data(parser, contacts, -1, NULL) && JSON_NODE_HOLDS_ARRAY(json_parser_get_root(parser))) {
+        JsonArray *array = json_node_get_array(json_parser_get_root(parser));
+        for(guint i=0; i<json_array_get_length(array); i++) {
+            JsonObject *contact = json_array_get_object_element(array, i);
+            JsonObject *name = contact && json_object_has_member(contact, "name") ? json_object_get_object_member(contact, "name") : NULL;
+            if(name && json_object_has_member(name, "displayName"))
+                count++;
+        }
+    }
+    g_object_unref(parser);
+    return count;
+}
+
+// compares the transfer of all contacts as JSON string (GetContacts), typed dictionaries (GetContactsVariant) and memory file
+// (GetContactsFd); the call includes the serialization by phoned, the decoding is done by the client
+void benchContacts() {
+    LoggerD("entered");
+
+    GDBusConnection *connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    GError *error = NULL;
+
+    // JSON
+    gint64 start = g_get_monotonic_time();
+    GVariant *reply = g_dbus_connection_call_sync( connection, PHONE_SERVICE, PHONE_OBJ_PATH, PHONE_IFACE, "GetContacts",
+                                                   g_variant_new("(u)", 0), G_VARIANT_TYPE("(s)"),
+                                                   G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+    if(reply) {
+        gint64 called = g_get_monotonic_time();
+        const char *json = NULL;
+        g_variant_get(reply, "(&s)", &json);
+        unsigned int count = readContactsJson(json);
+        printf("GetContacts:        %u contacts, %zu bytes, call %lld us, decode %lld us\n", count, strlen(json),
+               (long long)(called - start), (long long)(g_get_monotonic_time() - called));
+        g_variant_unref(reply);
+    }
+
+    // typed dictionaries
+    start = g_get_monotonic_time();
+    reply = error ? NULL : g_dbus_connection_call_sync( connection, PHONE_SERVICE, PHONE_OBJ_PATH, PHONE_IFACE, "GetContactsVariant",
+                                                        g_variant_new("(uus)", 0, 0, ""), G_VARIANT_TYPE("(aa{sv})"),
+                                                        G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+    if(reply) {
+        gint64 called = g_get_monotonic_time();
+        GVariant *contacts = g_variant_get_child_value(reply, 0);
+        unsigned int count = readContactsVariant(contacts);
+        printf("GetContactsVariant: %u contacts, %zu bytes, call %lld us, decode %lld us\n", count, g_variant_get_size(contacts),
+               (long long)(called - start), (long long)(g_get_monotonic_time() - called));
+        g_variant_unref(contacts);
+        g_variant_unref(reply);
+    }
+
+    // memory file
+    GUnixFDList *fds = NULL;
+    start = g_get_monotonic_time();
+    reply = error ? NULL : g_dbus_connection_call_with_unix_fd_list_sync( connection, PHONE_SERVICE, PHONE_OBJ_PATH, PHONE_IFACE, "GetContactsFd",
+                                                                          g_variant_new("(uus)", 0, 0, ""), G_VARIANT_TYPE("(ht)"),
+                                                                          G_DBUS_CALL_FLAGS_NONE, -1, NULL, &fds, NULL, &error);
+    if(reply) {
+        gint64 called = g_get_monotonic_time();
+        gint32 handle = -1;
+        guint64 size = 0;
+        g_variant_get(reply, "(ht)", &handle, &size);
+        unsigned int count = 0;
+        int fd = (size > 0 && fds) ? g_unix_fd_list_get(fds, handle, NULL) : -1; // there is no file for empty page
+        if(fd >= 0) {
+            void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+            if(data != MAP_FAILED) {
+                GVariant *contacts = g_variant_new_from_data(G_VARIANT_TYPE("aa{sv}"), data, size, FALSE, NULL, NULL);
+                count = readContactsVariant(contacts);
+                g_variant_unref(contacts);
+                munmap(data, size);
+            }
+            close(fd);
+        }
+        printf("GetContactsFd:      %u contacts, %llu bytes, call %lld us, decode %lld us\n", count, (unsigned long long)size,
+               (long long)(called - start), (long long)(g_get_monotonic_time() - called));
+        g_variant_unref(reply);
+    }
+    if(fds)
+        g_object_unref(fds);
+
+    if(error) {
+        LoggerE("Failed to request Contacts: " << error->message);
+        g_error_free(error);
+    }
+}
+
+// types the digits on the dial pad one by one, as the dialer would do, and measures PredictContacts; the duration of the look-up
+// in phoned, without the serialization and D-Bus, is reported by GetStatistics as "predictContacts"
+#define BENCH_PREDICT_DIGITS        "5264"
+#define BENCH_PREDICT_ITERATIONS    100
+#define BENCH_PREDICT_LIMIT         20
+
+void benchPredict() {
+    LoggerD("entered");
+
+    GDBusConnection *connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    std::string digits;
+    for(const char *digit = BENCH_PREDICT_DIGITS; *digit; digit++) {
+        digits += *digit;
+        gint64 total = 0, worst = 0;
+        for(int i=0; i<BENCH_PREDICT_ITERATIONS; i++) {
+            GError *error = NULL;
+            gint64 start = g_get_monotonic_time();
+            GVariant *reply = g_dbus_connection_call_sync( connection, PHONE_SERVICE, PHONE_OBJ_PATH, PHONE_IFACE, "PredictContacts",
+                                                           g_variant_new("(su)", digits.c_str(), BENCH_PREDICT_LIMIT), G_VARIANT_TYPE("(s)"),
+                                                           G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+            if(!reply) {
+                LoggerE("Failed to predict Contacts: " << (error?error->message:"unknown error"));
+                if(error)
+                    g_error_free(error);
+                return;
+            }
+            gint64 duration = g_get_monotonic_time() - start;
+            total += duration;
+            worst = MAX(worst, duration);
+            g_variant_unref(reply);
+        }
+        printf("PredictContacts(\"%s\"): avg %lld us, max %lld us\n", digits.c_str(),
+               (long long)(total / BENCH_PREDICT_ITERATIONS), (long long)worst);
+    }
+
+    GVariant *reply = g_dbus_connection_call_sync( connection, PHONE_SERVICE, PHONE_OBJ_PATH, PHONE_IFACE, "GetStatistics",
+                                                   NULL, G_VARIANT_TYPE("(s)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+    if(reply) {
+        const char *statistics = NULL;
+        g_variant_get(reply, "(&s)", &statistics);
+        printf("%s\n", statistics);
+        g_variant_unref(reply);
+    }
+}
+
+// compares reading of the VCards pulled over PBAP by VCardReader with the previous getline() loop of Obex::processVCards(), on
+// a generated dump of a large phonebook; only the tokenizing is measured, without the parsing by EContact
+#define BENCH_VCARD_COUNT           5000
+
+static void makeVCards(std::string &vcards) {
+    char line[128];
+    for(int i=0; i<BENCH_VCARD_COUNT; i++) {
+        vcards += "BEGIN:VCARD\r\nVERSION:3.0\r\n";
+        snprintf(line, sizeof(line), "FN:Contact %d\r\nN:%d;Contact;;;\r\n", i, i);
+        vcards += line;
+        snprintf(line, sizeof(line), "TEL;TYPE=CELL:+42190%07d\r\nTEL;TYPE=HOME:02%07d\r\n", i, i);
+        vcards += line;
+        snprintf(line, sizeof(line), "EMAIL;TYPE=INTERNET:contact%d@example.com\r\n", i);
+        vcards += line;
+        vcards += "ADR;TYPE=HOME:;;Main Street 1;Bratislava;;81101;Slovakia\r\n";
+        vcards += "UID:0123456789\r\nREV:20140101T101010Z\r\n";
+        snprintf(line, sizeof(line), "X-IRMC-CALL-DATETIME;TYPE=MISSED:201401%02dT101010\r\n", i % 28 + 1);
+        vcards += line;
+        if(i % 10 == 0) { // a folded photo
+            vcards += "PHOTO;ENCODING=b;TYPE=JPEG:/9j/4AAQSkZJRgABAQEASABIAAD/2wBDAAMCAgICAgMCAgIDAwMDBAYEBAQEBAgGBgUGCQgKCgkI\r\n";
+            for(int j=0; j<20; j++)
+                vcards += " CQkKDA8MCgsOCwkJDRENDhAQERIRCgwTFBMQFA8QERD/2wBDAQMDAwQDBAgEBAgQCwkLEBAQEBAQ\r\n";
+        }
+        vcards += "END:VCARD\r\n";
+    }
+}
+
+// the loop of Obex::processVCards() before VCardReader, the VCards are collected the same way, they are only counted
+static unsigned int readVCardsGetline(const char *filePath, size_t &length) {
+    unsigned int count = 0;
+    std::ifstream file(filePath);
+    std::string vcard;
+    for(std::string line; getline(file, line);)
+    {
+        line.replace(line.find("\r"), 1, "\n");
+
+        if(line.find("BEGIN:VCARD") == 0) {
+            vcard = line; // start collecting new VCard
+        }
+        else if(line.find("END:VCARD") == 0) {
+            vcard += line;
+            length += vcard.length();
+            count++;
+        }
+        else {
+            if((line.find("NOTE") == 0) || (line.find("REV") == 0)) {
+                // excluded
+            }
+            else if(line.find("UID") == 0) {
+                // excluded
+            }
+            else if(line.find("X-IRMC-CALL-DATETIME") == 0) {
+                size_t index1 = line.find( "TYPE=" ) + 5;
+                size_t index2 = line.find( ":", index1 ) + 1;
+
+                std::string note = line.substr (index1, index2-index1-1);
+                std::string rev = line.substr (index2, line.length()-index2);
+
+                vcard += "NOTE:" + note + "\n";
+                vcard += "REV:" + rev; // '\n' is taken from 'line'
+            }
+            else {
+                vcard += line;
+            }
+        }
+    }
+    return count;
+}
+
+static unsigned int readVCardsReader(const char *filePath, size_t &length) {
+    unsigned int count = 0;
+    PhoneD::VCardReader reader;
+    if(!reader.open(filePath))
+        return 0;
+    std::string vcard;
+    while(reader.next(vcard)) {
+        length += vcard.length();
+        count++;
+    }
+    return count;
+}
+
+void benchVCards() {
+    LoggerD("entered");
+
+    std::string vcards;
+    makeVCards(vcards);
+    gchar *filePath = NULL;
+    int fd = g_file_open_tmp("phoned-vcards-XXXXXX", &filePath, NULL);
+    if(fd < 0) {
+        LoggerE("Failed to create file for VCards");
+        return;
+    }
+    close(fd);
+    if(!g_file_set_contents(filePath, vcards.data(), vcards.size(), NULL)) {
+        LoggerE("Failed to write VCards: " << filePath);
+        g_unlink(filePath);
+        g_free(filePath);
+        return;
+    }
+
+    // the file is read once before, so that both readers find it in the page cache
+    size_t length = 0;
+    readVCardsReader(filePath, length);
+
+    length = 0;
+    gint64 start = g_get_monotonic_time();
+    unsigned int count = readVCardsGetline(filePath, length);
+    printf("getline:     %u VCards, %zu bytes, %lld us\n", count, length, (long long)(g_get_monotonic_time() - start));
+
+    length = 0;
+    start = g_get_monotonic_time();
+    count = readVCardsReader(filePath, length);
+    printf("VCardReader: %u VCards, %zu bytes, %lld us\n", count, length, (long long)(g_get_monotonic_time() - start));
+
+    g_unlink(filePath);
+    g_free(filePath);
+}
+
+// compares PBList with the previous std::map keyed by UID and std::vector of UIDs keeping the order, on the refreshes of a large
+// call history: the new calls are inserted at the front, then the client pages through the history
+#define BENCH_HISTORY_SIZE          5000
+#define BENCH_HISTORY_REFRESHES     100
+#define BENCH_HISTORY_CALLS         10
+#define BENCH_HISTORY_PAGE          20
+
+static void makeHistoryEntries(int count, int first, std::vector<PhoneD::PBEntryPtr> &entries) {
+    char uid[32];
+    for(int i=0; i<count; i++) {
+        PhoneD::PBEntry *entry = new PhoneD::PBEntry();
+        snprintf(uid, sizeof(uid), "+42190%07d:20140101T%06d", (first + i) % 1000, first + i);
+        entry->uid = uid;
+        entries.push_back(PhoneD::PBEntryPtr(entry));
+    }
+}
+
+void benchHistory() {
+    LoggerD("entered");
+
+    std::vector<PhoneD::PBEntryPtr> entries;
+    makeHistoryEntries(BENCH_HISTORY_SIZE + BENCH_HISTORY_REFRESHES * BENCH_HISTORY_CALLS, 0, entries);
+    size_t found = 0;
+
+    // std::map and std::vector, the previous implementation
+    std::map<std::string, const PhoneD::PBEntry*> items;
+    std::vector<std::string> order;
+    for(int i=0; i<BENCH_HISTORY_SIZE; i++) {
+        items[entries[i]->uid] = entries[i].get();
+        order.push_back(entries[i]->uid);
+    }
+    gint64 refresh = 0, paging = 0;
+    for(int r=0; r<BENCH_HISTORY_REFRESHES; r++) {
+        gint64 start = g_get_monotonic_time();
+        for(int i=0; i<BENCH_HISTORY_CALLS; i++) {
+            const PhoneD::PBEntryPtr &entry = entries[BENCH_HISTORY_SIZE + r * BENCH_HISTORY_CALLS + i];
+            if(items[entry->uid] == NULL) {
+                items[entry->uid] = entry.get();
+                order.insert(order.begin() + i, entry->uid);
+            }
+        }
+        gint64 refreshed = g_get_monotonic_time();
+        for(size_t offset=0; offset<order.size(); offset+=BENCH_HISTORY_PAGE) {
+            for(size_t i=offset; i<offset+BENCH_HISTORY_PAGE && i<order.size(); i++) {
+                auto it = items.find(order[i]);
+                if(it != items.end() && (*it).second)
+                    found++;
+            }
+        }
+        refresh += refreshed - start;
+        paging += g_get_monotonic_time() - refreshed;
+    }
+    printf("std::map: %zu entries, refresh avg %lld us, paging avg %lld us\n", order.size(),
+           (long long)(refresh / BENCH_HISTORY_REFRESHES), (long long)(paging / BENCH_HISTORY_REFRESHES));
+
+    // PBList
+    PhoneD::PBList list;
+    for(int i=0; i<BENCH_HISTORY_SIZE; i++)
+        list.pushBack(entries[i]);
+    refresh = 0;
+    paging = 0;
+    for(int r=0; r<BENCH_HISTORY_REFRESHES; r++) {
+        gint64 start = g_get_monotonic_time();
+        for(int i=0; i<BENCH_HISTORY_CALLS; i++)
+            list.insert(i, entries[BENCH_HISTORY_SIZE + r * BENCH_HISTORY_CALLS + i]);
+        gint64 refreshed = g_get_monotonic_time();
+        for(size_t offset=0; offset<list.size(); offset+=BENCH_HISTORY_PAGE) {
+            for(size_t i=offset; i<offset+BENCH_HISTORY_PAGE && i<list.size(); i++) {
+                if(list.at(i))
+                    found++;
+            }
+        }
+        refresh += refreshed - start;
+        paging += g_get_monotonic_time() - refreshed;
+    }
+    printf("PBList:   %zu entries, refresh avg %lld us, paging avg %lld us\n", list.size(),
+           (long long)(refresh / BENCH_HISTORY_REFRESHES), (long long)(paging / BENCH_HISTORY_REFRESHES));
+
+    // the entries, which have been found, are only reported, so that the look-ups are not optimized out
+    LoggerD("Paged entries: " << found);
+}
+
+// compares serialization of the contacts of a generated phonebook as tizen.Contact JSON by JsonWriter, the same way as
+// Obex::parseEntryToJsonTizenContact() does, with the previous concatenation of the strings, which didn't escape them
+#define BENCH_JSON_CONTACTS         20000
+#define BENCH_JSON_RESERVE          512 // JSON_CONTACT_RESERVE of phoned
+
+struct BenchContact {
+    std::string uid;
+    std::string firstName;
+    std::string lastName;
+    std::string displayName;
+    std::string photoURI;
+    std::vector<std::string> numbers;
+    std::vector<std::string> emails;
+    std::string address[6]; // type, country, region, city, street, postal code
+};
+
+static void makeBenchContacts(std::vector<BenchContact> &contacts) {
+    char buffer[128];
+    contacts.resize(BENCH_JSON_CONTACTS);
+    for(int i=0; i<BENCH_JSON_CONTACTS; i++) {
+        BenchContact &contact = contacts[i];
+        snprintf(buffer, sizeof(buffer), "%d:+42190%07d", i, i);
+        contact.uid = buffer;
+        snprintf(buffer, sizeof(buffer), "Contact%d", i);
+        contact.firstName = buffer;
+        contact.lastName = "Novak";
+        contact.displayName = contact.firstName + " " + contact.lastName;
+        if(i % 4 == 0) {
+            snprintf(buffer, sizeof(buffer), "file:///home/app/.phoned-photos/%040d.jif", i);
+            contact.photoURI = buffer;
+        }
+        snprintf(buffer, sizeof(buffer), "+42190%07d", i);
+        contact.numbers.push_back(buffer);
+        snprintf(buffer, sizeof(buffer), "02%07d", i);
+        contact.numbers.push_back(buffer);
+        snprintf(buffer, sizeof(buffer), "contact%d@example.com", i);
+        contact.emails.push_back(buffer);
+        if(i % 2 == 0) {
+            const char *address[] = { "HOME", "Slovakia", "", "Bratislava", "Main Street 1", "81101" };
+            for(int a=0; a<6; a++)
+                contact.address[a] = address[a];
+        }
+    }
+}
+
+// the concatenation of parseEContactToJsonTizenContact() before JsonWriter
+static void makeJsonConcatenated(const BenchContact &c, std::string &contact) {
+    contact = "{";
+    contact += "\"uid\":\"";
+    contact += c.uid;
+    contact += "\"";
+
+    if(!c.numbers.empty()) {
+        contact += ",\"personId\":\"";
+        contact += c.numbers[0];
+        contact += "\"";
+    }
+
+    contact += ",\"name\":{";
+    bool firstAttr = true;
+    if(!c.firstName.empty()) {
+        firstAttr = false;
+        contact += "\"firstName\":\"";
+        contact += c.firstName;
+        contact += "\"";
+    }
+    if(!c.lastName.empty()) {
+        contact += firstAttr ? "\"lastName\":\"" : ",\"lastName\":\"";
+        firstAttr = false;
+        contact += c.lastName;
+        contact += "\"";
+    }
+    if(!c.displayName.empty()) {
+        contact += firstAttr ? "\"displayName\":\"" : ",\"displayName\":\"";
+        firstAttr = false;
+        contact += c.displayName;
+        contact += "\"";
+    }
+    contact += "}";
+
+    contact += ",\"addresses\":[";
+    if(!c.address[0].empty()) {
+        const char *keys[] = { NULL, ",\"country\":\"", ",\"region\":\"", ",\"city\":\"", ",\"streetAddress\":\"", ",\"postalCode\":\"" };
+        contact += "{";
+        contact += "\"isDefault\":\"false\"";
+        for(int a=1; a<6; a++) {
+            if(!c.address[a].empty()) {
+                contact += keys[a];
+                contact += c.address[a];
+                contact += "\"";
+            }
+        }
+        contact += ",\"types\":[\"";
+        contact += c.address[0];
+        contact += "\"]";
+        contact += "}";
+    }
+    contact += "]";
+
+    if(!c.photoURI.empty()) {
+        contact += ",\"photoURI\":\"";
+        contact += c.photoURI;
+        contact += "\"";
+    }
+
+    contact += ",\"phoneNumbers\":[";
+    for(unsigned int i=0; i<c.numbers.size(); i++) {
+        contact += i==0 ? "{\"number\":\"" : ",{\"number\":\"";
+        contact += c.numbers[i];
+        contact += "\"}";
+    }
+    contact += "]";
+
+    contact += ",\"emails\":[";
+    for(unsigned int i=0; i<c.emails.size(); i++) {
+        contact += i==0 ? "{\"email\":\"" : ",{\"email\":\"";
+        contact += c.emails[i];
+        contact += "\"";
+        contact += ",\"isDefault\":\"false\"";
+        contact += ",\"types\":[\"WORK\"]";
+        contact += "}";
+    }
+    contact += "]";
+
+    contact += "}";
+}
+
+static void makeJsonWriter(const BenchContact &c, std::string &contact) {
+    PhoneD::JsonWriter json(contact, BENCH_JSON_RESERVE);
+    json.beginObject();
+    json.string("uid", c.uid.c_str());
+    json.optionalString("personId", c.numbers.empty() ? NULL : c.numbers[0].c_str());
+
+    json.beginObject("name");
+    json.optionalString("firstName", c.firstName.c_str());
+    json.optionalString("lastName", c.lastName.c_str());
+    json.optionalString("displayName", c.displayName.c_str());
+    json.endObject();
+
+    json.beginArray("addresses");
+    if(!c.address[0].empty()) {
+        json.beginObject();
+        json.string("isDefault", "false");
+        json.optionalString("country", c.address[1].c_str());
+        json.optionalString("region", c.address[2].c_str());
+        json.optionalString("city", c.address[3].c_str());
+        json.optionalString("streetAddress", c.address[4].c_str());
+        json.optionalString("postalCode", c.address[5].c_str());
+        json.beginArray("types");
+        json.string(NULL, c.address[0].c_str());
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+
+    json.optionalString("photoURI", c.photoURI.c_str());
+
+    json.beginArray("phoneNumbers");
+    for(unsigned int i=0; i<c.numbers.size(); i++) {
+        json.beginObject();
+        json.string("number", c.numbers[i].c_str());
+        json.endObject();
+    }
+    json.endArray();
+
+    json.beginArray("emails");
+    for(unsigned int i=0; i<c.emails.size(); i++) {
+        json.beginObject();
+        json.string("email", c.emails[i].c_str());
+        json.string("isDefault", "false");
+        json.beginArray("types");
+        json.string(NULL, "WORK");
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+
+    json.endObject();
+}
+
+void benchJson() {
+    LoggerD("entered");
+
+    std::vector<BenchContact> contacts;
+    makeBenchContacts(contacts);
+
+    // each contact is serialized into its own string, as the entries are, the strings are freed after the time is taken
+    for(int pass=0; pass<2; pass++) {
+        std::vector<std::string> json(contacts.size());
+        size_t length = 0;
+        gint64 start = g_get_monotonic_time();
+        for(size_t i=0; i<contacts.size(); i++) {
+            if(pass == 0)
+                makeJsonConcatenated(contacts[i], json[i]);
+            else
+                makeJsonWriter(contacts[i], json[i]);
+        }
+        gint64 duration = g_get_monotonic_time() - start;
+        for(size_t i=0; i<json.size(); i++)
+            length += json[i].length();
+        printf("%s %zu contacts, %zu bytes, %lld us\n", pass == 0 ? "concatenation:" : "JsonWriter:   ", contacts.size(), length,
+               (long long)duration);
+    }
+}
+
 void getCallHistory() {
     LoggerD("entered");
 